@@ -0,0 +1,110 @@
+#include "hostThread.h"
+
+// how long an idle network thread waits on the socket before looking at the outgoing queue again
+static constexpr enet_uint32 idle_wait_ms = 1;
+
+HostThread::HostThread(ENetHost *host) : host(host)
+{
+}
+
+HostThread::~HostThread()
+{
+  stop();
+}
+
+void HostThread::start()
+{
+  if (running.exchange(true))
+    return;
+  thread = std::thread(&HostThread::run, this);
+}
+
+void HostThread::stop()
+{
+  running.store(false);
+  if (thread.joinable())
+    thread.join();
+
+  HostEvent event;
+  while (incoming.TryPop(event))
+    if (event.packet)
+      enet_packet_destroy(event.packet);
+  Outgoing out;
+  while (outgoing.TryPop(out))
+    enet_packet_destroy(out.packet);
+}
+
+bool HostThread::receive(HostEvent &event)
+{
+  return incoming.TryPop(event);
+}
+
+void HostThread::send(ENetPeer *peer, uint8_t channel, ENetPacket *packet)
+{
+  Outgoing out;
+  out.peer = peer;
+  out.channel = channel;
+  out.packet = packet;
+  // drained every millisecond at worst, a full queue is a short wait
+  while (!outgoing.TryPush(out))
+    std::this_thread::yield();
+}
+
+void HostThread::run()
+{
+  while (running.load(std::memory_order_relaxed))
+  {
+    if (pump())
+      continue;
+    enet_uint32 condition = ENET_SOCKET_WAIT_RECEIVE;
+    enet_socket_wait(host->socket, &condition, idle_wait_ms);
+  }
+}
+
+bool HostThread::pump()
+{
+  bool busy = false;
+  Outgoing out;
+  while (outgoing.TryPop(out))
+  {
+    busy = true;
+    if (enet_peer_send(out.peer, out.channel, out.packet) == 0)
+      on_send(out.peer, out.packet);
+    else if (out.packet->referenceCount == 0)
+      enet_packet_destroy(out.packet); // the peer is gone, nobody else holds it
+  }
+  if (busy)
+    enet_host_flush(host);
+
+  ENetEvent event;
+  int result = enet_host_service(host, &event, 0);
+  while (result > 0)
+  {
+    busy = true;
+    deliver(event);
+    result = enet_host_check_events(host, &event);
+  }
+  return busy;
+}
+
+void HostThread::deliver(const ENetEvent &event)
+{
+  on_event(event);
+  HostEvent hostEvent;
+  hostEvent.type = event.type;
+  hostEvent.peer = event.peer;
+  hostEvent.address = event.peer->address;
+  hostEvent.packet = event.packet;
+  if (event.type == ENET_EVENT_TYPE_RECEIVE)
+  {
+    if (!incoming.TryPush(hostEvent))
+    {
+      enet_packet_destroy(event.packet);
+      droppedReceives.fetch_add(1, std::memory_order_relaxed);
+    }
+    return;
+  }
+  // the game thread's list of peers depends on seeing every connect and disconnect
+  while (!incoming.TryPush(hostEvent) && running.load(std::memory_order_relaxed))
+    std::this_thread::yield();
+}
@@ -0,0 +1,77 @@
+#pragma once
+// A server's ENetHost serviced on a thread of its own, so a tick never blocks
+// in ENet and ENet never waits for a tick to finish before it receives and
+// acknowledges. Unlike w5's NetworkThread it knows nothing of the protocol:
+// packets cross the two single producer, single consumer queues as they are,
+// the game thread builds what it sends and reads what it receives.
+#include <enet/enet.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include "spscQueue.h"
+
+// a connect, disconnect or received packet, as the game thread gets it
+struct HostEvent
+{
+  ENetEventType type = ENET_EVENT_TYPE_NONE;
+  // the game thread keys its own state on it, only the network thread reads what it points to
+  ENetPeer *peer = nullptr;
+  ENetAddress address = {};
+  // received packets only, destroying it is up to the game thread
+  ENetPacket *packet = nullptr;
+};
+
+class HostThread
+{
+public:
+  // the receives of a few ticks, and every send of a tick at a few thousand peers
+  static constexpr size_t incoming_queue_size = 1 << 14;
+  static constexpr size_t outgoing_queue_size = 1 << 16;
+
+  // the host must not be used by anyone else between start() and stop()
+  explicit HostThread(ENetHost *host);
+  // a subclass overriding the hooks has to stop() in its own destructor
+  virtual ~HostThread();
+
+  void start();
+  // joins the thread and destroys the packets still queued either way
+  void stop();
+
+  // game thread only
+  bool receive(HostEvent &event);
+  // the packet belongs to the network thread from here on, a peer that
+  // disconnected before it got there doesn't get it
+  void send(ENetPeer *peer, uint8_t channel, ENetPacket *packet);
+
+  // packets thrown away because the game thread wasn't keeping up
+  uint64_t dropped_receives() const { return droppedReceives.load(std::memory_order_relaxed); }
+
+protected:
+  // One pass of the network thread: send and flush what the game thread
+  // queued, then service the host without blocking. Returns whether there was
+  // anything to do, if not the thread waits on the socket for a millisecond.
+  virtual bool pump();
+  // on the network thread, as a packet is taken by ENet and as an event comes out of it
+  virtual void on_send(ENetPeer *, const ENetPacket *) {}
+  virtual void on_event(const ENetEvent &) {}
+
+  ENetHost *host;
+
+private:
+  struct Outgoing
+  {
+    ENetPeer *peer = nullptr;
+    uint8_t channel = 0;
+    ENetPacket *packet = nullptr;
+  };
+
+  void run();
+  void deliver(const ENetEvent &event);
+
+  std::thread thread;
+  std::atomic<bool> running{false};
+  SpscQueue<HostEvent> incoming{incoming_queue_size};
+  SpscQueue<Outgoing> outgoing{outgoing_queue_size};
+  std::atomic<uint64_t> droppedReceives{0};
+};
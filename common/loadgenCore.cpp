@@ -0,0 +1,203 @@
+#include "loadgenCore.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// bots share hosts, thousands of them shouldn't need thousands of sockets
+constexpr size_t bots_per_host = 64;
+constexpr double report_interval_ms = 1000.0;
+
+void LatencyHistogram::add(double ms)
+{
+  size_t bucket = std::min(size_t(std::max(ms, 0.0) / bucket_ms), num_buckets);
+  buckets[bucket]++;
+  total++;
+  maxMs = std::max(maxMs, ms);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+  for (size_t i = 0; i <= num_buckets; ++i)
+    buckets[i] += other.buckets[i];
+  total += other.total;
+  maxMs = std::max(maxMs, other.maxMs);
+}
+
+double LatencyHistogram::percentile(double p) const
+{
+  uint64_t rank = uint64_t(p * total);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < num_buckets; ++i)
+  {
+    seen += buckets[i];
+    if (seen > rank)
+      return (i + 1) * bucket_ms;
+  }
+  return maxMs;
+}
+
+void LoadStats::merge(const LoadStats &other)
+{
+  snapshots += other.snapshots;
+  bytesIn += other.bytesIn;
+  bytesOut += other.bytesOut;
+  disconnects += other.disconnects;
+  latency.merge(other.latency);
+}
+
+double now_ms()
+{
+  using namespace std::chrono;
+  return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+void parse_loadgen_options(int argc, const char **argv, LoadgenOptions &options)
+{
+  if (argc > 1)
+    options.bots = std::max(atoi(argv[1]), 1);
+  if (argc > 2)
+    options.seconds = atof(argv[2]);
+  if (argc > 3)
+    options.hostName = argv[3];
+  if (argc > 4)
+    options.port = uint16_t(atoi(argv[4]));
+}
+
+static void print_report(const char *label, const LoadStats &stats, double seconds, size_t playing, size_t bots)
+{
+  const double perSecond = seconds > 0.0 ? 1.0 / seconds : 0.0;
+  printf("%s %zu/%zu bots playing, %.0f snapshots/s (%.1f per bot), in %.1f KiB/s, out %.1f KiB/s, "
+         "latency p50 %.2f p90 %.2f p99 %.2f max %.2f ms, %llu disconnects\n",
+         label, playing, bots, stats.snapshots * perSecond,
+         playing ? stats.snapshots * perSecond / playing : 0.0,
+         stats.bytesIn * perSecond / 1024.0, stats.bytesOut * perSecond / 1024.0,
+         stats.latency.percentile(0.5), stats.latency.percentile(0.9), stats.latency.percentile(0.99),
+         stats.latency.max(), (unsigned long long)stats.disconnects);
+}
+
+static void collect_traffic(const std::vector<ENetHost*> &hosts, LoadStats &stats)
+{
+  for (ENetHost *host : hosts)
+  {
+    stats.bytesIn += host->totalReceivedData;
+    stats.bytesOut += host->totalSentData;
+    host->totalReceivedData = 0;
+    host->totalSentData = 0;
+  }
+}
+
+static void service_host(ENetHost *host, LoadStats &stats)
+{
+  ENetEvent event;
+  while (enet_host_service(host, &event, 0) > 0)
+  {
+    LoadBot &bot = *(LoadBot*)event.peer->data;
+    switch (event.type)
+    {
+    case ENET_EVENT_TYPE_CONNECT:
+      bot.connected = true;
+      bot.on_connect();
+      break;
+    case ENET_EVENT_TYPE_DISCONNECT:
+      bot.connected = false;
+      bot.on_disconnect();
+      stats.disconnects++;
+      break;
+    case ENET_EVENT_TYPE_RECEIVE:
+      bot.on_receive(event.packet, now_ms(), stats);
+      enet_packet_destroy(event.packet);
+      break;
+    default:
+      break;
+    };
+  }
+}
+
+int run_loadgen(const LoadgenOptions &options, const ENetAddress &address,
+                const std::function<std::unique_ptr<LoadBot>(size_t index)> &make_bot)
+{
+  std::vector<ENetHost*> hosts;
+  std::vector<std::unique_ptr<LoadBot>> bots;
+  int result = 0;
+  for (size_t i = 0; i < options.bots; ++i)
+  {
+    if (i % bots_per_host == 0)
+    {
+      ENetHost *host = enet_host_create(nullptr, bots_per_host, 2, 0, 0);
+      if (!host)
+      {
+        printf("Cannot create ENet client\n");
+        result = 1;
+        break;
+      }
+      hosts.push_back(host);
+    }
+    std::unique_ptr<LoadBot> bot = make_bot(i);
+    bot->peer = enet_host_connect(hosts.back(), &address, 2, 0);
+    if (!bot->peer)
+    {
+      printf("Cannot connect to server\n");
+      result = 1;
+      break;
+    }
+    bot->peer->data = bot.get();
+    bots.push_back(std::move(bot));
+  }
+  if (result == 0)
+    printf("%zu bots on %zu hosts against %s:%u for %.0f s\n", bots.size(), hosts.size(), options.hostName,
+           options.port, options.seconds);
+
+  LoadStats interval;
+  LoadStats total;
+  const double start = now_ms();
+  double lastReport = start;
+  while (result == 0)
+  {
+    // wake up for any host's packets, or in time for the bots' next sends
+    ENetSocketSet readable;
+    ENET_SOCKETSET_EMPTY(readable);
+    ENetSocket maxSocket = 0;
+    for (ENetHost *host : hosts)
+    {
+      ENET_SOCKETSET_ADD(readable, host->socket);
+      maxSocket = std::max(maxSocket, host->socket);
+    }
+    enet_socketset_select(maxSocket, &readable, nullptr, 1);
+
+    for (ENetHost *host : hosts)
+      service_host(host, interval);
+
+    const double now = now_ms();
+    for (const std::unique_ptr<LoadBot> &bot : bots)
+      if (bot->connected)
+        bot->drive(now);
+    for (ENetHost *host : hosts)
+      enet_host_flush(host);
+
+    if (now - lastReport < report_interval_ms && now - start < options.seconds * 1000.0)
+      continue;
+    collect_traffic(hosts, interval);
+    size_t playing = 0;
+    for (const std::unique_ptr<LoadBot> &bot : bots)
+      playing += bot->playing();
+    char label[32];
+    snprintf(label, sizeof(label), "%5.1fs", (now - start) * 0.001);
+    print_report(label, interval, (now - lastReport) * 0.001, playing, bots.size());
+    total.merge(interval);
+    interval = LoadStats();
+    lastReport = now;
+    if (now - start >= options.seconds * 1000.0)
+    {
+      print_report("total:", total, (now - start) * 0.001, playing, bots.size());
+      break;
+    }
+  }
+
+  for (const std::unique_ptr<LoadBot> &bot : bots)
+    enet_peer_disconnect_now(bot->peer, 0);
+  for (ENetHost *host : hosts)
+    enet_host_destroy(host);
+  return result;
+}
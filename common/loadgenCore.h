@@ -0,0 +1,82 @@
+#pragma once
+// What the load generators of every server directory have in common: latency
+// percentiles, the per second report and the loop that connects the bots,
+// pumps their hosts and drives them. The protocol is left to each directory's
+// loadgen.cpp, which implements LoadBot for it and hands run_loadgen a factory.
+#include <enet/enet.h>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+// Fixed 50 us buckets up to 500 ms: percentiles over a whole run take no more
+// memory than over one report, and adding a sample is an increment.
+class LatencyHistogram
+{
+public:
+  void add(double ms);
+  void merge(const LatencyHistogram &other);
+  // upper edge of the bucket holding the p-th fraction of samples
+  double percentile(double p) const;
+  double max() const { return maxMs; }
+
+private:
+  static constexpr double bucket_ms = 0.05;
+  static constexpr size_t num_buckets = 10000;
+  uint64_t buckets[num_buckets + 1] = {}; // the last one takes everything slower
+  uint64_t total = 0;
+  double maxMs = 0.0;
+};
+
+struct LoadStats
+{
+  uint64_t snapshots = 0;
+  uint64_t bytesIn = 0;
+  uint64_t bytesOut = 0;
+  uint64_t disconnects = 0;
+  LatencyHistogram latency;
+
+  void merge(const LoadStats &other);
+};
+
+// One scripted client on its own ENet peer. The loop keeps peer and connected
+// up to date and counts disconnects, everything the protocol says goes
+// through the virtual functions.
+class LoadBot
+{
+public:
+  virtual ~LoadBot() = default;
+
+  // the connection is up, typically time to send the join
+  virtual void on_connect() = 0;
+  // forget the entity and whatever else the server handed out
+  virtual void on_disconnect() = 0;
+  // the packet is destroyed by the caller; snapshots and their latency go to stats
+  virtual void on_receive(ENetPacket *packet, double arrival, LoadStats &stats) = 0;
+  // called for connected bots on every pass of the loop, about once a millisecond
+  virtual void drive(double now) = 0;
+  // whether the server gave the bot an entity to play
+  virtual bool playing() const = 0;
+
+  ENetPeer *peer = nullptr;
+  bool connected = false;
+};
+
+struct LoadgenOptions
+{
+  size_t bots = 100;
+  double seconds = 30.0;
+  const char *hostName = "localhost";
+  uint16_t port = 10131;
+};
+
+double now_ms();
+// [bots] [seconds] [host] [port] from argv[1..4], missing ones keep their defaults
+void parse_loadgen_options(int argc, const char **argv, LoadgenOptions &options);
+
+// Connects options.bots bots to address, bots_per_host of them sharing an ENet
+// host, and runs them for options.seconds, printing a report every second and
+// the totals at the end. ENet must be initialized. Returns 0, or 1 if the
+// hosts or peers couldn't be made.
+int run_loadgen(const LoadgenOptions &options, const ENetAddress &address,
+                const std::function<std::unique_ptr<LoadBot>(size_t index)> &make_bot);
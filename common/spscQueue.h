@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Slots are allocated once in the constructor and reused; a push or pop
+// is a copy plus one release store, nothing allocates or locks afterwards.
+template <typename T>
+class SpscQueue {
+public:
+    // capacity must be a power of two
+    explicit SpscQueue(size_t capacity) : m_items(capacity), m_mask(capacity - 1) {
+    }
+
+    // producer thread only; false if the queue is full
+    bool TryPush(const T& value) {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead == m_items.size()) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead == m_items.size()) {
+                return false;
+            }
+        }
+        m_items[tail & m_mask] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer thread only; false if the queue is empty
+    bool TryPop(T& value) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail) {
+                return false;
+            }
+        }
+        value = m_items[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> m_items;
+    const size_t m_mask;
+
+    // head and tail on their own cache lines, each next to the copy of the other
+    // index its owner works from, so the threads only share a line when the
+    // cached copy runs out
+    alignas(64) std::atomic<size_t> m_head{0};
+    size_t m_cachedTail = 0; // consumer's view of m_tail
+    alignas(64) std::atomic<size_t> m_tail{0};
+    size_t m_cachedHead = 0; // producer's view of m_head
+};
@@ -1,5 +1,7 @@
 #!/bin/bash
 # https://serverfault.com/questions/725030/traffic-shaping-on-osx-10-10-with-pfctl-and-dnctl
+# Needs root and macOS. Elsewhere the w5 client and loadgen take a link spec
+# instead, e.g. "delay=150,loss=0.1,rate=50000" for the pipe below, see w5/linkEmulator.h
 
 # Reset dummynet to default config
 dnctl -f flush
@@ -27,7 +27,26 @@ int main(int argc, const char **argv)
     std::getline(std::cin, input);
     ssize_t res = sendto(sfd, input.c_str(), input.size(), 0, resAddrInfo.ai_addr, resAddrInfo.ai_addrlen);
     if (res == -1)
+    {
       std::cout << strerror(errno) << std::endl;
+      continue;
+    }
+
+    // the server echoes every datagram, give it a moment to come back
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(sfd, &readSet);
+    timeval timeout = { 0, 100000 }; // 100 ms
+    if (select(sfd + 1, &readSet, NULL, NULL, &timeout) > 0)
+    {
+      char buffer[1500];
+      ssize_t size = recvfrom(sfd, buffer, sizeof(buffer) - 1, 0, nullptr, nullptr);
+      if (size > 0)
+      {
+        buffer[size] = '\0';
+        printf("echo: %s\n", buffer);
+      }
+    }
   }
   return 0;
 }
@@ -1,50 +1,122 @@
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <cstring>
 #include <cstdio>
 #include <iostream>
+#include <thread>
+#include <vector>
 #include "socket_tools.h"
+#include "udp_batch.h"
 
-int main(int argc, const char **argv)
-{
-  const char *port = "2025";
+static const char *port = "2025";
+static constexpr size_t batch_size = 64;
+static constexpr size_t max_datagram_size = 1500;
+
+static std::atomic<uint64_t> totalDatagrams{0};
+static std::atomic<uint64_t> totalBatches{0};
+static std::atomic<uint64_t> totalEchoed{0};
 
-  int sfd = create_dgram_socket(nullptr, port, nullptr);
+// number of replies the kernel took, the rest stay queued in sock
+static int flush_replies(BatchSocket &sock)
+{
+  const int sent = sock.flush();
+  if (sent > 0)
+    totalEchoed.fetch_add(sent, std::memory_order_relaxed);
+  return sent;
+}
 
+// One shard: its own SO_REUSEPORT socket, epoll instance and batch buffers, so
+// threads share nothing but the counters. Every datagram is echoed back to its
+// sender, the replies to one recvmmsg going out together in one sendmmsg.
+static void serve_shard(int shard, bool quiet)
+{
+  int sfd = create_sharded_dgram_socket(port);
   if (sfd == -1)
   {
-    printf("cannot create socket\n");
-    return 1;
+    printf("shard %d: cannot create socket\n", shard);
+    return;
+  }
+  int efd = epoll_create1(0);
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.fd = sfd;
+  if (efd == -1 || epoll_ctl(efd, EPOLL_CTL_ADD, sfd, &ev) != 0)
+  {
+    printf("shard %d: cannot set up epoll\n", shard);
+    close(sfd);
+    return;
   }
-  printf("listening!\n");
 
+  BatchSocket sock(sfd, batch_size, max_datagram_size);
   while (true)
   {
-    fd_set readSet;
-    FD_ZERO(&readSet);
-    FD_SET(sfd, &readSet);
-
-    timeval timeout = { 0, 100000 }; // 100 ms
-    select(sfd + 1, &readSet, NULL, NULL, &timeout);
-
+    epoll_event events[1];
+    if (epoll_wait(efd, events, 1, 100) <= 0)
+    {
+      // replies the kernel had no room for last time
+      flush_replies(sock);
+      continue;
+    }
 
-    if (FD_ISSET(sfd, &readSet))
+    // edge triggered: there is no new wake up until the socket has been drained
+    int received = 0;
+    while ((received = sock.receive()) > 0)
     {
-      constexpr size_t buf_size = 1000;
-      static char buffer[buf_size];
-      memset(buffer, 0, buf_size);
-
-      sockaddr_in sin;
-      socklen_t slen = sizeof(sockaddr_in);
-      ssize_t numBytes = recvfrom(sfd, buffer, buf_size - 1, 0, (sockaddr*)&sin, &slen);
-      if (numBytes > 0)
+      totalDatagrams.fetch_add(received, std::memory_order_relaxed);
+      totalBatches.fetch_add(1, std::memory_order_relaxed);
+      for (int i = 0; i < received; ++i)
       {
-        printf("(%s:%d) %s\n", inet_ntoa(sin.sin_addr), sin.sin_port, buffer); // assume that buffer is a string
+        Datagram dgram = sock.datagram(i);
+        if (!quiet)
+          printf("[%d] (%s:%d) %s\n", shard, inet_ntoa(dgram.from->sin_addr), dgram.from->sin_port, dgram.data); // assume that buffer is a string
+        // still full after a flush means the kernel is backed up, drop the reply like UDP would
+        if (!sock.send(*dgram.from, dgram.data, dgram.size) && flush_replies(sock) > 0)
+          sock.send(*dgram.from, dgram.data, dgram.size);
       }
+      flush_replies(sock);
     }
   }
+}
+
+int main(int argc, const char **argv)
+{
+  // usage: server [threads] [quiet]
+  int numShards = argc > 1 ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+  if (numShards < 1)
+    numShards = 1;
+  const bool quiet = argc > 2;
+
+  std::vector<std::thread> shards;
+  for (int i = 0; i < numShards; ++i)
+    shards.emplace_back(serve_shard, i, quiet);
+  printf("listening on %d shards!\n", numShards);
+
+  uint64_t lastDatagrams = 0;
+  uint64_t lastBatches = 0;
+  uint64_t lastEchoed = 0;
+  while (true)
+  {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    if (!quiet)
+      continue;
+    const uint64_t datagrams = totalDatagrams.load(std::memory_order_relaxed);
+    const uint64_t batches = totalBatches.load(std::memory_order_relaxed);
+    const uint64_t echoed = totalEchoed.load(std::memory_order_relaxed);
+    if (datagrams != lastDatagrams)
+      printf("%llu datagrams/s, %.1f per recvmmsg, %llu echoed/s\n", (unsigned long long)(datagrams - lastDatagrams),
+             batches != lastBatches ? double(datagrams - lastDatagrams) / (batches - lastBatches) : 0.0,
+             (unsigned long long)(echoed - lastEchoed));
+    lastDatagrams = datagrams;
+    lastBatches = batches;
+    lastEchoed = echoed;
+  }
   return 0;
 }
@@ -10,7 +10,7 @@
 #include "socket_tools.h"
 
 // Adaptation of linux man page: https://linux.die.net/man/3/getaddrinfo
-static int get_dgram_socket(addrinfo *addr, bool should_bind, addrinfo *res_addr)
+static int get_dgram_socket(addrinfo *addr, bool should_bind, bool reuse_port, addrinfo *res_addr)
 {
   for (addrinfo *ptr = addr; ptr != nullptr; ptr = ptr->ai_next)
   {
@@ -24,6 +24,11 @@ static int get_dgram_socket(addrinfo *addr, bool should_bind, addrinfo *res_addr
 
     int trueVal = 1;
     setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &trueVal, sizeof(int));
+    if (reuse_port && setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, &trueVal, sizeof(int)) != 0)
+    {
+      close(sfd);
+      continue;
+    }
 
     if (res_addr)
       *res_addr = *ptr;
@@ -38,7 +43,7 @@ static int get_dgram_socket(addrinfo *addr, bool should_bind, addrinfo *res_addr
   return -1;
 }
 
-int create_dgram_socket(const char *address, const char *port, addrinfo *res_addr)
+static int create_socket(const char *address, const char *port, bool reuse_port, addrinfo *res_addr)
 {
   addrinfo hints;
   memset(&hints, 0, sizeof(addrinfo));
@@ -54,9 +59,18 @@ int create_dgram_socket(const char *address, const char *port, addrinfo *res_add
   if (getaddrinfo(address, port, &hints, &result) != 0)
     return -1;
 
-  int sfd = get_dgram_socket(result, isListener, res_addr);
+  int sfd = get_dgram_socket(result, isListener, reuse_port, res_addr);
 
   //freeaddrinfo(result);
   return sfd;
 }
 
+int create_dgram_socket(const char *address, const char *port, addrinfo *res_addr)
+{
+  return create_socket(address, port, false, res_addr);
+}
+
+int create_sharded_dgram_socket(const char *port)
+{
+  return create_socket(nullptr, port, true, nullptr);
+}
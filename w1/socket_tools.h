@@ -3,3 +3,6 @@
 struct addrinfo;
 
 int create_dgram_socket(const char *address, const char *port, addrinfo *res_addr);
+// listener bound with SO_REUSEPORT: every thread can bind its own socket to the
+// same port and the kernel spreads incoming flows between them
+int create_sharded_dgram_socket(const char *port);
@@ -0,0 +1,84 @@
+#include <errno.h>
+#include <cstring>
+
+#include "udp_batch.h"
+
+BatchSocket::BatchSocket(int sfd, size_t batch_size, size_t max_datagram_size)
+  : sfd(sfd), batchSize(batch_size), maxDatagramSize(max_datagram_size)
+{
+  // one extra byte per slot for the terminating zero
+  init_batch(in, maxDatagramSize + 1);
+  init_batch(out, maxDatagramSize);
+}
+
+void BatchSocket::init_batch(Batch &batch, size_t stride)
+{
+  batch.buffers.assign(batchSize * stride, 0);
+  batch.iov.resize(batchSize);
+  batch.headers.resize(batchSize);
+  batch.addresses.resize(batchSize);
+  for (size_t i = 0; i < batchSize; ++i)
+  {
+    batch.iov[i].iov_base = &batch.buffers[i * stride];
+    batch.iov[i].iov_len = maxDatagramSize;
+    memset(&batch.headers[i], 0, sizeof(mmsghdr));
+    batch.headers[i].msg_hdr.msg_iov = &batch.iov[i];
+    batch.headers[i].msg_hdr.msg_iovlen = 1;
+    batch.headers[i].msg_hdr.msg_name = &batch.addresses[i];
+    batch.headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+  }
+}
+
+int BatchSocket::receive()
+{
+  // the kernel shrinks msg_namelen to what it wrote, give every slot the full size back
+  for (size_t i = 0; i < received; ++i)
+    in.headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+
+  int res = recvmmsg(sfd, in.headers.data(), batchSize, MSG_DONTWAIT, nullptr);
+  if (res < 0)
+  {
+    received = 0;
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+  }
+  received = res;
+  for (size_t i = 0; i < received; ++i)
+    ((char *)in.iov[i].iov_base)[in.headers[i].msg_len] = '\0';
+  return res;
+}
+
+Datagram BatchSocket::datagram(size_t i) const
+{
+  return { (const char *)in.iov[i].iov_base, in.headers[i].msg_len, &in.addresses[i] };
+}
+
+bool BatchSocket::send(const sockaddr_in &to, const void *data, size_t size)
+{
+  if (queued == batchSize || size > maxDatagramSize)
+    return false;
+  memcpy(out.iov[queued].iov_base, data, size);
+  out.iov[queued].iov_len = size;
+  out.addresses[queued] = to;
+  queued++;
+  return true;
+}
+
+int BatchSocket::flush()
+{
+  if (queued == 0)
+    return 0;
+  int res = sendmmsg(sfd, out.headers.data(), queued, MSG_DONTWAIT);
+  if (res < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+  // keep whatever the kernel didn't take at the front of the batch
+  const size_t left = queued - res;
+  for (size_t i = 0; i < left; ++i)
+  {
+    memcpy(out.iov[i].iov_base, out.iov[res + i].iov_base, out.iov[res + i].iov_len);
+    out.iov[i].iov_len = out.iov[res + i].iov_len;
+    out.addresses[i] = out.addresses[res + i];
+  }
+  queued = left;
+  return res;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <cstddef>
+#include <vector>
+
+struct Datagram
+{
+  const char *data; // zero terminated, valid until the next receive()
+  size_t size;
+  const sockaddr_in *from;
+};
+
+// Batched I/O on one non-blocking UDP socket. The buffers, iovecs and headers
+// for a whole batch are allocated once up front: receive() fills them with a
+// single recvmmsg, send() copies a datagram into the outgoing batch and
+// flush() hands the whole batch to the kernel with a single sendmmsg.
+class BatchSocket
+{
+public:
+  BatchSocket(int sfd, size_t batch_size, size_t max_datagram_size);
+
+  // number of datagrams read, 0 once the socket has nothing more, -1 on error
+  int receive();
+  Datagram datagram(size_t i) const;
+
+  // false if the outgoing batch is full, flush() and retry
+  bool send(const sockaddr_in &to, const void *data, size_t size);
+  // number of datagrams the kernel took, the rest stay queued; -1 on error
+  int flush();
+
+  int fd() const { return sfd; }
+
+private:
+  struct Batch
+  {
+    std::vector<char> buffers;
+    std::vector<iovec> iov;
+    std::vector<mmsghdr> headers;
+    std::vector<sockaddr_in> addresses;
+  };
+
+  void init_batch(Batch &batch, size_t stride);
+
+  int sfd;
+  size_t batchSize;
+  size_t maxDatagramSize;
+  Batch in;
+  Batch out;
+  size_t received = 0;
+  size_t queued = 0;
+};
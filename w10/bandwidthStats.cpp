@@ -0,0 +1,194 @@
+#include "bandwidthStats.h"
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+
+static const char *message_type_names[num_message_types] = {
+  "join", "new_entity", "set_controlled_entity", "input", "snapshot",
+  "snapshot_batch", "snapshot_delta", "snapshot_ack", "key"
+};
+
+struct MessageCounters
+{
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+};
+
+struct Traffic
+{
+  MessageCounters sent[num_message_types];
+  MessageCounters received[num_message_types];
+  uint64_t wireSent = 0;
+  uint64_t wireReceived = 0;
+};
+
+struct PeerTraffic
+{
+  ENetAddress address = {};
+  Traffic traffic;
+  // ENet's counters as of the last sample_wire_traffic()
+  uint32_t lastOutgoingTotal = 0;
+  uint32_t lastIncomingTotal = 0;
+};
+
+static std::mutex statsMutex;
+static std::unordered_map<ENetPeer*, PeerTraffic> peers;
+// everything, including peers that are gone
+static Traffic total;
+static Traffic lastReported;
+// the whole host on the wire, ENet headers, acks and pings included
+static uint64_t hostWireSent = 0;
+static uint64_t hostWireReceived = 0;
+static uint64_t lastReportedHostWireSent = 0;
+static uint64_t lastReportedHostWireReceived = 0;
+
+static PeerTraffic &peer_traffic(ENetPeer *peer)
+{
+  auto [it, inserted] = peers.try_emplace(peer);
+  if (inserted)
+  {
+    it->second.address = peer->address;
+    it->second.lastOutgoingTotal = peer->outgoingDataTotal;
+    it->second.lastIncomingTotal = peer->incomingDataTotal;
+  }
+  return it->second;
+}
+
+static void count(MessageCounters *counters, MessageCounters *totals, const ENetPacket *packet)
+{
+  const uint8_t type = packet->dataLength ? packet->data[0] : num_message_types;
+  if (type >= num_message_types)
+    return;
+  counters[type].packets++;
+  counters[type].bytes += packet->dataLength;
+  totals[type].packets++;
+  totals[type].bytes += packet->dataLength;
+}
+
+void count_sent(ENetPeer *peer, const ENetPacket *packet)
+{
+  std::lock_guard<std::mutex> lock(statsMutex);
+  count(peer_traffic(peer).traffic.sent, total.sent, packet);
+}
+
+void count_received(ENetPeer *peer, const ENetPacket *packet)
+{
+  std::lock_guard<std::mutex> lock(statsMutex);
+  count(peer_traffic(peer).traffic.received, total.received, packet);
+}
+
+void forget_peer(ENetPeer *peer)
+{
+  std::lock_guard<std::mutex> lock(statsMutex);
+  peers.erase(peer);
+}
+
+// bytes since the last sample, or since ENet last zeroed the counter
+static uint64_t counter_delta(uint32_t current, uint32_t &last)
+{
+  const uint64_t delta = current >= last ? current - last : current;
+  last = current;
+  return delta;
+}
+
+void sample_wire_traffic(ENetHost *host)
+{
+  std::lock_guard<std::mutex> lock(statsMutex);
+  hostWireSent += host->totalSentData;
+  hostWireReceived += host->totalReceivedData;
+  host->totalSentData = 0;
+  host->totalReceivedData = 0;
+
+  for (size_t i = 0; i < host->peerCount; ++i)
+  {
+    ENetPeer *peer = &host->peers[i];
+    if (peer->state != ENET_PEER_STATE_CONNECTED)
+      continue;
+    PeerTraffic &t = peer_traffic(peer);
+    const uint64_t sent = counter_delta(peer->outgoingDataTotal, t.lastOutgoingTotal);
+    const uint64_t received = counter_delta(peer->incomingDataTotal, t.lastIncomingTotal);
+    t.traffic.wireSent += sent;
+    t.traffic.wireReceived += received;
+    total.wireSent += sent;
+    total.wireReceived += received;
+  }
+}
+
+static void print_direction(const char *direction, const MessageCounters *now, const MessageCounters *last,
+                            double perSecond)
+{
+  for (size_t i = 0; i < num_message_types; ++i)
+  {
+    const uint64_t packets = now[i].packets - last[i].packets;
+    const uint64_t bytes = now[i].bytes - last[i].bytes;
+    if (packets == 0)
+      continue;
+    printf("  %s %-22s %9.1f pkt/s %9.2f KiB/s, %6.1f B avg\n", direction, message_type_names[i],
+           packets * perSecond, bytes * perSecond / 1024.0, double(bytes) / packets);
+  }
+}
+
+static uint64_t sum_bytes(const MessageCounters *counters)
+{
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < num_message_types; ++i)
+    bytes += counters[i].bytes;
+  return bytes;
+}
+
+void print_bandwidth_report(double seconds)
+{
+  std::lock_guard<std::mutex> lock(statsMutex);
+  const double perSecond = seconds > 0.0 ? 1.0 / seconds : 0.0;
+  const double kib = perSecond / 1024.0;
+  printf("Bandwidth over %.1f s, %zu peers: out %.2f KiB/s (peers %.2f, host %.2f on the wire), "
+         "in %.2f KiB/s (peers %.2f, host %.2f on the wire)\n",
+         seconds, peers.size(),
+         (sum_bytes(total.sent) - sum_bytes(lastReported.sent)) * kib,
+         (total.wireSent - lastReported.wireSent) * kib, (hostWireSent - lastReportedHostWireSent) * kib,
+         (sum_bytes(total.received) - sum_bytes(lastReported.received)) * kib,
+         (total.wireReceived - lastReported.wireReceived) * kib,
+         (hostWireReceived - lastReportedHostWireReceived) * kib);
+  print_direction("out", total.sent, lastReported.sent, perSecond);
+  print_direction("in ", total.received, lastReported.received, perSecond);
+  lastReported = total;
+  lastReportedHostWireSent = hostWireSent;
+  lastReportedHostWireReceived = hostWireReceived;
+}
+
+static void dump_traffic(FILE *file, const char *peer, const Traffic &traffic)
+{
+  for (size_t i = 0; i < num_message_types; ++i)
+  {
+    if (traffic.sent[i].packets)
+      fprintf(file, "%s,out,%s,%llu,%llu\n", peer, message_type_names[i],
+              (unsigned long long)traffic.sent[i].packets, (unsigned long long)traffic.sent[i].bytes);
+    if (traffic.received[i].packets)
+      fprintf(file, "%s,in,%s,%llu,%llu\n", peer, message_type_names[i],
+              (unsigned long long)traffic.received[i].packets, (unsigned long long)traffic.received[i].bytes);
+  }
+  fprintf(file, "%s,out,wire,,%llu\n", peer, (unsigned long long)traffic.wireSent);
+  fprintf(file, "%s,in,wire,,%llu\n", peer, (unsigned long long)traffic.wireReceived);
+}
+
+void dump_bandwidth(const char *path)
+{
+  FILE *file = fopen(path, "w");
+  if (!file)
+  {
+    printf("Cannot write bandwidth stats to %s\n", path);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(statsMutex);
+  fprintf(file, "peer,direction,type,packets,bytes\n");
+  dump_traffic(file, "total", total);
+  fprintf(file, "host,out,wire,,%llu\n", (unsigned long long)hostWireSent);
+  fprintf(file, "host,in,wire,,%llu\n", (unsigned long long)hostWireReceived);
+  for (const auto &[peer, t] : peers)
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "%x:%u", t.address.host, t.address.port);
+    dump_traffic(file, name, t.traffic);
+  }
+  fclose(file);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <enet/enet.h>
+#include <cstdint>
+#include "protocol.h"
+
+// Packets and bytes per MessageType and per peer, counted as the protocol hands
+// packets to ENet and as they come out of it, next to what ENet itself puts on
+// the wire. Counted on the thread that owns the host, which for the server is
+// its HostThread, while the reports come from the game thread: one mutex keeps
+// them apart and is only ever contended when a report is due.
+
+// every send in protocol.cpp goes through here, before ENet adds its headers
+void count_sent(ENetPeer *peer, const ENetPacket *packet);
+void count_received(ENetPeer *peer, const ENetPacket *packet);
+// its counts stay in the totals, the slot may come back as a different peer
+void forget_peer(ENetPeer *peer);
+
+// Once per tick, on the thread that owns the host: ENet zeroes its per peer totals every second to throttle, so
+// they are folded into ours often enough to lose at most a tick's worth.
+void sample_wire_traffic(ENetHost *host);
+
+// rates per type since the last report, pre-ENet against on the wire
+void print_bandwidth_report(double seconds);
+// cumulative counts per peer and type as CSV, rewritten on every call
+void dump_bandwidth(const char *path);
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "quantisation.h"
+
+// Bit-granular streams over a caller-owned buffer (usually ENetPacket::data).
+// Values are stored LSB first. Going past the end never touches memory
+// outside the buffer: the stream just raises its overflow flag, reads return
+// zero and callers check overflowed() once at the end.
+class BitWriter
+{
+  uint8_t *data;
+  size_t capacityBits;
+  size_t bitPos = 0;
+  bool overflow = false;
+
+public:
+  BitWriter(uint8_t *data, size_t size) : data(data), capacityBits(size * 8) {}
+
+  void write(uint32_t value, int num_bits)
+  {
+    if (num_bits > 32 || bitPos + num_bits > capacityBits)
+    {
+      overflow = true;
+      return;
+    }
+    for (int written = 0; written < num_bits;)
+    {
+      uint8_t &byte = data[bitPos >> 3];
+      int offset = bitPos & 7;
+      int chunk = std::min(8 - offset, num_bits - written);
+      uint8_t bits = (value >> written) & ((1u << chunk) - 1);
+      byte = (byte & ((1u << offset) - 1)) | (bits << offset);
+      written += chunk;
+      bitPos += chunk;
+    }
+  }
+
+  template<typename T, int num_bits>
+  void write(const PackedFloat<T, num_bits> &v) { write(v.packedVal, num_bits); }
+
+  size_t bits_written() const { return bitPos; }
+  size_t bytes_written() const { return (bitPos + 7) / 8; }
+  bool overflowed() const { return overflow; }
+};
+
+class BitReader
+{
+  const uint8_t *data;
+  size_t capacityBits;
+  size_t bitPos = 0;
+  bool overflow = false;
+
+public:
+  BitReader(const uint8_t *data, size_t size) : data(data), capacityBits(size * 8) {}
+
+  uint32_t read(int num_bits)
+  {
+    if (num_bits > 32 || bitPos + num_bits > capacityBits)
+    {
+      overflow = true;
+      return 0;
+    }
+    uint32_t value = 0;
+    for (int readBits = 0; readBits < num_bits;)
+    {
+      int offset = bitPos & 7;
+      int chunk = std::min(8 - offset, num_bits - readBits);
+      uint32_t bits = (data[bitPos >> 3] >> offset) & ((1u << chunk) - 1);
+      value |= bits << readBits;
+      readBits += chunk;
+      bitPos += chunk;
+    }
+    return value;
+  }
+
+  template<typename T, int num_bits>
+  void read(PackedFloat<T, num_bits> &v) { v.packedVal = read(num_bits); }
+
+  size_t bits_left() const { return capacityBits - bitPos; }
+  bool overflowed() const { return overflow; }
+};
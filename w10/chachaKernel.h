@@ -0,0 +1,162 @@
+#pragma once
+// The vectorized ChaCha20 block kernel, shared by chachaPoly.cpp (SSE2) and
+// chachaPoly_avx2.cpp, which is the only file built with AVX2 enabled. As in
+// simulateKernel.h, everything but the types has internal linkage, so the AVX2
+// file's copies never get called in place of the SSE2 ones.
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // memcpy
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+constexpr size_t chacha_block_size = 64;
+
+// One ChaCha20 block to generate: message keystream starts at counter 1, the
+// Poly1305 key is the first half of block 0.
+struct BlockJob
+{
+  const uint8_t *key;
+  const uint8_t *nonce;
+  uint32_t counter;
+};
+
+namespace
+{
+
+uint32_t load_le32(const uint8_t *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(uint32_t));
+  return v;
+}
+
+void store_le32(uint8_t *p, uint32_t v)
+{
+  memcpy(p, &v, sizeof(uint32_t));
+}
+
+void init_state(uint32_t *s, const BlockJob &job)
+{
+  s[0] = 0x61707865;
+  s[1] = 0x3320646e;
+  s[2] = 0x79622d32;
+  s[3] = 0x6b206574;
+  for (int i = 0; i < 8; ++i)
+    s[4 + i] = load_le32(job.key + 4 * i);
+  s[12] = job.counter;
+  for (int i = 0; i < 3; ++i)
+    s[13 + i] = load_le32(job.nonce + 4 * i);
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+// Thin wrappers so one kernel template serves both vector widths.
+struct SseOps
+{
+  static constexpr size_t width = 4;
+  typedef __m128i V;
+  static V load(const uint32_t *p) { return _mm_loadu_si128((const __m128i*)p); }
+  static void store(uint32_t *p, V v) { _mm_storeu_si128((__m128i*)p, v); }
+  static V add(V a, V b) { return _mm_add_epi32(a, b); }
+  static V xor_(V a, V b) { return _mm_xor_si128(a, b); }
+  template<int n>
+  static V rotl(V v)
+  {
+    if constexpr (n == 16)
+      return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xb1), 0xb1);
+    else
+      return _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - n));
+  }
+};
+
+#if defined(__AVX2__)
+struct AvxOps
+{
+  static constexpr size_t width = 8;
+  typedef __m256i V;
+  static V load(const uint32_t *p) { return _mm256_loadu_si256((const __m256i*)p); }
+  static void store(uint32_t *p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+  static V add(V a, V b) { return _mm256_add_epi32(a, b); }
+  static V xor_(V a, V b) { return _mm256_xor_si256(a, b); }
+  template<int n>
+  static V rotl(V v)
+  {
+    // whole byte rotations are a byte shuffle within each lane
+    if constexpr (n == 16)
+      return _mm256_shuffle_epi8(v, _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                                     13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2));
+    else if constexpr (n == 8)
+      return _mm256_shuffle_epi8(v, _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                                    14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3));
+    else
+      return _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - n));
+  }
+};
+#endif
+
+template<typename Ops>
+void quarter_round(typename Ops::V &a, typename Ops::V &b, typename Ops::V &c, typename Ops::V &d)
+{
+  a = Ops::add(a, b); d = Ops::template rotl<16>(Ops::xor_(d, a));
+  c = Ops::add(c, d); b = Ops::template rotl<12>(Ops::xor_(b, c));
+  a = Ops::add(a, b); d = Ops::template rotl<8>(Ops::xor_(d, a));
+  c = Ops::add(c, d); b = Ops::template rotl<7>(Ops::xor_(b, c));
+}
+
+// Ops::width blocks at once, lane i holding word w of block i in vector w, so
+// the rounds are chacha_block_scalar's with every operation done on all lanes.
+template<typename Ops>
+void chacha_lanes(const BlockJob *jobs, uint8_t *out)
+{
+  typedef typename Ops::V V;
+  constexpr size_t width = Ops::width;
+  alignas(32) uint32_t words[16][width];
+  for (size_t lane = 0; lane < width; ++lane)
+  {
+    uint32_t s[16];
+    init_state(s, jobs[lane]);
+    for (int w = 0; w < 16; ++w)
+      words[w][lane] = s[w];
+  }
+
+  V s[16];
+  V x[16];
+  for (int w = 0; w < 16; ++w)
+    x[w] = s[w] = Ops::load(words[w]);
+  for (int i = 0; i < 10; ++i)
+  {
+    quarter_round<Ops>(x[0], x[4], x[8], x[12]);
+    quarter_round<Ops>(x[1], x[5], x[9], x[13]);
+    quarter_round<Ops>(x[2], x[6], x[10], x[14]);
+    quarter_round<Ops>(x[3], x[7], x[11], x[15]);
+    quarter_round<Ops>(x[0], x[5], x[10], x[15]);
+    quarter_round<Ops>(x[1], x[6], x[11], x[12]);
+    quarter_round<Ops>(x[2], x[7], x[8], x[13]);
+    quarter_round<Ops>(x[3], x[4], x[9], x[14]);
+  }
+  for (int w = 0; w < 16; ++w)
+    Ops::store(words[w], Ops::add(x[w], s[w]));
+
+  for (size_t lane = 0; lane < width; ++lane)
+    for (int w = 0; w < 16; ++w)
+      store_le32(out + lane * chacha_block_size + 4 * w, words[w][lane]);
+}
+
+// whole groups of Ops::width blocks only, returns how many blocks were done
+template<typename Ops>
+size_t chacha_blocks_vector(const BlockJob *jobs, size_t count, uint8_t *out)
+{
+  size_t i = 0;
+  for (; i + Ops::width <= count; i += Ops::width)
+    chacha_lanes<Ops>(jobs + i, out + i * chacha_block_size);
+  return i;
+}
+
+#endif
+
+}
+
+// In chachaPoly_avx2.cpp, only to be called once cpu_has_avx2() said so.
+size_t chacha_blocks_avx2(const BlockJob *jobs, size_t count, uint8_t *out);
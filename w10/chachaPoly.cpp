@@ -0,0 +1,291 @@
+#include "chachaPoly.h"
+#include "chachaKernel.h"
+#include "cpuFeatures.h"
+#include <cstring> // memcpy
+#include <vector>
+
+static void store_le64(uint8_t *p, uint64_t v)
+{
+  memcpy(p, &v, sizeof(uint64_t));
+}
+
+static uint32_t rotl(uint32_t v, int n)
+{
+  return (v << n) | (v >> (32 - n));
+}
+
+static void quarter_round(uint32_t &a, uint32_t &b, uint32_t &c, uint32_t &d)
+{
+  a += b; d ^= a; d = rotl(d, 16);
+  c += d; b ^= c; b = rotl(b, 12);
+  a += b; d ^= a; d = rotl(d, 8);
+  c += d; b ^= c; b = rotl(b, 7);
+}
+
+static void chacha_block_scalar(const BlockJob &job, uint8_t *out)
+{
+  uint32_t s[16];
+  uint32_t x[16];
+  init_state(s, job);
+  memcpy(x, s, sizeof(x));
+  for (int i = 0; i < 10; ++i)
+  {
+    quarter_round(x[0], x[4], x[8], x[12]);
+    quarter_round(x[1], x[5], x[9], x[13]);
+    quarter_round(x[2], x[6], x[10], x[14]);
+    quarter_round(x[3], x[7], x[11], x[15]);
+    quarter_round(x[0], x[5], x[10], x[15]);
+    quarter_round(x[1], x[6], x[11], x[12]);
+    quarter_round(x[2], x[7], x[8], x[13]);
+    quarter_round(x[3], x[4], x[9], x[14]);
+  }
+  for (int i = 0; i < 16; ++i)
+    store_le32(out + 4 * i, x[i] + s[i]);
+}
+
+static void chacha_blocks_scalar(const BlockJob *jobs, size_t count, uint8_t *out)
+{
+  for (size_t i = 0; i < count; ++i)
+    chacha_block_scalar(jobs[i], out + i * chacha_block_size);
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+// AVX2 when this CPU has it and the AVX2 file was built (x86 only), SSE2
+// otherwise, with whatever is left over done one block at a time.
+static void chacha_blocks(const BlockJob *jobs, size_t count, uint8_t *out)
+{
+  size_t i = 0;
+#if defined(W10_AVX2_KERNELS)
+  if (cpu_has_avx2())
+    i = chacha_blocks_avx2(jobs, count, out);
+  else
+#endif
+    i = chacha_blocks_vector<SseOps>(jobs, count, out);
+  chacha_blocks_scalar(jobs + i, count - i, out + i * chacha_block_size);
+}
+
+const char *aead_path()
+{
+#if defined(W10_AVX2_KERNELS)
+  if (cpu_has_avx2())
+    return "avx2";
+#endif
+  return "sse2";
+}
+
+#else
+
+static void chacha_blocks(const BlockJob *jobs, size_t count, uint8_t *out)
+{
+  chacha_blocks_scalar(jobs, count, out);
+}
+
+const char *aead_path()
+{
+  return "scalar";
+}
+
+#endif
+
+// Poly1305 in 26 bit limbs, as in poly1305-donna: every product fits in 64
+// bits, so it needs neither 128 bit integers nor anything platform specific.
+class Poly1305
+{
+public:
+  explicit Poly1305(const uint8_t *key)
+  {
+    r[0] = load_le32(key + 0) & 0x3ffffff;
+    r[1] = (load_le32(key + 3) >> 2) & 0x3ffff03;
+    r[2] = (load_le32(key + 6) >> 4) & 0x3ffc0ff;
+    r[3] = (load_le32(key + 9) >> 6) & 0x3f03fff;
+    r[4] = (load_le32(key + 12) >> 8) & 0x00fffff;
+    for (int i = 0; i < 4; ++i)
+      pad[i] = load_le32(key + 16 + 4 * i);
+  }
+
+  // the AEAD pads everything it MACs to 16 bytes, so the tail is zero filled here
+  void update_padded(const uint8_t *m, size_t length)
+  {
+    const size_t whole = length & ~size_t(15);
+    blocks(m, whole);
+    if (whole < length)
+    {
+      uint8_t last[16] = {};
+      memcpy(last, m + whole, length - whole);
+      blocks(last, sizeof(last));
+    }
+  }
+
+  void finish(uint8_t *tag)
+  {
+    uint32_t h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+    uint32_t c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    // h - p, taken instead of h when it doesn't go negative
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - (1u << 26);
+    uint32_t mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    h0 = h0 | (h1 << 26);
+    h1 = (h1 >> 6) | (h2 << 20);
+    h2 = (h2 >> 12) | (h3 << 14);
+    h3 = (h3 >> 18) | (h4 << 8);
+
+    uint64_t f = uint64_t(h0) + pad[0]; store_le32(tag + 0, uint32_t(f));
+    f = uint64_t(h1) + pad[1] + (f >> 32); store_le32(tag + 4, uint32_t(f));
+    f = uint64_t(h2) + pad[2] + (f >> 32); store_le32(tag + 8, uint32_t(f));
+    f = uint64_t(h3) + pad[3] + (f >> 32); store_le32(tag + 12, uint32_t(f));
+  }
+
+private:
+  void blocks(const uint8_t *m, size_t length)
+  {
+    const uint64_t r0 = r[0], r1 = r[1], r2 = r[2], r3 = r[3], r4 = r[4];
+    const uint64_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+    for (; length >= 16; m += 16, length -= 16)
+    {
+      h0 += load_le32(m + 0) & 0x3ffffff;
+      h1 += (load_le32(m + 3) >> 2) & 0x3ffffff;
+      h2 += (load_le32(m + 6) >> 4) & 0x3ffffff;
+      h3 += (load_le32(m + 9) >> 6) & 0x3ffffff;
+      h4 += (load_le32(m + 12) >> 8) | (1u << 24);
+
+      const uint64_t d0 = h0 * r0 + h1 * s4 + h2 * s3 + h3 * s2 + h4 * s1;
+      uint64_t d1 = h0 * r1 + h1 * r0 + h2 * s4 + h3 * s3 + h4 * s2;
+      uint64_t d2 = h0 * r2 + h1 * r1 + h2 * r0 + h3 * s4 + h4 * s3;
+      uint64_t d3 = h0 * r3 + h1 * r2 + h2 * r1 + h3 * r0 + h4 * s4;
+      uint64_t d4 = h0 * r4 + h1 * r3 + h2 * r2 + h3 * r1 + h4 * r0;
+
+      uint32_t c = uint32_t(d0 >> 26); h0 = uint32_t(d0) & 0x3ffffff;
+      d1 += c; c = uint32_t(d1 >> 26); h1 = uint32_t(d1) & 0x3ffffff;
+      d2 += c; c = uint32_t(d2 >> 26); h2 = uint32_t(d2) & 0x3ffffff;
+      d3 += c; c = uint32_t(d3 >> 26); h3 = uint32_t(d3) & 0x3ffffff;
+      d4 += c; c = uint32_t(d4 >> 26); h4 = uint32_t(d4) & 0x3ffffff;
+      h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+      h1 += c;
+    }
+    h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3; h[4] = h4;
+  }
+
+  uint32_t r[5];
+  uint32_t h[5] = {};
+  uint32_t pad[4];
+};
+
+static void compute_tag(const AeadMessage &m, const uint8_t *polyKey, uint8_t *tag)
+{
+  Poly1305 poly(polyKey);
+  poly.update_padded(m.aad, m.aadLength);
+  poly.update_padded(m.data, m.length);
+  uint8_t lengths[16];
+  store_le64(lengths, m.aadLength);
+  store_le64(lengths + 8, m.length);
+  poly.update_padded(lengths, sizeof(lengths));
+  poly.finish(tag);
+}
+
+static bool same_tag(const uint8_t *a, const uint8_t *b)
+{
+  // no early out, how much of a forged tag was right mustn't show in the timing
+  uint8_t diff = 0;
+  for (size_t i = 0; i < poly1305_tag_size; ++i)
+    diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+static void xor_keystream(uint8_t *data, const uint8_t *keystream, size_t length)
+{
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+  {
+    uint64_t d, k;
+    memcpy(&d, data + i, sizeof(uint64_t));
+    memcpy(&k, keystream + i, sizeof(uint64_t));
+    d ^= k;
+    memcpy(data + i, &d, sizeof(uint64_t));
+  }
+  for (; i < length; ++i)
+    data[i] ^= keystream[i];
+}
+
+static size_t message_blocks(const AeadMessage &m)
+{
+  return 1 + (m.length + chacha_block_size - 1) / chacha_block_size;
+}
+
+typedef void (*BlocksFunction)(const BlockJob *jobs, size_t count, uint8_t *out);
+
+static void aead_batch(AeadMessage *messages, size_t count, bool seal, BlocksFunction generate)
+{
+  // packets are encrypted on the thread pool, every thread keeps its own scratch
+  thread_local std::vector<BlockJob> jobs;
+  thread_local std::vector<uint8_t> keystream;
+  jobs.clear();
+  for (size_t i = 0; i < count; ++i)
+  {
+    const AeadMessage &m = messages[i];
+    const size_t blocks = message_blocks(m);
+    for (size_t b = 0; b < blocks; ++b)
+      jobs.push_back({m.key, m.nonce, uint32_t(b)});
+  }
+  keystream.resize(jobs.size() * chacha_block_size);
+  generate(jobs.data(), jobs.size(), keystream.data());
+
+  const uint8_t *stream = keystream.data();
+  for (size_t i = 0; i < count; ++i)
+  {
+    AeadMessage &m = messages[i];
+    const uint8_t *polyKey = stream;
+    const uint8_t *messageStream = stream + chacha_block_size;
+    stream += message_blocks(m) * chacha_block_size;
+    if (seal)
+    {
+      xor_keystream(m.data, messageStream, m.length);
+      compute_tag(m, polyKey, m.tag);
+      m.authentic = true;
+    }
+    else
+    {
+      uint8_t expected[poly1305_tag_size];
+      compute_tag(m, polyKey, expected);
+      m.authentic = same_tag(expected, m.tag);
+      if (m.authentic)
+        xor_keystream(m.data, messageStream, m.length);
+    }
+  }
+}
+
+void aead_seal(AeadMessage *messages, size_t count)
+{
+  aead_batch(messages, count, true, chacha_blocks);
+}
+
+void aead_open(AeadMessage *messages, size_t count)
+{
+  aead_batch(messages, count, false, chacha_blocks);
+}
+
+void aead_seal_scalar(AeadMessage *messages, size_t count)
+{
+  aead_batch(messages, count, true, chacha_blocks_scalar);
+}
+
+void aead_open_scalar(AeadMessage *messages, size_t count)
+{
+  aead_batch(messages, count, false, chacha_blocks_scalar);
+}
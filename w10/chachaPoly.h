@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+constexpr size_t chacha_key_size = 32;
+constexpr size_t chacha_nonce_size = 12;
+constexpr size_t poly1305_tag_size = 16;
+
+// One ChaCha20-Poly1305 (RFC 8439) message, encrypted or decrypted in place.
+struct AeadMessage
+{
+  const uint8_t *key = nullptr;
+  uint8_t nonce[chacha_nonce_size] = {};
+  const uint8_t *aad = nullptr;
+  size_t aadLength = 0;
+  uint8_t *data = nullptr;
+  size_t length = 0;
+  uint8_t *tag = nullptr; // written by seal, checked by open
+  bool authentic = false; // set by open, data is left encrypted when false
+};
+
+// A batch is done in two passes: the ChaCha20 blocks of all its messages are
+// generated side by side, one block per AVX2 or SSE2 lane whichever message it
+// belongs to, then every message is xored with its keystream and MACed. Small
+// packets that would leave most lanes of a per message kernel idle fill them
+// up this way. Safe to call from several threads at once.
+void aead_seal(AeadMessage *messages, size_t count);
+void aead_open(AeadMessage *messages, size_t count);
+// One block at a time with the same results, to check and time the vector path against.
+void aead_seal_scalar(AeadMessage *messages, size_t count);
+void aead_open_scalar(AeadMessage *messages, size_t count);
+// "avx2", "sse2" or "scalar", whichever the ChaCha20 blocks of aead_seal/open run on here
+const char *aead_path();
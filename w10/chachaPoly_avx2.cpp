@@ -0,0 +1,12 @@
+// Built with AVX2 enabled (see CMakeLists.txt), so nothing outside the kernel
+// belongs in here: whatever this file compiles may use AVX2 instructions.
+#include "chachaKernel.h"
+
+#if defined(__AVX2__)
+
+size_t chacha_blocks_avx2(const BlockJob *jobs, size_t count, uint8_t *out)
+{
+  return chacha_blocks_vector<AvxOps>(jobs, count, out);
+}
+
+#endif
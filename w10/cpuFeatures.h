@@ -0,0 +1,33 @@
+#pragma once
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+// Whether the CPU running us (not the one we were compiled for) has AVX2, so
+// kernels built for it in their own files can be picked at runtime. Checked
+// once, the answer doesn't change.
+inline bool cpu_has_avx2()
+{
+#if defined(__AVX2__)
+  return true;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  static const bool supported = []
+  {
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+      return false;
+    __cpuidex(info, 1, 0);
+    const bool osSavesAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesAvx && (info[1] & (1 << 5)) != 0;
+  }();
+  return supported;
+#else
+  return false;
+#endif
+}
@@ -1,14 +1,90 @@
 #include "entity.h"
 #include "mathUtils.h"
+#include "simulateKernel.h"
+#include "cpuFeatures.h"
 
-void simulate_entity(Entity &e, float dt)
+static void sincos_scalar(float v, float &s, float &c)
+{
+  int q = (int)nearbyintf(v * two_over_pi);
+  float fq = (float)q;
+  float r = v - fq * pi_2_hi;
+  r = r - fq * pi_2_mid;
+  r = r - fq * pi_2_lo;
+  float r2 = r * r;
+  float ps = r + r * r2 * (sin_c0 + r2 * (sin_c1 + r2 * sin_c2));
+  float pc = 1.f - 0.5f * r2 + r2 * r2 * (cos_c0 + r2 * (cos_c1 + r2 * cos_c2));
+  bool swap = q & 1;
+  s = swap ? pc : ps;
+  c = swap ? ps : pc;
+  if (q & 2)
+    s = -s;
+  if ((q + 1) & 2)
+    c = -c;
+}
+
+static void simulate_scalar(float &x, float &y, float &speed, float &ori, float thr, float steer, float dt)
 {
-  bool isBraking = sign(e.thr) != 0.f && sign(e.thr) != sign(e.speed);
+  bool isBraking = sign(thr) != 0.f && sign(thr) != sign(speed);
   float accel = isBraking ? 12.f : 3.f;
-  e.speed = move_to(e.speed, clamp(e.thr, -0.3, 1.f) * 10.f, dt, accel);
-  e.ori += e.steer * dt * clamp(e.speed, -2.f, 2.f) * 0.3f;
-  e.ori = e.ori + (e.ori > PI ? -2.f * PI : e.ori < -PI ? 2.f * PI : 0.f);
-  e.x += cosf(e.ori) * e.speed * dt;
-  e.y += sinf(e.ori) * e.speed * dt;
+  speed = move_to(speed, clamp(thr, -0.3f, 1.f) * 10.f, dt, accel);
+  ori += steer * dt * clamp(speed, -2.f, 2.f) * 0.3f;
+  ori = ori + (ori > PI ? -2.f * PI : ori < -PI ? 2.f * PI : 0.f);
+  float s, c;
+  sincos_scalar(ori, s, c);
+  x += c * speed * dt;
+  y += s * speed * dt;
+}
+
+void simulate_entity(Entity &e, float dt)
+{
+  simulate_scalar(e.x, e.y, e.speed, e.ori, e.thr, e.steer, dt);
+}
+
+void simulate_entities_scalar(EntitySpan entities, float dt)
+{
+  for (size_t i = 0; i < entities.count; ++i)
+    simulate_scalar(entities.x[i], entities.y[i], entities.speed[i], entities.ori[i],
+                    entities.thr[i], entities.steer[i], dt);
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+// AVX2 when this CPU has it and the AVX2 file was built (x86 only), SSE2 otherwise.
+static size_t simulate_blocks_best(EntitySpan entities, float dt)
+{
+#if defined(W10_AVX2_KERNELS)
+  if (cpu_has_avx2())
+    return simulate_blocks_avx2(entities, dt);
+#endif
+  return simulate_blocks<SseOps>(entities, dt);
+}
+
+void simulate_entities(EntitySpan entities, float dt)
+{
+  size_t i = simulate_blocks_best(entities, dt);
+  // tail goes through the scalar path, which gives the same bits
+  simulate_entities_scalar(entities.slice(i, entities.count), dt);
+}
+
+const char *simulate_entities_path()
+{
+#if defined(W10_AVX2_KERNELS)
+  if (cpu_has_avx2())
+    return "avx2";
+#endif
+  return "sse2";
+}
+
+#else
+
+void simulate_entities(EntitySpan entities, float dt)
+{
+  simulate_entities_scalar(entities, dt);
+}
+
+const char *simulate_entities_path()
+{
+  return "scalar";
 }
 
+#endif
@@ -1,7 +1,8 @@
 #pragma once
 #include <cstdint>
+#include <cstddef>
 
-constexpr uint16_t invalid_entity = -1;
+constexpr uint32_t invalid_entity = -1;
 struct Entity
 {
   uint32_t color = 0xff00ffff;
@@ -11,8 +12,32 @@ struct Entity
   float ori = 0.f;
   float thr = 0.f;
   float steer = 0.f;
-  uint16_t eid = invalid_entity;
+  uint32_t eid = invalid_entity;
 };
 
 void simulate_entity(Entity &e, float dt);
 
+// Structure-of-arrays view over a batch of entities.
+struct EntitySpan
+{
+  float *x = nullptr;
+  float *y = nullptr;
+  float *speed = nullptr;
+  float *ori = nullptr;
+  const float *thr = nullptr;
+  const float *steer = nullptr;
+  size_t count = 0;
+
+  EntitySpan slice(size_t begin, size_t end) const
+  {
+    return {x + begin, y + begin, speed + begin, ori + begin, thr + begin, steer + begin, end - begin};
+  }
+};
+
+// Vectorized with SSE2, or AVX2 when the CPU running it has it. Every path,
+// including the scalar one and simulate_entity, does the same float operations
+// in the same order, so results are bit-for-bit identical whichever one runs.
+void simulate_entities(EntitySpan entities, float dt);
+void simulate_entities_scalar(EntitySpan entities, float dt);
+// "avx2", "sse2" or "scalar", whichever simulate_entities runs on this machine
+const char *simulate_entities_path();
@@ -0,0 +1,66 @@
+#include "entityStore.h"
+
+template<typename T>
+static void swap_remove(std::vector<T> &v, size_t idx)
+{
+  v[idx] = v.back();
+  v.pop_back();
+}
+
+uint32_t EntityStore::create(Entity ent)
+{
+  ent.eid = registry.create();
+  if (ent.eid == invalid_entity)
+    return invalid_entity;
+  x.push_back(ent.x);
+  y.push_back(ent.y);
+  speed.push_back(ent.speed);
+  ori.push_back(ent.ori);
+  thr.push_back(ent.thr);
+  steer.push_back(ent.steer);
+  color.push_back(ent.color);
+  eid.push_back(ent.eid);
+  return ent.eid;
+}
+
+void EntityStore::destroy(uint32_t id)
+{
+  size_t idx = registry.destroy(id);
+  if (idx == EntityRegistry::npos)
+    return;
+  swap_remove(x, idx);
+  swap_remove(y, idx);
+  swap_remove(speed, idx);
+  swap_remove(ori, idx);
+  swap_remove(thr, idx);
+  swap_remove(steer, idx);
+  swap_remove(color, idx);
+  swap_remove(eid, idx);
+}
+
+Entity EntityStore::get(size_t idx) const
+{
+  Entity ent;
+  ent.color = color[idx];
+  ent.x = x[idx];
+  ent.y = y[idx];
+  ent.speed = speed[idx];
+  ent.ori = ori[idx];
+  ent.thr = thr[idx];
+  ent.steer = steer[idx];
+  ent.eid = eid[idx];
+  return ent;
+}
+
+EntitySpan EntityStore::span()
+{
+  EntitySpan res;
+  res.x = x.data();
+  res.y = y.data();
+  res.speed = speed.data();
+  res.ori = ori.data();
+  res.thr = thr.data();
+  res.steer = steer.data();
+  res.count = size();
+  return res;
+}
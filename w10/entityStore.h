@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "entity.h"
+#include "entityRegistry.h"
+
+// Server side entity storage as a structure of arrays, so the per tick
+// simulation streams through contiguous floats (see simulate_entities).
+// Arrays stay dense, ids are resolved to indices through the registry.
+struct EntityStore
+{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> speed;
+  std::vector<float> ori;
+  std::vector<float> thr;
+  std::vector<float> steer;
+  std::vector<uint32_t> color;
+  std::vector<uint32_t> eid;
+
+  size_t size() const { return eid.size(); }
+  bool empty() const { return eid.empty(); }
+
+  // assigns ent a fresh eid and returns it, invalid_entity when the store is full
+  uint32_t create(Entity ent);
+  void destroy(uint32_t id);
+  // index of the entity or EntityRegistry::npos
+  size_t find(uint32_t id) const { return registry.find(id); }
+  Entity get(size_t idx) const;
+  EntitySpan span();
+
+private:
+  EntityRegistry registry;
+};
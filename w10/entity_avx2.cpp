@@ -0,0 +1,12 @@
+// Built with AVX2 enabled (see CMakeLists.txt), so nothing outside the kernel
+// belongs in here: whatever this file compiles may use AVX2 instructions.
+#include "simulateKernel.h"
+
+#if defined(__AVX2__)
+
+size_t simulate_blocks_avx2(EntitySpan entities, float dt)
+{
+  return simulate_blocks<AvxOps>(entities, dt);
+}
+
+#endif
@@ -0,0 +1,164 @@
+// Headless load generator for w10_server: many scripted bots from one process,
+// each its own ENet peer playing the same protocol as the w10 client, delta
+// snapshots, acks and session cipher included. The loop, stats and report are
+// common/loadgenCore's, this is the w10 protocol side.
+// usage: w10_loadgen [bots] [seconds] [host] [port]
+#include <enet/enet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+#include "entity.h"
+#include "protocol.h"
+#include "packetPool.h"
+#include "inputWindow.h"
+#include "loadgenCore.h"
+
+// how long a bot keeps its scripted input before picking another one
+constexpr int min_input_hold_ms = 250;
+constexpr int max_input_hold_ms = 2000;
+
+class Bot : public LoadBot
+{
+public:
+  explicit Bot(uint32_t seed) : rng(seed) {}
+
+  void on_connect() override
+  {
+    send_join(peer);
+  }
+
+  void on_disconnect() override
+  {
+    eid = invalid_entity;
+    lastAppliedSnapshot = invalid_snapshot;
+    session = SessionCipher();
+  }
+
+  void on_receive(ENetPacket *packet, double arrival, LoadStats &stats) override
+  {
+    switch (get_packet_type(packet))
+    {
+    case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+      deserialize_set_controlled_entity(packet, eid);
+      break;
+    case E_SERVER_TO_CLIENT_KEY:
+      deserialize_cipher_key(packet, session);
+      break;
+    case E_SERVER_TO_CLIENT_SNAPSHOT_DELTA:
+      if (open_packet(session, packet))
+        on_snapshot_delta(packet, arrival, stats);
+      break;
+    default:
+      break;
+    };
+  }
+
+  void drive(double now) override
+  {
+    if (eid == invalid_entity)
+      return;
+    if (now >= nextInputChange)
+    {
+      std::uniform_int_distribution<int> axis(-1, 1);
+      std::uniform_int_distribution<int> hold(min_input_hold_ms, max_input_hold_ms);
+      thr = float(axis(rng));
+      steer = float(axis(rng));
+      nextInputChange = now + hold(rng);
+    }
+    if (inputWindow.sample(enet_time_get(), thr, steer))
+      send_entity_input(peer, session, eid, inputWindow.samples(), inputWindow.size());
+  }
+
+  bool playing() const override { return eid != invalid_entity; }
+
+private:
+  // Time from the server tick to this snapshot packet being handled. The first
+  // packet of a seq is taken to be half the lowest round trip late, the other
+  // parts of it are measured against that; a whole snapshot held back by a slow
+  // tick shows up in the ENet round trip instead.
+  double snapshot_latency(uint32_t seq, double arrival)
+  {
+    if (seq != burstSeq)
+    {
+      burstSeq = seq;
+      burstStart = arrival;
+    }
+    return peer->lowestRoundTripTime * 0.5 + (arrival - burstStart);
+  }
+
+  // same reassembly as the client, the acks are what picks the server's baselines
+  void on_snapshot_delta(ENetPacket *packet, double arrival, LoadStats &stats)
+  {
+    SnapshotDeltaHeader header;
+    if (!deserialize_snapshot_delta_header(packet, header))
+      return;
+    stats.latency.add(snapshot_latency(header.seq, arrival));
+    if (header.seq <= lastAppliedSnapshot)
+      return;
+    WorldSnapshot *snapshot = snapshotHistory.find(header.seq);
+    if (!snapshot)
+    {
+      const WorldSnapshot *baseline = snapshotHistory.find(header.baselineSeq);
+      if (header.baselineSeq != invalid_snapshot && !baseline)
+        return;
+      std::vector<QuantizedEntity> baselineEntities;
+      if (baseline)
+        baselineEntities = baseline->entities;
+      snapshot = &snapshotHistory.emplace(header.seq);
+      snapshot->entities = std::move(baselineEntities);
+      snapshot->expect_parts(header.numParts);
+    }
+    else if (snapshot->numParts != header.numParts)
+      return; // not the snapshot its first part described
+    deserialize_snapshot_delta(packet, *snapshot);
+    if (!snapshot->complete())
+      return;
+
+    lastAppliedSnapshot = snapshot->seq;
+    send_snapshot_ack(peer, session, snapshot->seq);
+    stats.snapshots++;
+  }
+
+  uint32_t eid = invalid_entity;
+  InputWindow inputWindow{10};
+  std::mt19937 rng;
+  double nextInputChange = 0.0;
+  float thr = 0.f;
+  float steer = 0.f;
+  SessionCipher session;
+  SnapshotHistory snapshotHistory;
+  uint32_t lastAppliedSnapshot = invalid_snapshot;
+  // arrival of the first packet of the newest snapshot seq
+  uint32_t burstSeq = invalid_snapshot;
+  double burstStart = 0.0;
+};
+
+int main(int argc, const char **argv)
+{
+  LoadgenOptions options;
+  parse_loadgen_options(argc, argv, options);
+
+  if (packet_pool_initialize() != 0)
+  {
+    printf("Cannot init ENet");
+    return 1;
+  }
+
+  ENetAddress address;
+  if (enet_address_set_host(&address, options.hostName) != 0)
+  {
+    printf("Cannot resolve %s\n", options.hostName);
+    return 1;
+  }
+  address.port = options.port;
+
+  int result = run_loadgen(options, address, [](size_t index)
+  {
+    return std::make_unique<Bot>(uint32_t(index));
+  });
+
+  atexit(enet_deinitialize);
+  return result;
+}
@@ -6,22 +6,47 @@
 #include <math.h>
 
 #include <vector>
+#include <unordered_map>
 #include "entity.h"
 #include "protocol.h"
+#include "packetPool.h"
+#include "inputWindow.h"
 
 
 static std::vector<Entity> entities;
-static uint16_t my_entity = invalid_entity;
+// eid -> index in entities, the client never removes entities so indices stay put
+static std::unordered_map<uint32_t, size_t> entityIndex;
+static uint32_t my_entity = invalid_entity;
+static SnapshotHistory snapshotHistory;
+static uint32_t lastAppliedSnapshot = invalid_snapshot;
+static SessionCipher session;
+// the server ticks every 10 ms, sampling input faster than that is wasted
+static InputWindow inputWindow(10);
+
+static Entity *find_entity(uint32_t eid)
+{
+  auto it = entityIndex.find(eid);
+  return it != entityIndex.end() ? &entities[it->second] : nullptr;
+}
+
+static void apply_snapshot_entity(const QuantizedEntity &q)
+{
+  if (Entity *e = find_entity(q.eid))
+    dequantize_entity(q, e->x, e->y, e->ori);
+}
 
 void on_new_entity_packet(ENetPacket *packet)
 {
   Entity newEntity;
   deserialize_new_entity(packet, newEntity);
-  // TODO: Direct adressing, of course!
-  for (const Entity &e : entities)
-    if (e.eid == newEntity.eid)
-      return; // don't need to do anything, we already have entity
+  if (!entityIndex.emplace(newEntity.eid, entities.size()).second)
+    return; // don't need to do anything, we already have entity
   entities.push_back(newEntity);
+  // deltas only touch what changed, and the ones applied so far may have
+  // overtaken this reliable packet
+  if (const WorldSnapshot *applied = snapshotHistory.find(lastAppliedSnapshot))
+    if (const QuantizedEntity *q = applied->find(newEntity.eid))
+      apply_snapshot_entity(*q);
 }
 
 void on_set_controlled_entity(ENetPacket *packet)
@@ -31,27 +56,97 @@ void on_set_controlled_entity(ENetPacket *packet)
 
 void on_snapshot(ENetPacket *packet)
 {
-  uint16_t eid = invalid_entity;
+  uint32_t eid = invalid_entity;
   float x = 0.f; float y = 0.f; float ori = 0.f;
   deserialize_snapshot(packet, eid, x, y, ori);
-  // TODO: Direct adressing, of course!
-  for (Entity &e : entities)
-    if (e.eid == eid)
+  if (Entity *e = find_entity(eid))
+  {
+    e->x = x;
+    e->y = y;
+    e->ori = ori;
+  }
+}
+
+void on_snapshot_batch(ENetPacket *packet)
+{
+  static std::vector<EntitySnapshot> snapshots;
+  deserialize_snapshot_batch(packet, snapshots);
+  for (const EntitySnapshot &snap : snapshots)
+    if (Entity *e = find_entity(snap.eid))
     {
-      e.x = x;
-      e.y = y;
-      e.ori = ori;
+      e->x = snap.x;
+      e->y = snap.y;
+      e->ori = snap.ori;
     }
 }
 
+// Entities already hold the last applied snapshot. A delta against exactly that
+// one only has to apply what its parts carried. Against an older baseline an
+// entity may have moved since and be back where the baseline had it, so the
+// new snapshot is compared with the applied one instead (both sorted by eid).
+static void apply_snapshot(const WorldSnapshot &snapshot, uint32_t baselineSeq)
+{
+  const WorldSnapshot *applied = snapshotHistory.find(lastAppliedSnapshot);
+  if (applied && baselineSeq == lastAppliedSnapshot)
+  {
+    for (uint32_t eid : snapshot.changed)
+      if (const QuantizedEntity *q = snapshot.find(eid))
+        apply_snapshot_entity(*q);
+    return;
+  }
+  size_t j = 0;
+  for (const QuantizedEntity &q : snapshot.entities)
+  {
+    const QuantizedEntity *previous = nullptr;
+    if (applied)
+    {
+      while (j < applied->entities.size() && applied->entities[j].eid < q.eid)
+        ++j;
+      if (j < applied->entities.size() && applied->entities[j].eid == q.eid)
+        previous = &applied->entities[j];
+    }
+    if (delta_mask(q, previous))
+      apply_snapshot_entity(q);
+  }
+}
+
+void on_snapshot_delta(ENetPacket *packet, ENetPeer *serverPeer)
+{
+  SnapshotDeltaHeader header;
+  if (!deserialize_snapshot_delta_header(packet, header) || header.seq <= lastAppliedSnapshot)
+    return;
+  WorldSnapshot *snapshot = snapshotHistory.find(header.seq);
+  if (!snapshot)
+  {
+    const WorldSnapshot *baseline = snapshotHistory.find(header.baselineSeq);
+    if (header.baselineSeq != invalid_snapshot && !baseline)
+      return; // we no longer have this baseline, wait for the server to catch up with our acks
+    std::vector<QuantizedEntity> baselineEntities;
+    if (baseline)
+      baselineEntities = baseline->entities;
+    snapshot = &snapshotHistory.emplace(header.seq);
+    snapshot->entities = std::move(baselineEntities);
+    snapshot->expect_parts(header.numParts);
+  }
+  else if (snapshot->numParts != header.numParts)
+    return; // not the snapshot its first part described
+  deserialize_snapshot_delta(packet, *snapshot);
+  if (!snapshot->complete())
+    return;
+
+  apply_snapshot(*snapshot, header.baselineSeq);
+  lastAppliedSnapshot = snapshot->seq;
+  send_snapshot_ack(serverPeer, session, snapshot->seq);
+}
+
 void on_key(ENetPacket *packet)
 {
-  deserialize_and_set_key(packet);
+  deserialize_cipher_key(packet, session);
 }
 
 int main(int argc, const char **argv)
 {
-  if (enet_initialize() != 0)
+  if (packet_pool_initialize() != 0)
   {
     printf("Cannot init ENet");
     return 1;
@@ -124,6 +219,13 @@ int main(int argc, const char **argv)
         case E_SERVER_TO_CLIENT_SNAPSHOT:
           on_snapshot(event.packet);
           break;
+        case E_SERVER_TO_CLIENT_SNAPSHOT_BATCH:
+          on_snapshot_batch(event.packet);
+          break;
+        case E_SERVER_TO_CLIENT_SNAPSHOT_DELTA:
+          if (open_packet(session, event.packet))
+            on_snapshot_delta(event.packet, serverPeer);
+          break;
         case E_SERVER_TO_CLIENT_KEY:
           on_key(event.packet);
           break;
@@ -139,17 +241,16 @@ int main(int argc, const char **argv)
       bool right = IsKeyDown(KEY_RIGHT);
       bool up = IsKeyDown(KEY_UP);
       bool down = IsKeyDown(KEY_DOWN);
-      // TODO: Direct adressing, of course!
-      for (Entity &e : entities)
-        if (e.eid == my_entity)
-        {
-          // Update
-          float thr = (up ? 1.f : 0.f) + (down ? -1.f : 0.f);
-          float steer = (left ? -1.f : 0.f) + (right ? 1.f : 0.f);
+      if (find_entity(my_entity))
+      {
+        // Update
+        float thr = (up ? 1.f : 0.f) + (down ? -1.f : 0.f);
+        float steer = (left ? -1.f : 0.f) + (right ? 1.f : 0.f);
 
-          // Send
-          send_entity_input(serverPeer, my_entity, thr, steer);
-        }
+        // Send
+        if (inputWindow.sample(enet_time_get(), thr, steer))
+          send_entity_input(serverPeer, session, my_entity, inputWindow.samples(), inputWindow.size());
+      }
     }
 
     BeginDrawing();
@@ -1,17 +1,38 @@
 #include "protocol.h"
-#include "quantisation.h"
+#include "bitstream.h"
+#include "bandwidthStats.h"
+#include "entityRegistry.h"
 #include <cstring> // memcpy
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <stdlib.h>
 
-static uint32_t xorCipherKey = 0;
+static PacketSink packetSink = nullptr;
+
+void set_packet_sink(PacketSink sink)
+{
+  packetSink = sink;
+}
+
+// every packet goes out through here so bandwidthStats sees what we hand to ENet
+static void send_packet(ENetPeer *peer, uint8_t channel, ENetPacket *packet)
+{
+  if (packetSink)
+  {
+    packetSink(peer, channel, packet);
+    return;
+  }
+  count_sent(peer, packet);
+  enet_peer_send(peer, channel, packet);
+}
 
 void send_join(ENetPeer *peer)
 {
   ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t), ENET_PACKET_FLAG_RELIABLE);
   *packet->data = E_CLIENT_TO_SERVER_JOIN;
 
-  enet_peer_send(peer, 0, packet);
+  send_packet(peer, 0, packet);
 }
 
 void send_new_entity(ENetPeer *peer, const Entity &ent)
@@ -22,29 +43,29 @@ void send_new_entity(ENetPeer *peer, const Entity &ent)
   *ptr = E_SERVER_TO_CLIENT_NEW_ENTITY; ptr += sizeof(uint8_t);
   memcpy(ptr, &ent, sizeof(Entity)); ptr += sizeof(Entity);
 
-  enet_peer_send(peer, 0, packet);
+  send_packet(peer, 0, packet);
 }
 
-void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
+void send_set_controlled_entity(ENetPeer *peer, uint32_t eid)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t),
+  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint32_t),
                                                    ENET_PACKET_FLAG_RELIABLE);
   uint8_t *ptr = packet->data;
   *ptr = E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY; ptr += sizeof(uint8_t);
-  memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+  memcpy(ptr, &eid, sizeof(uint32_t)); ptr += sizeof(uint32_t);
 
-  enet_peer_send(peer, 0, packet);
+  send_packet(peer, 0, packet);
 }
 
-void send_cipher_key(ENetPeer *peer, uint32_t key)
+void send_cipher_key(ENetPeer *peer, const uint8_t *key)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint32_t),
+  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + chacha_key_size,
                                                    ENET_PACKET_FLAG_RELIABLE);
   uint8_t *ptr = packet->data;
   *ptr = E_SERVER_TO_CLIENT_KEY; ptr += sizeof(uint8_t);
-  memcpy(ptr, &key, sizeof(uint32_t)); ptr += sizeof(uint32_t);
+  memcpy(ptr, key, chacha_key_size); ptr += chacha_key_size;
 
-  enet_peer_send(peer, 0, packet);
+  send_packet(peer, 0, packet);
 }
 
 void fuzz_packet_data(ENetPacket *packet)
@@ -52,53 +73,242 @@ void fuzz_packet_data(ENetPacket *packet)
   packet->data[rand() % packet->dataLength] = (uint8_t)rand();
 }
 
-void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float ori)
+static constexpr int eid_bits = EntityRegistry::slot_bits;
+
+static constexpr int input_seq_bits = 16;
+static constexpr int input_count_bits = 2;
+static_assert(input_window_size < (1 << input_count_bits));
+
+// Samples in a window have consecutive seqs, so only the newest one is sent:
+// [eid][newest seq][count][thr, steer] * count, oldest sample first.
+void send_entity_input(ENetPeer *peer, SessionCipher &session, uint32_t eid, const InputSample *samples, size_t count)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) +
-                                                   sizeof(float) * 2,
-                                                   //sizeof(uint8_t),
-                                                   ENET_PACKET_FLAG_UNSEQUENCED);
-  uint8_t *ptr = packet->data;
-  *ptr = E_CLIENT_TO_SERVER_INPUT; ptr += sizeof(uint8_t);
-  memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  memcpy(ptr, &thr, sizeof(float)); ptr += sizeof(float);
-  memcpy(ptr, &ori, sizeof(float)); ptr += sizeof(float);
-  /*
-  float4bitsQuantized thrPacked(thr, -1.f, 1.f);
-  float4bitsQuantized oriPacked(ori, -1.f, 1.f);
-  uint8_t thrSteerPacked = (thrPacked.packedVal << 4) | oriPacked.packedVal;
-  memcpy(ptr, &thrSteerPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  */
-  /*
-  memcpy(ptr, &thrPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  memcpy(ptr, &oriPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  */
+  count = std::min(count, input_window_size);
+  if (count == 0 || !session.ready)
+    return;
+  const size_t payloadSize = (eid_bits + input_seq_bits + input_count_bits +
+                              count * float4bitsQuantized::bits * 2 + 7) / 8;
+  ENetPacket *packet = create_sealed_packet(E_CLIENT_TO_SERVER_INPUT, payloadSize);
+  BitWriter writer(sealed_payload(packet), payloadSize);
+  writer.write(eid, eid_bits);
+  writer.write(samples[count - 1].seq, input_seq_bits);
+  writer.write(count, input_count_bits);
+  for (size_t i = 0; i < count; ++i)
+  {
+    writer.write(float4bitsQuantized(samples[i].thr, -1.f, 1.f));
+    writer.write(float4bitsQuantized(samples[i].steer, -1.f, 1.f));
+  }
 
+  // what is fuzzed gets sealed, so the server still has to cope with garbage inputs
   fuzz_packet_data(packet);
-  cipher_data(packet);
+  SealJob job;
+  job.session = &session;
+  job.packet = packet;
+  seal_packets(&job, 1);
+
+  send_packet(peer, 1, packet);
+}
 
-  enet_peer_send(peer, 1, packet);
+static constexpr size_t snapshot_entry_bits = eid_bits + PositionXQuantized::bits +
+                                              PositionYQuantized::bits + OrientationQuantized::bits;
+
+static void write_snapshot_entry(BitWriter &writer, const QuantizedEntity &q)
+{
+  writer.write(q.eid, eid_bits);
+  writer.write(PositionXQuantized(q.x));
+  writer.write(PositionYQuantized(q.y));
+  writer.write(OrientationQuantized(q.ori));
 }
 
-void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori)
+static void read_snapshot_entry(BitReader &reader, QuantizedEntity &q)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) +
-                                                   sizeof(uint16_t) +
-                                                   sizeof(uint16_t) +
-                                                   sizeof(uint8_t),
+  PositionXQuantized xPacked;
+  PositionYQuantized yPacked;
+  OrientationQuantized oriPacked;
+  q.eid = reader.read(eid_bits);
+  reader.read(xPacked);
+  reader.read(yPacked);
+  reader.read(oriPacked);
+  q.x = xPacked.packedVal;
+  q.y = yPacked.packedVal;
+  q.ori = oriPacked.packedVal;
+}
+
+void send_snapshot(ENetPeer *peer, uint32_t eid, float x, float y, float ori)
+{
+  constexpr size_t payloadSize = (snapshot_entry_bits + 7) / 8;
+  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + payloadSize,
+                                                   ENET_PACKET_FLAG_UNSEQUENCED);
+  *packet->data = E_SERVER_TO_CLIENT_SNAPSHOT;
+  BitWriter writer(packet->data + sizeof(uint8_t), payloadSize);
+  write_snapshot_entry(writer, quantize_entity(eid, x, y, ori));
+
+  send_packet(peer, 1, packet);
+}
+
+static constexpr size_t snapshot_batch_header_size = sizeof(uint8_t) + sizeof(uint16_t);
+
+static ENetPacket *create_snapshot_batch(const Entity *entities, uint16_t count)
+{
+  const size_t payloadSize = (count * snapshot_entry_bits + 7) / 8;
+  ENetPacket *packet = enet_packet_create(nullptr, snapshot_batch_header_size + payloadSize,
                                                    ENET_PACKET_FLAG_UNSEQUENCED);
   uint8_t *ptr = packet->data;
-  *ptr = E_SERVER_TO_CLIENT_SNAPSHOT; ptr += sizeof(uint8_t);
-  memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  uint16_t xPacked = pack_float<uint16_t>(x, -16.f, 16.f, 11);
-  uint16_t yPacked = pack_float<uint16_t>(y, -8.f, 8.f, 10);
-  uint8_t oriPacked = pack_float<uint8_t>(ori, -PI, PI, 8);
-  //printf("xPacked/unpacked %d %f\n", xPacked, x);
-  memcpy(ptr, &xPacked, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  memcpy(ptr, &yPacked, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  memcpy(ptr, &oriPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
+  *ptr = E_SERVER_TO_CLIENT_SNAPSHOT_BATCH; ptr += sizeof(uint8_t);
+  memcpy(ptr, &count, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+  BitWriter writer(ptr, payloadSize);
+  for (uint16_t i = 0; i < count; ++i)
+    write_snapshot_entry(writer, quantize_entity(entities[i].eid, entities[i].x, entities[i].y, entities[i].ori));
+  return packet;
+}
+
+// Packs as many entity states as fit into one MTU-sized packet and repeats
+// until the whole world is sent: [type][count:u16][count * entry bits].
+// Every packet is encoded once and shared by all peers through its refcount.
+void broadcast_snapshot_batch(ENetHost *host, const std::vector<Entity> &entities)
+{
+  constexpr size_t maxEntries = (snapshot_batch_max_size - snapshot_batch_header_size) * 8 /
+                                snapshot_entry_bits;
+
+  for (size_t first = 0; first < entities.size(); first += maxEntries)
+  {
+    uint16_t count = std::min(entities.size() - first, maxEntries);
+    ENetPacket *packet = create_snapshot_batch(&entities[first], count);
+    for (size_t i = 0; i < host->peerCount; ++i)
+      if (host->peers[i].state == ENET_PEER_STATE_CONNECTED)
+        count_sent(&host->peers[i], packet);
+    enet_host_broadcast(host, 1, packet);
+  }
+}
+
+static constexpr size_t snapshot_delta_header_size = sizeof(uint8_t) + 2 * sizeof(uint32_t) +
+                                                     3 * sizeof(uint16_t);
+
+static constexpr int delta_mask_bits = 3;
+
+static constexpr size_t delta_entry_bits(uint8_t mask)
+{
+  return eid_bits + delta_mask_bits +
+         (mask & E_DELTA_X ? PositionXQuantized::bits : 0) +
+         (mask & E_DELTA_Y ? PositionYQuantized::bits : 0) +
+         (mask & E_DELTA_ORI ? OrientationQuantized::bits : 0);
+}
+
+// each peer's copy grows by the seq and the tag once sealed, and still has to fit
+static constexpr size_t max_delta_part_bits =
+  (snapshot_batch_max_size - snapshot_delta_header_size - sealed_overhead) * 8;
+
+// Sends only the fields that differ from baseline (or everything when there is
+// no baseline), split into MTU-sized parts:
+// [type][seq:u32][baseline:u32][part:u16][numParts:u16][count:u16][count * (eid mask fields...) bits].
+// Idle entities are omitted, so a quiet world costs one header per tick.
+// The parts are encoded once and shared by every peer acking the same baseline.
+void encode_snapshot_delta(const WorldSnapshot &snapshot, const WorldSnapshot *baseline,
+                           std::vector<ENetPacket*> &packets)
+{
+  struct Change { const QuantizedEntity *q; uint8_t mask; };
+  struct Part { size_t first; size_t count; size_t bits; };
+  // server encodes several baselines at once on the thread pool
+  thread_local std::vector<Change> changes;
+  thread_local std::vector<Part> parts;
+  changes.clear();
+  parts.clear();
+
+  for (const QuantizedEntity &q : snapshot.entities)
+    if (uint8_t mask = delta_mask(q, baseline ? baseline->find(q.eid) : nullptr))
+      changes.push_back({&q, mask});
+
+  parts.push_back({0, 0, 0});
+  for (size_t i = 0; i < changes.size(); ++i)
+  {
+    size_t entryBits = delta_entry_bits(changes[i].mask);
+    if (parts.back().bits + entryBits > max_delta_part_bits)
+      parts.push_back({i, 0, 0});
+    parts.back().count++;
+    parts.back().bits += entryBits;
+  }
+  // Some 12M changed entities. Nothing goes out rather than part of the world
+  // passed off as all of it: the peer keeps its baseline and stays unacked.
+  if (parts.size() > max_snapshot_parts)
+  {
+    printf("Snapshot %u needs %zu parts, more than %u can be numbered\n", snapshot.seq, parts.size(),
+           unsigned(max_snapshot_parts));
+    return;
+  }
+
+  const uint32_t baselineSeq = baseline ? baseline->seq : invalid_snapshot;
+  const uint16_t numParts = parts.size();
+  for (uint16_t partIdx = 0; partIdx < numParts; ++partIdx)
+  {
+    const Part &part = parts[partIdx];
+    const uint16_t count = part.count;
+    const size_t payloadSize = (part.bits + 7) / 8;
+    ENetPacket *packet = enet_packet_create(nullptr, snapshot_delta_header_size + payloadSize,
+                                                     ENET_PACKET_FLAG_UNSEQUENCED);
+    uint8_t *ptr = packet->data;
+    *ptr = E_SERVER_TO_CLIENT_SNAPSHOT_DELTA; ptr += sizeof(uint8_t);
+    memcpy(ptr, &snapshot.seq, sizeof(uint32_t)); ptr += sizeof(uint32_t);
+    memcpy(ptr, &baselineSeq, sizeof(uint32_t)); ptr += sizeof(uint32_t);
+    memcpy(ptr, &partIdx, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+    memcpy(ptr, &numParts, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+    memcpy(ptr, &count, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+    BitWriter writer(ptr, payloadSize);
+    for (size_t i = part.first; i < part.first + part.count; ++i)
+    {
+      const QuantizedEntity &q = *changes[i].q;
+      const uint8_t mask = changes[i].mask;
+      writer.write(q.eid, eid_bits);
+      writer.write(mask, delta_mask_bits);
+      if (mask & E_DELTA_X)
+        writer.write(PositionXQuantized(q.x));
+      if (mask & E_DELTA_Y)
+        writer.write(PositionYQuantized(q.y));
+      if (mask & E_DELTA_ORI)
+        writer.write(OrientationQuantized(q.ori));
+    }
+    packets.push_back(packet);
+  }
+}
 
-  enet_peer_send(peer, 1, packet);
+void seal_snapshot_deliveries(SnapshotDelivery *deliveries, size_t count)
+{
+  thread_local std::vector<SealJob> jobs;
+  jobs.clear();
+  for (size_t i = 0; i < count; ++i)
+  {
+    SnapshotDelivery &delivery = deliveries[i];
+    delivery.sealed.clear();
+    for (const ENetPacket *part : *delivery.parts)
+    {
+      const size_t payloadSize = part->dataLength - sizeof(uint8_t);
+      ENetPacket *packet = create_sealed_packet(*part->data, payloadSize);
+      memcpy(sealed_payload(packet), part->data + sizeof(uint8_t), payloadSize);
+      delivery.sealed.push_back(packet);
+      jobs.push_back({delivery.session, packet});
+    }
+  }
+  seal_packets(jobs.data(), jobs.size());
+}
+
+void send_snapshot_deliveries(SnapshotDelivery *deliveries, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+    for (ENetPacket *packet : deliveries[i].sealed)
+      send_packet(deliveries[i].peer, 1, packet);
+}
+
+void send_snapshot_ack(ENetPeer *peer, SessionCipher &session, uint32_t seq)
+{
+  if (!session.ready)
+    return;
+  ENetPacket *packet = create_sealed_packet(E_CLIENT_TO_SERVER_SNAPSHOT_ACK, sizeof(uint32_t));
+  memcpy(sealed_payload(packet), &seq, sizeof(uint32_t));
+  SealJob job;
+  job.session = &session;
+  job.packet = packet;
+  seal_packets(&job, 1);
+
+  send_packet(peer, 1, packet);
 }
 
 MessageType get_packet_type(ENetPacket *packet)
@@ -112,69 +322,126 @@ void deserialize_new_entity(ENetPacket *packet, Entity &ent)
   ent = *(Entity*)(ptr); ptr += sizeof(Entity);
 }
 
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
+void deserialize_set_controlled_entity(ENetPacket *packet, uint32_t &eid)
 {
   uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
+  eid = *(uint32_t*)(ptr); ptr += sizeof(uint32_t);
 }
 
-void xor_packet_data(ENetPacket *packet, uint8_t *key_ptr)
+size_t deserialize_entity_input(ENetPacket *packet, uint32_t &eid, InputSample *samples)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  uint8_t *end = packet->data + packet->dataLength;
-  for (int i = 0; ptr < end; ++ptr, ++i)
+  static uint8_t neutralPackedValue = pack_float<uint8_t>(0.f, -1.f, 1.f, float4bitsQuantized::bits);
+  BitReader reader(packet->data + sizeof(uint8_t), packet->dataLength - sizeof(uint8_t));
+  eid = reader.read(eid_bits);
+  uint16_t newestSeq = reader.read(input_seq_bits);
+  size_t count = std::min<size_t>(reader.read(input_count_bits), input_window_size);
+  for (size_t i = 0; i < count; ++i)
+  {
+    float4bitsQuantized thrPacked;
+    float4bitsQuantized steerPacked;
+    reader.read(thrPacked);
+    reader.read(steerPacked);
+    samples[i].seq = uint16_t(newestSeq - (count - 1 - i));
+    samples[i].thr = thrPacked.packedVal == neutralPackedValue ? 0.f : thrPacked.unpack(-1.f, 1.f);
+    samples[i].steer = steerPacked.packedVal == neutralPackedValue ? 0.f : steerPacked.unpack(-1.f, 1.f);
+  }
+  if (reader.overflowed())
   {
-    i = i % 4;
-    *ptr ^= key_ptr[i];
+    eid = invalid_entity;
+    return 0;
   }
+  return count;
 }
 
-void cipher_data(ENetPacket *packet)
+void deserialize_snapshot(ENetPacket *packet, uint32_t &eid, float &x, float &y, float &ori)
 {
-  xor_packet_data(packet, (uint8_t*)&xorCipherKey);
+  BitReader reader(packet->data + sizeof(uint8_t), packet->dataLength - sizeof(uint8_t));
+  QuantizedEntity q;
+  read_snapshot_entry(reader, q);
+  eid = reader.overflowed() ? invalid_entity : q.eid;
+  dequantize_entity(q, x, y, ori);
 }
 
-void decipher_data(ENetPacket *packet, ENetPeer *peer)
+void deserialize_snapshot_batch(ENetPacket *packet, std::vector<EntitySnapshot> &snapshots)
 {
-  xor_packet_data(packet, (uint8_t*)peer->data);
+  snapshots.clear();
+  if (packet->dataLength < snapshot_batch_header_size)
+    return;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  uint16_t count = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
+  BitReader reader(ptr, packet->dataLength - snapshot_batch_header_size);
+  // never trust the count more than the actual packet length
+  count = std::min<size_t>(count, reader.bits_left() / snapshot_entry_bits);
+
+  snapshots.resize(count);
+  for (EntitySnapshot &snap : snapshots)
+  {
+    QuantizedEntity q;
+    read_snapshot_entry(reader, q);
+    snap.eid = q.eid;
+    dequantize_entity(q, snap.x, snap.y, snap.ori);
+  }
 }
 
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer)
+bool deserialize_snapshot_delta_header(ENetPacket *packet, SnapshotDeltaHeader &header)
 {
+  if (packet->dataLength < snapshot_delta_header_size)
+    return false;
   uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  header.seq = *(uint32_t*)(ptr); ptr += sizeof(uint32_t);
+  header.baselineSeq = *(uint32_t*)(ptr); ptr += sizeof(uint32_t);
+  header.part = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
+  header.numParts = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
+  return header.seq != invalid_snapshot && header.part < header.numParts;
+}
 
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  thr = *(float*)(ptr); ptr += sizeof(float);
-  steer = *(float*)(ptr); ptr += sizeof(float);
-  //uint8_t thrSteerPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  /*
-  uint8_t thrPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  uint8_t oriPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  */
-  /*
-  static uint8_t neutralPackedValue = pack_float<uint8_t>(0.f, -1.f, 1.f, 4);
-  float4bitsQuantized thrPacked(thrSteerPacked >> 4);
-  float4bitsQuantized steerPacked(thrSteerPacked & 0x0f);
-  thr = thrPacked.packedVal == neutralPackedValue ? 0.f : thrPacked.unpack(-1.f, 1.f);
-  steer = steerPacked.packedVal == neutralPackedValue ? 0.f : steerPacked.unpack(-1.f, 1.f);
-  */
-}
-
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori)
+void deserialize_snapshot_delta(ENetPacket *packet, WorldSnapshot &snapshot)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint16_t xPacked = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint16_t yPacked = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint8_t oriPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  x = unpack_float<uint16_t>(xPacked, -16.f, 16.f, 11);
-  y = unpack_float<uint16_t>(yPacked, -8.f, 8.f, 10);
-  ori = unpack_float<uint8_t>(oriPacked, -PI, PI, 8);
+  const uint8_t *ptr = packet->data + snapshot_delta_header_size - sizeof(uint16_t);
+  uint16_t part;
+  memcpy(&part, packet->data + sizeof(uint8_t) + 2 * sizeof(uint32_t), sizeof(uint16_t));
+  uint16_t count = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
+  BitReader reader(ptr, packet->dataLength - snapshot_delta_header_size);
+  for (uint16_t i = 0; i < count; ++i)
+  {
+    PositionXQuantized xPacked;
+    PositionYQuantized yPacked;
+    OrientationQuantized oriPacked;
+    uint32_t eid = reader.read(eid_bits);
+    uint8_t mask = reader.read(delta_mask_bits);
+    if (mask & E_DELTA_X)
+      reader.read(xPacked);
+    if (mask & E_DELTA_Y)
+      reader.read(yPacked);
+    if (mask & E_DELTA_ORI)
+      reader.read(oriPacked);
+    if (reader.overflowed())
+      return;
+
+    snapshot.changed.push_back(eid);
+    QuantizedEntity &q = snapshot.get_or_add(eid);
+    if (mask & E_DELTA_X)
+      q.x = xPacked.packedVal;
+    if (mask & E_DELTA_Y)
+      q.y = yPacked.packedVal;
+    if (mask & E_DELTA_ORI)
+      q.ori = oriPacked.packedVal;
+  }
+  // only a fully decoded part counts towards completing the snapshot
+  snapshot.mark_received(part);
 }
 
-void deserialize_and_set_key(ENetPacket *packet)
+void deserialize_snapshot_ack(ENetPacket *packet, uint32_t &seq)
 {
   uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  xorCipherKey = *(uint32_t*)(ptr); ptr += sizeof(uint32_t);
+  seq = *(uint32_t*)(ptr); ptr += sizeof(uint32_t);
+}
+
+bool deserialize_cipher_key(ENetPacket *packet, SessionCipher &session)
+{
+  if (packet->dataLength < sizeof(uint8_t) + chacha_key_size)
+    return false;
+  set_session_key(session, packet->data + sizeof(uint8_t), false);
+  return true;
 }
 
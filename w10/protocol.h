@@ -1,7 +1,10 @@
 #pragma once
 #include <enet/enet.h>
 #include <cstdint>
+#include <vector>
 #include "entity.h"
+#include "snapshot.h"
+#include "sessionCipher.h"
 
 enum MessageType : uint8_t
 {
@@ -10,24 +13,92 @@ enum MessageType : uint8_t
   E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY,
   E_CLIENT_TO_SERVER_INPUT,
   E_SERVER_TO_CLIENT_SNAPSHOT,
+  E_SERVER_TO_CLIENT_SNAPSHOT_BATCH,
+  E_SERVER_TO_CLIENT_SNAPSHOT_DELTA,
+  E_CLIENT_TO_SERVER_SNAPSHOT_ACK,
   E_SERVER_TO_CLIENT_KEY
 };
+constexpr size_t num_message_types = E_SERVER_TO_CLIENT_KEY + 1;
+
+// Where the sends below hand their packets over. By default that is
+// enet_peer_send, counted in bandwidthStats; a server whose host lives on a
+// HostThread queues them for it instead, and counts them there.
+typedef void (*PacketSink)(ENetPeer *peer, uint8_t channel, ENetPacket *packet);
+void set_packet_sink(PacketSink sink);
 
 void send_join(ENetPeer *peer);
 void send_new_entity(ENetPeer *peer, const Entity &ent);
-void send_set_controlled_entity(ENetPeer *peer, uint16_t eid);
-void send_cipher_key(ENetPeer *peer, uint32_t key);
-void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float steer);
-void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori);
+void send_set_controlled_entity(ENetPeer *peer, uint32_t eid);
+// The session key goes out over the reliable channel in the clear, agreeing on
+// one without showing it to the network is not done yet.
+void send_cipher_key(ENetPeer *peer, const uint8_t *key);
+void send_snapshot(ENetPeer *peer, uint32_t eid, float x, float y, float ori);
+
+// an input packet carries this many of the latest samples, oldest first
+constexpr size_t input_window_size = 3;
+
+struct InputSample
+{
+  uint16_t seq = 0;
+  float thr = 0.f;
+  float steer = 0.f;
+};
+
+// Inputs and acks are sealed with the session, nothing is sent before its key arrived.
+void send_entity_input(ENetPeer *peer, SessionCipher &session, uint32_t eid, const InputSample *samples, size_t count);
+
+// keep batches under a typical path MTU so ENet never has to fragment them
+constexpr size_t snapshot_batch_max_size = 1200;
+
+struct EntitySnapshot
+{
+  uint32_t eid = invalid_entity;
+  float x = 0.f;
+  float y = 0.f;
+  float ori = 0.f;
+};
+
+void broadcast_snapshot_batch(ENetHost *host, const std::vector<Entity> &entities);
+// Encoding only allocates packets and may run off the game thread. The parts
+// are encoded once per baseline and never sent themselves, every peer that
+// acked the baseline gets its own sealed copies of them.
+void encode_snapshot_delta(const WorldSnapshot &snapshot, const WorldSnapshot *baseline,
+                           std::vector<ENetPacket*> &packets);
+
+// One peer's sealed copies of the parts encoded against its baseline.
+struct SnapshotDelivery
+{
+  ENetPeer *peer = nullptr;
+  SessionCipher *session = nullptr;
+  const std::vector<ENetPacket*> *parts = nullptr;
+  std::vector<ENetPacket*> sealed;
+};
+// Seals all parts for all the deliveries in one cipher batch, each with its
+// peer's session. Like encoding it may run off the game thread, as long as no
+// peer is in two calls at once.
+void seal_snapshot_deliveries(SnapshotDelivery *deliveries, size_t count);
+void send_snapshot_deliveries(SnapshotDelivery *deliveries, size_t count);
+void send_snapshot_ack(ENetPeer *peer, SessionCipher &session, uint32_t seq);
+
+struct SnapshotDeltaHeader
+{
+  uint32_t seq = invalid_snapshot;
+  uint32_t baselineSeq = invalid_snapshot;
+  uint16_t part = 0;
+  uint16_t numParts = 0;
+};
 
 MessageType get_packet_type(ENetPacket *packet);
 
 void deserialize_new_entity(ENetPacket *packet, Entity &ent);
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer);
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori);
-void deserialize_and_set_key(ENetPacket *packet);
-
-void cipher_data(ENetPacket *packet);
-void decipher_data(ENetPacket *packet, ENetPeer *peer);
+void deserialize_set_controlled_entity(ENetPacket *packet, uint32_t &eid);
+// samples must have room for input_window_size entries, returns how many were read
+size_t deserialize_entity_input(ENetPacket *packet, uint32_t &eid, InputSample *samples);
+void deserialize_snapshot(ENetPacket *packet, uint32_t &eid, float &x, float &y, float &ori);
+void deserialize_snapshot_batch(ENetPacket *packet, std::vector<EntitySnapshot> &snapshots);
+bool deserialize_snapshot_delta_header(ENetPacket *packet, SnapshotDeltaHeader &header);
+void deserialize_snapshot_delta(ENetPacket *packet, WorldSnapshot &snapshot);
+void deserialize_snapshot_ack(ENetPacket *packet, uint32_t &seq);
+// starts the client's end of the session
+bool deserialize_cipher_key(ENetPacket *packet, SessionCipher &session);
 
@@ -19,8 +19,10 @@ float unpack_float(T c, float lo, float hi, int num_bits)
 template<typename T, int num_bits>
 struct PackedFloat
 {
-  T packedVal;
+  static constexpr int bits = num_bits;
+  T packedVal = 0;
 
+  PackedFloat() = default;
   PackedFloat(float v, float lo, float hi) { pack(v, lo, hi); }
   PackedFloat(T compressed_val) : packedVal(compressed_val) {}
 
@@ -29,4 +31,7 @@ struct PackedFloat
 };
 
 typedef PackedFloat<uint8_t, 4> float4bitsQuantized;
+typedef PackedFloat<uint16_t, 11> PositionXQuantized;
+typedef PackedFloat<uint16_t, 10> PositionYQuantized;
+typedef PackedFloat<uint8_t, 8> OrientationQuantized;
 
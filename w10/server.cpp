@@ -1,68 +1,394 @@
 #include <enet/enet.h>
 #include <iostream>
 #include "entity.h"
+#include "entityStore.h"
+#include "threadPool.h"
+#include "tickScheduler.h"
 #include "protocol.h"
+#include "packetPool.h"
 #include "mathUtils.h"
+#include "tickProfiler.h"
+#include "bandwidthStats.h"
+#include "hostThread.h"
 #include <stdlib.h>
 #include <vector>
 #include <map>
 #include <random>
+#include <memory>
+#include <cstring>
 
-static std::vector<Entity> entities;
-static std::map<uint16_t, ENetPeer*> controlledMap;
+// What the game thread knows of a connected peer. The ENetPeer itself belongs
+// to the network thread, here it is only a key and an address to send to.
+struct ConnectedPeer
+{
+  ENetPeer *peer = nullptr;
+  ENetAddress address = {};
+  SessionCipher session;
+  uint32_t ackedSnapshot = invalid_snapshot;
+};
+
+static EntityStore entities;
+static std::map<uint32_t, ENetPeer*> controlledMap;
+static std::map<ENetPeer*, ConnectedPeer> peers;
+static SnapshotHistory snapshotHistory;
+static uint32_t snapshotSeq = invalid_snapshot;
+static std::unique_ptr<ThreadPool> pool;
+
+// big enough to amortize a wake up, small enough to balance across cores
+constexpr size_t simulate_grain = 4096;
+// peers sealed per job: enough parts to fill the cipher's lanes, and 32 peers still make several jobs
+constexpr size_t seal_grain = 8;
+
+// Latest input per entity (same index as in entities), collected while
+// draining the network thread's events and applied in one pass after them.
+struct PendingInput
+{
+  uint16_t seq = 0;
+  bool received = false; // any seq is accepted before the first input
+  bool fresh = false;    // not applied yet
+  float thr = 0.f;
+  float steer = 0.f;
+};
+static std::vector<PendingInput> pendingInputs;
+
+// Sealed inputs and acks wait here from the network thread handing them over
+// until the tick opens all of them in one cipher batch.
+static std::vector<OpenJob> inbox;
+static std::vector<ENetPeer*> inboxPeers;
+
+// Unsequenced inputs this far behind the newest one are reordered leftovers.
+// Anything further back means the client restarted its count (or the seq got
+// corrupted on the way) and is taken as new rather than locking the input out.
+constexpr uint16_t input_reorder_window = 256;
+
+constexpr uint32_t tick_ms = 10;
+// after a stall run at most this many steps at once, the rest is dropped
+constexpr uint32_t max_catch_up_ticks = 5;
+constexpr uint64_t tick_stats_interval = 1000;
+// rewritten with the stage histograms every tick_stats_interval ticks
+constexpr const char *tick_profile_path = "w10_tick_profile.txt";
+constexpr const char *bandwidth_path = "w10_bandwidth.csv";
+
+// The host on its own thread, counting the traffic where it meets ENet.
+class ServerHost : public HostThread
+{
+public:
+  explicit ServerHost(ENetHost *host) : HostThread(host) {}
+  ~ServerHost() override { stop(); }
+
+protected:
+  // Timed here rather than around a blocking enet_host_service: the pass never
+  // waits, the idle wait on the socket comes after it, so this is ENet's work.
+  bool pump() override
+  {
+    bool busy;
+    {
+      PROFILE_SCOPE(E_STAGE_SERVICE);
+      busy = HostThread::pump();
+    }
+    const uint32_t now = enet_time_get();
+    if (now - lastWireSample >= tick_ms)
+    {
+      sample_wire_traffic(host);
+      lastWireSample = now;
+    }
+    return busy;
+  }
+
+  void on_send(ENetPeer *peer, const ENetPacket *packet) override
+  {
+    count_sent(peer, packet);
+  }
 
-void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
+  void on_event(const ENetEvent &event) override
+  {
+    if (event.type == ENET_EVENT_TYPE_RECEIVE)
+      count_received(event.peer, event.packet);
+    else if (event.type == ENET_EVENT_TYPE_DISCONNECT)
+      forget_peer(event.peer);
+  }
+
+private:
+  uint32_t lastWireSample = 0;
+};
+static std::unique_ptr<ServerHost> network;
+
+void on_join(ENetPacket *packet, ConnectedPeer &joined)
 {
+  ENetPeer *peer = joined.peer;
   // send all entities
-  for (const Entity &ent : entities)
-    send_new_entity(peer, ent);
-
-  // find max eid
-  uint16_t maxEid = entities.empty() ? invalid_entity : entities[0].eid;
-  for (const Entity &e : entities)
-    maxEid = std::max(maxEid, e.eid);
-  uint16_t newEid = maxEid + 1;
+  for (size_t i = 0; i < entities.size(); ++i)
+    send_new_entity(peer, entities.get(i));
+
   uint32_t color = 0xff000000 +
                    0x00440000 * (rand() % 5) +
                    0x00004400 * (rand() % 5) +
                    0x00000044 * (rand() % 5);
   float x = (rand() % 4) * 2.f;
   float y = (rand() % 4) * 2.f;
-  Entity ent = {color, x, y, 0.f, (rand() / RAND_MAX) * 3.141592654f, 0.f, 0.f, newEid};
-  entities.push_back(ent);
+  Entity ent = {color, x, y, 0.f, (rand() / RAND_MAX) * 3.141592654f, 0.f, 0.f, invalid_entity};
+  uint32_t newEid = entities.create(ent);
+  if (newEid == invalid_entity)
+  {
+    printf("No free entity slots for %x:%u\n", joined.address.host, joined.address.port);
+    return;
+  }
+  ent.eid = newEid;
+  pendingInputs.resize(entities.size());
+  pendingInputs[entities.find(newEid)] = PendingInput();
 
   controlledMap[newEid] = peer;
 
 
   // send info about new entity to everyone
-  for (size_t i = 0; i < host->peerCount; ++i)
-    send_new_entity(&host->peers[i], ent);
+  for (const auto &[other, connected] : peers)
+    send_new_entity(other, ent);
   // send info about controlled entity
   send_set_controlled_entity(peer, newEid);
-  uint32_t *keyPtr = (uint32_t*)peer->data;
-  std::random_device rd;  //Will be used to obtain a seed for the random number engine
-  std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
-  std::uniform_int_distribution<uint32_t> distrib(0);
-  *keyPtr = distrib(gen);
-  send_cipher_key(peer, *keyPtr);
+  // straight from the OS, a key must not be guessable from the ones before it
+  std::random_device rd;
+  uint8_t key[chacha_key_size];
+  for (size_t i = 0; i < chacha_key_size; i += sizeof(uint32_t))
+  {
+    uint32_t word = rd();
+    memcpy(key + i, &word, sizeof(uint32_t));
+  }
+  set_session_key(joined.session, key, true);
+  send_cipher_key(peer, key);
+}
+
+void on_input(ENetPacket *packet, ENetPeer *peer)
+{
+  uint32_t eid = invalid_entity;
+  InputSample samples[input_window_size];
+  size_t count = deserialize_entity_input(packet, eid, samples);
+  // eid comes from the client: it has to be live and controlled by this peer
+  size_t idx = entities.find(eid);
+  auto controller = controlledMap.find(eid);
+  if (count == 0 || idx == EntityRegistry::npos || controller == controlledMap.end() || controller->second != peer)
+    return;
+
+  // input is a state rather than an event, so only the newest sample of the
+  // window matters here; a lost packet is covered by the next one repeating it
+  const InputSample &newest = samples[count - 1];
+  PendingInput &input = pendingInputs[idx];
+  if (input.received && uint16_t(input.seq - newest.seq) < input_reorder_window)
+    return; // duplicate or older than what we already have
+  input.seq = newest.seq;
+  input.received = true;
+  input.fresh = true;
+  input.thr = newest.thr;
+  input.steer = newest.steer;
+}
+
+void apply_inputs()
+{
+  PROFILE_SCOPE(E_STAGE_APPLY_INPUTS);
+  for (size_t i = 0; i < pendingInputs.size(); ++i)
+  {
+    PendingInput &input = pendingInputs[i];
+    if (!input.fresh)
+      continue;
+    entities.thr[i] = input.thr;
+    entities.steer[i] = input.steer;
+    input.fresh = false;
+  }
+}
+
+void on_snapshot_ack(ENetPacket *packet, ENetPeer *peer)
+{
+  uint32_t seq = invalid_snapshot;
+  deserialize_snapshot_ack(packet, seq);
+  auto connected = peers.find(peer);
+  if (connected == peers.end())
+    return;
+  // unsequenced acks may arrive out of order, and never ack the future
+  uint32_t &acked = connected->second.ackedSnapshot;
+  if (seq <= snapshotSeq && seq > acked)
+    acked = seq;
+}
+
+void open_inbox()
+{
+  PROFILE_SCOPE(E_STAGE_OPEN);
+  open_packets(inbox.data(), inbox.size());
+  for (size_t i = 0; i < inbox.size(); ++i)
+  {
+    ENetPacket *packet = inbox[i].packet;
+    if (inbox[i].opened)
+    {
+      if (get_packet_type(packet) == E_CLIENT_TO_SERVER_INPUT)
+        on_input(packet, inboxPeers[i]);
+      else if (get_packet_type(packet) == E_CLIENT_TO_SERVER_SNAPSHOT_ACK)
+        on_snapshot_ack(packet, inboxPeers[i]);
+    }
+    enet_packet_destroy(packet);
+  }
+  inbox.clear();
+  inboxPeers.clear();
+}
+
+// its session is about to go, and the slot may come back as another peer
+void drop_from_inbox(ENetPeer *peer)
+{
+  size_t kept = 0;
+  for (size_t i = 0; i < inbox.size(); ++i)
+  {
+    if (inboxPeers[i] == peer)
+    {
+      enet_packet_destroy(inbox[i].packet);
+      continue;
+    }
+    inbox[kept] = inbox[i];
+    inboxPeers[kept] = inboxPeers[i];
+    kept++;
+  }
+  inbox.resize(kept);
+  inboxPeers.resize(kept);
 }
 
-void on_input(ENetPacket *packet)
+void send_snapshots()
 {
-  uint16_t eid = invalid_entity;
-  float thr = 0.f; float steer = 0.f;
-  deserialize_entity_input(packet, eid, thr, steer);
-  for (Entity &e : entities)
-    if (e.eid == eid)
+  PROFILE_SCOPE(E_STAGE_SNAPSHOTS);
+  WorldSnapshot &snapshot = snapshotHistory.emplace(++snapshotSeq);
+  quantize_world(entities, snapshot);
+
+  // peers acking the same baseline share one encoding of the delta
+  static std::map<uint32_t, std::vector<ConnectedPeer*>> peersByBaseline;
+  for (auto &[baselineSeq, baselinePeers] : peersByBaseline)
+    baselinePeers.clear();
+  for (auto &[peer, connected] : peers)
+  {
+    // nothing goes out before the peer joined and has a key to open it with
+    if (!connected.session.ready)
+      continue;
+    uint32_t acked = connected.ackedSnapshot;
+    bool inWindow = acked != invalid_snapshot && snapshotSeq - acked < snapshot_history_size;
+    peersByBaseline[inWindow ? acked : invalid_snapshot].push_back(&connected);
+  }
+  struct Encoding
+  {
+    const std::vector<ConnectedPeer*> *peers;
+    const WorldSnapshot *baseline;
+    std::vector<ENetPacket*> packets;
+  };
+  static std::vector<Encoding> encodings;
+  encodings.clear();
+  for (auto it = peersByBaseline.begin(); it != peersByBaseline.end();)
+  {
+    if (it->second.empty())
+    {
+      it = peersByBaseline.erase(it);
+      continue;
+    }
+    encodings.push_back({&it->second, snapshotHistory.find(it->first), {}});
+    ++it;
+  }
+
+  // every baseline is encoded on its own, only the sends need the game thread
+  pool->parallel_for(encodings.size(), 1, [&](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      PROFILE_SCOPE(E_STAGE_ENCODE);
+      encode_snapshot_delta(snapshot, encodings[i].baseline, encodings[i].packets);
+    }
+  });
+
+  // every peer needs its own copy sealed with its own key, which is most of
+  // the work at many peers, so that goes to the pool as well
+  static std::vector<SnapshotDelivery> deliveries;
+  size_t numDeliveries = 0;
+  for (const Encoding &enc : encodings)
+    for (ConnectedPeer *connected : *enc.peers)
     {
-      e.thr = thr;
-      e.steer = steer;
+      if (numDeliveries == deliveries.size())
+        deliveries.emplace_back();
+      deliveries[numDeliveries].peer = connected->peer;
+      deliveries[numDeliveries].session = &connected->session;
+      deliveries[numDeliveries].parts = &enc.packets;
+      numDeliveries++;
     }
+  pool->parallel_for(numDeliveries, seal_grain, [&](size_t begin, size_t end)
+  {
+    PROFILE_SCOPE(E_STAGE_SEAL);
+    seal_snapshot_deliveries(&deliveries[begin], end - begin);
+  });
+  for (const Encoding &enc : encodings)
+    for (ENetPacket *part : enc.packets)
+      enet_packet_destroy(part);
+
+  PROFILE_SCOPE(E_STAGE_SEND);
+  send_snapshot_deliveries(deliveries.data(), numDeliveries);
+}
+
+void simulate(float dt)
+{
+  PROFILE_SCOPE(E_STAGE_SIMULATE);
+  EntitySpan span = entities.span();
+  pool->parallel_for(span.count, simulate_grain, [&](size_t begin, size_t end)
+  {
+    PROFILE_SCOPE(E_STAGE_SIMULATE_SLICE);
+    simulate_entities(span.slice(begin, end), dt);
+  });
+}
+
+// Everything the network thread got since the last tick, in the order it came.
+void handle_events()
+{
+  PROFILE_SCOPE(E_STAGE_EVENTS);
+  HostEvent event;
+  while (network->receive(event))
+  {
+    switch (event.type)
+    {
+    case ENET_EVENT_TYPE_CONNECT:
+    {
+      printf("Connection with %x:%u established\n", event.address.host, event.address.port);
+      ConnectedPeer &connected = peers[event.peer];
+      connected.peer = event.peer;
+      connected.address = event.address;
+      break;
+    }
+    case ENET_EVENT_TYPE_DISCONNECT:
+      printf("Disconnected %x:%u \n", event.address.host, event.address.port);
+      drop_from_inbox(event.peer);
+      peers.erase(event.peer);
+      break;
+    case ENET_EVENT_TYPE_RECEIVE:
+    {
+      auto connected = peers.find(event.peer);
+      if (connected == peers.end())
+      {
+        enet_packet_destroy(event.packet);
+        break;
+      }
+      switch (get_packet_type(event.packet))
+      {
+        case E_CLIENT_TO_SERVER_JOIN:
+          on_join(event.packet, connected->second);
+          break;
+        case E_CLIENT_TO_SERVER_INPUT:
+        case E_CLIENT_TO_SERVER_SNAPSHOT_ACK:
+          // opened along with the rest further down the tick
+          inbox.push_back({&connected->second.session, event.packet});
+          inboxPeers.push_back(event.peer);
+          event.packet = nullptr;
+          break;
+      };
+      if (event.packet)
+        enet_packet_destroy(event.packet);
+      break;
+    }
+    default:
+      break;
+    };
+  }
 }
 
 int main(int argc, const char **argv)
 {
-  if (enet_initialize() != 0)
+  if (packet_pool_initialize() != 0)
   {
     printf("Cannot init ENet");
     return 1;
@@ -72,7 +398,8 @@ int main(int argc, const char **argv)
   address.host = ENET_HOST_ANY;
   address.port = 10131;
 
-  ENetHost *server = enet_host_create(&address, 32, 2, 0, 0);
+  // as many peers as ENet can address, so w10_loadgen can bring thousands of bots
+  ENetHost *server = enet_host_create(&address, ENET_PROTOCOL_MAXIMUM_PEER_ID, 2, 0, 0);
 
   if (!server)
   {
@@ -80,60 +407,46 @@ int main(int argc, const char **argv)
     return 1;
   }
 
-  uint32_t lastTime = enet_time_get();
+  // the main thread is part of the pool, it runs the tick and joins every job
+  unsigned cores = std::thread::hardware_concurrency();
+  pool = std::make_unique<ThreadPool>(cores > 1 ? cores - 1 : 0);
+  printf("Simulating on %zu threads\n", pool->concurrency());
+
+  // ENet gets a thread of its own, every send of the tick is queued for it
+  network = std::make_unique<ServerHost>(server);
+  set_packet_sink([](ENetPeer *peer, uint8_t channel, ENetPacket *packet) { network->send(peer, channel, packet); });
+  network->start();
+
+  TickScheduler scheduler(tick_ms, max_catch_up_ticks);
   while (true)
   {
-    uint32_t curTime = enet_time_get();
-    float dt = (curTime - lastTime) * 0.001f;
-    lastTime = curTime;
-    ENetEvent event;
-    while (enet_host_service(server, &event, 0) > 0)
+    scheduler.wait();
+    uint32_t steps = scheduler.advance();
+    if (steps == 0)
+      continue;
     {
-      switch (event.type)
-      {
-      case ENET_EVENT_TYPE_CONNECT:
-        printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
-        event.peer->data = new uint32_t;
-        *(uint32_t*)event.peer->data = 0;
-        break;
-      case ENET_EVENT_TYPE_DISCONNECT:
-        printf("Disconnected %x:%u \n", event.peer->address.host, event.peer->address.port);
-        delete event.peer->data;
-        break;
-      case ENET_EVENT_TYPE_RECEIVE:
-        switch (get_packet_type(event.packet))
-        {
-          case E_CLIENT_TO_SERVER_JOIN:
-            on_join(event.packet, event.peer, server);
-            break;
-          case E_CLIENT_TO_SERVER_INPUT:
-            decipher_data(event.packet, event.peer);
-            on_input(event.packet);
-            break;
-        };
-        enet_packet_destroy(event.packet);
-        break;
-      default:
-        break;
-      };
+      PROFILE_SCOPE(E_STAGE_TICK);
+      handle_events();
+      open_inbox();
+      apply_inputs();
+      for (uint32_t i = 0; i < steps; ++i)
+        simulate(scheduler.dt());
+      send_snapshots();
     }
-    static int t = 0;
-    for (Entity &e : entities)
+    profiler_end_tick();
+    if (scheduler.stats().ticks >= tick_stats_interval)
     {
-      // simulate
-      simulate_entity(e, dt);
-      // send
-      for (size_t i = 0; i < server->peerCount; ++i)
-      {
-        ENetPeer *peer = &server->peers[i];
-        // skip this here in this implementation
-        //if (controlledMap[e.eid] != peer)
-        send_snapshot(peer, e.eid, e.x, e.y, e.ori);
-      }
+      print_packet_pool_stats(scheduler.stats().ticks);
+      print_bandwidth_report(scheduler.stats().ticks * tick_ms * 0.001);
+      dump_bandwidth(bandwidth_path);
+      profiler_dump(tick_profile_path);
+      if (network->dropped_receives())
+        printf("Network thread dropped %llu packets so far\n", (unsigned long long)network->dropped_receives());
+      print_tick_stats(scheduler);
     }
-    usleep(10000);
   }
 
+  network->stop();
   enet_host_destroy(server);
 
   atexit(enet_deinitialize);
@@ -0,0 +1,145 @@
+#include "sessionCipher.h"
+#include <cstring> // memcpy
+#include <vector>
+
+// goes into the nonce, so the two ends never encrypt under the same one
+constexpr uint32_t client_side = 1;
+constexpr uint32_t server_side = 2;
+// unsequenced packets this far behind the newest one are still taken
+constexpr uint32_t replay_window = 64;
+
+static void make_nonce(uint8_t *nonce, bool fromServer, uint32_t seq)
+{
+  const uint32_t side = fromServer ? server_side : client_side;
+  memset(nonce, 0, chacha_nonce_size);
+  memcpy(nonce, &side, sizeof(uint32_t));
+  memcpy(nonce + chacha_nonce_size - sizeof(uint32_t), &seq, sizeof(uint32_t));
+}
+
+static uint32_t packet_seq(const ENetPacket *packet)
+{
+  uint32_t seq;
+  memcpy(&seq, packet->data + sizeof(uint8_t), sizeof(uint32_t));
+  return seq;
+}
+
+static size_t sealed_length(const ENetPacket *packet)
+{
+  return packet->dataLength - sealed_header_size - poly1305_tag_size;
+}
+
+void set_session_key(SessionCipher &session, const uint8_t *key, bool isServer)
+{
+  session = SessionCipher();
+  memcpy(session.key, key, chacha_key_size);
+  session.ready = true;
+  session.isServer = isServer;
+}
+
+ENetPacket *create_sealed_packet(uint8_t type, size_t payloadSize)
+{
+  ENetPacket *packet = enet_packet_create(nullptr, sealed_header_size + payloadSize + poly1305_tag_size,
+                                          ENET_PACKET_FLAG_UNSEQUENCED);
+  *packet->data = type;
+  return packet;
+}
+
+static void set_message(AeadMessage &m, const SessionCipher &session, bool fromServer, ENetPacket *packet)
+{
+  m = AeadMessage();
+  m.key = session.key;
+  make_nonce(m.nonce, fromServer, packet_seq(packet));
+  m.aad = packet->data;
+  m.aadLength = sealed_header_size;
+  m.data = sealed_payload(packet);
+  m.length = sealed_length(packet);
+  m.tag = packet->data + packet->dataLength - poly1305_tag_size;
+}
+
+void seal_packets(SealJob *jobs, size_t count)
+{
+  thread_local std::vector<AeadMessage> messages;
+  messages.resize(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    SessionCipher &session = *jobs[i].session;
+    const uint32_t seq = session.sendSeq++;
+    memcpy(jobs[i].packet->data + sizeof(uint8_t), &seq, sizeof(uint32_t));
+    set_message(messages[i], session, session.isServer, jobs[i].packet);
+  }
+  aead_seal(messages.data(), count);
+}
+
+static bool seen_before(const SessionCipher &session, uint32_t seq)
+{
+  if (!session.received || int32_t(seq - session.receivedSeq) > 0)
+    return false;
+  const uint32_t behind = session.receivedSeq - seq;
+  return behind == 0 || behind > replay_window || (session.receivedWindow >> (behind - 1)) & 1;
+}
+
+static void mark_received(SessionCipher &session, uint32_t seq)
+{
+  if (!session.received)
+  {
+    session.received = true;
+    session.receivedSeq = seq;
+    return;
+  }
+  const int32_t ahead = int32_t(seq - session.receivedSeq);
+  if (ahead > 0)
+  {
+    const uint64_t shifted = ahead >= 64 ? 0 : session.receivedWindow << ahead;
+    const uint64_t previous = ahead > 64 ? 0 : 1ull << (ahead - 1);
+    session.receivedWindow = shifted | previous;
+    session.receivedSeq = seq;
+  }
+  else
+  {
+    session.receivedWindow |= 1ull << (-ahead - 1);
+  }
+}
+
+void open_packets(OpenJob *jobs, size_t count)
+{
+  thread_local std::vector<AeadMessage> messages;
+  thread_local std::vector<OpenJob*> opening;
+  messages.clear();
+  opening.clear();
+  for (size_t i = 0; i < count; ++i)
+  {
+    OpenJob &job = jobs[i];
+    job.opened = false;
+    // replays are turned away before spending any time on them
+    if (!job.session->ready || job.packet->dataLength < sealed_header_size + poly1305_tag_size ||
+        seen_before(*job.session, packet_seq(job.packet)))
+      continue;
+    messages.emplace_back();
+    set_message(messages.back(), *job.session, !job.session->isServer, job.packet);
+    opening.push_back(&job);
+  }
+  aead_open(messages.data(), messages.size());
+
+  for (size_t i = 0; i < messages.size(); ++i)
+  {
+    OpenJob &job = *opening[i];
+    const uint32_t seq = packet_seq(job.packet);
+    // checked again, the same packet may have come twice in this batch
+    if (!messages[i].authentic || seen_before(*job.session, seq))
+      continue;
+    mark_received(*job.session, seq);
+    const size_t length = sealed_length(job.packet);
+    memmove(job.packet->data + sizeof(uint8_t), sealed_payload(job.packet), length);
+    job.packet->dataLength = sizeof(uint8_t) + length;
+    job.opened = true;
+  }
+}
+
+bool open_packet(SessionCipher &session, ENetPacket *packet)
+{
+  OpenJob job;
+  job.session = &session;
+  job.packet = packet;
+  open_packets(&job, 1);
+  return job.opened;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <enet/enet.h>
+#include <cstdint>
+#include <cstddef>
+#include "chachaPoly.h"
+
+// A sealed packet is [type][seq:u32][payload][tag]: type and seq go in the
+// clear and are authenticated along with the encrypted payload. The nonce is
+// the sender's side and its seq, so both directions can share the one key
+// without ever repeating a nonce.
+constexpr size_t sealed_header_size = sizeof(uint8_t) + sizeof(uint32_t);
+constexpr size_t sealed_overhead = sizeof(uint32_t) + poly1305_tag_size;
+
+// One peer's ChaCha20-Poly1305 session, from either end of the connection.
+struct SessionCipher
+{
+  uint8_t key[chacha_key_size] = {};
+  bool ready = false;
+  bool isServer = false;
+  uint32_t sendSeq = 0;
+  // replay window: the highest seq opened so far, bit n set when highest - 1 - n was
+  bool received = false;
+  uint32_t receivedSeq = 0;
+  uint64_t receivedWindow = 0;
+};
+
+void set_session_key(SessionCipher &session, const uint8_t *key, bool isServer);
+
+// An unsequenced packet with room for the header and the tag around
+// payloadSize bytes, which are written at sealed_payload(packet).
+ENetPacket *create_sealed_packet(uint8_t type, size_t payloadSize);
+inline uint8_t *sealed_payload(ENetPacket *packet) { return packet->data + sealed_header_size; }
+
+struct SealJob
+{
+  SessionCipher *session = nullptr;
+  ENetPacket *packet = nullptr;
+};
+
+// Numbers and encrypts every packet in one batch of the vector cipher. A session
+// may be in several jobs, but only in one call at a time.
+void seal_packets(SealJob *jobs, size_t count);
+
+struct OpenJob
+{
+  SessionCipher *session = nullptr;
+  ENetPacket *packet = nullptr;
+  bool opened = false;
+};
+
+// Authenticates and decrypts a batch; opened packets are cut down to
+// [type][payload] for the usual deserialize_ functions. Forged, damaged and
+// replayed packets stay closed and should be thrown away.
+void open_packets(OpenJob *jobs, size_t count);
+bool open_packet(SessionCipher &session, ENetPacket *packet);
@@ -0,0 +1,176 @@
+#pragma once
+// The vectorized simulation kernel, shared by entity.cpp (SSE2) and
+// entity_avx2.cpp, which is the only file built with AVX2 enabled. Everything
+// here has internal linkage, so the AVX2 file's copies can never stand in for
+// the ones the rest of the program calls.
+#include "entity.h"
+#include "mathUtils.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// sincos for |v| <= 2*PI: Cody-Waite reduction by PI/2 and the cephes
+// minimax polynomials on [-PI/4, PI/4]. Unlike cosf/sinf it is easy to
+// reproduce exactly in SIMD lanes.
+constexpr float two_over_pi = 0.636619772f;
+constexpr float pi_2_hi = 1.5703125f;
+constexpr float pi_2_mid = 4.837512969970703125e-4f;
+constexpr float pi_2_lo = 7.549789954891882e-8f;
+constexpr float sin_c0 = -1.6666654611e-1f;
+constexpr float sin_c1 = 8.3321608736e-3f;
+constexpr float sin_c2 = -1.9515295891e-4f;
+constexpr float cos_c0 = 4.166664568298827e-2f;
+constexpr float cos_c1 = -1.388731625493765e-3f;
+constexpr float cos_c2 = 2.443315711809948e-5f;
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+// Thin wrappers so one kernel template serves both vector widths.
+struct SseOps
+{
+  static constexpr size_t width = 4;
+  typedef __m128 F;
+  typedef __m128i I;
+  static F load(const float *p) { return _mm_loadu_ps(p); }
+  static void store(float *p, F v) { _mm_storeu_ps(p, v); }
+  static F set(float v) { return _mm_set1_ps(v); }
+  static F add(F a, F b) { return _mm_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+  static F min(F a, F b) { return _mm_min_ps(a, b); }
+  static F max(F a, F b) { return _mm_max_ps(a, b); }
+  static F gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+  static F lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+  static F neq(F a, F b) { return _mm_cmpneq_ps(a, b); }
+  static F and_(F a, F b) { return _mm_and_ps(a, b); }
+  static F xor_(F a, F b) { return _mm_xor_ps(a, b); }
+  static F abs(F a, F signBit) { return _mm_andnot_ps(signBit, a); }
+  static F select(F mask, F a, F b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+  static I round_to_int(F v) { return _mm_cvtps_epi32(v); }
+  static F to_float(I v) { return _mm_cvtepi32_ps(v); }
+  static F bit_set(I v, int bit) // all ones where the bit is set
+  {
+    I b = _mm_set1_epi32(bit);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(v, b), b));
+  }
+  static I add_int(I a, int b) { return _mm_add_epi32(a, _mm_set1_epi32(b)); }
+};
+
+#if defined(__AVX2__)
+struct AvxOps
+{
+  static constexpr size_t width = 8;
+  typedef __m256 F;
+  typedef __m256i I;
+  static F load(const float *p) { return _mm256_loadu_ps(p); }
+  static void store(float *p, F v) { _mm256_storeu_ps(p, v); }
+  static F set(float v) { return _mm256_set1_ps(v); }
+  static F add(F a, F b) { return _mm256_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+  static F min(F a, F b) { return _mm256_min_ps(a, b); }
+  static F max(F a, F b) { return _mm256_max_ps(a, b); }
+  static F gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static F lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static F neq(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+  static F and_(F a, F b) { return _mm256_and_ps(a, b); }
+  static F xor_(F a, F b) { return _mm256_xor_ps(a, b); }
+  static F abs(F a, F signBit) { return _mm256_andnot_ps(signBit, a); }
+  static F select(F mask, F a, F b) { return _mm256_blendv_ps(b, a, mask); }
+  static I round_to_int(F v) { return _mm256_cvtps_epi32(v); }
+  static F to_float(I v) { return _mm256_cvtepi32_ps(v); }
+  static F bit_set(I v, int bit)
+  {
+    I b = _mm256_set1_epi32(bit);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(v, b), b));
+  }
+  static I add_int(I a, int b) { return _mm256_add_epi32(a, _mm256_set1_epi32(b)); }
+};
+#endif
+
+// Lane-wise copy of simulate_scalar. Comparisons become masks and the
+// ternaries become selects; the arithmetic order is kept exactly.
+template<typename V>
+void simulate_block(EntitySpan e, size_t i, float dt)
+{
+  typedef typename V::F F;
+  const F zero = V::set(0.f);
+  const F one = V::set(1.f);
+  const F minusOne = V::set(-1.f);
+  const F vdt = V::set(dt);
+  const F signBit = V::set(-0.f);
+
+  F x = V::load(e.x + i);
+  F y = V::load(e.y + i);
+  F speed = V::load(e.speed + i);
+  F ori = V::load(e.ori + i);
+  F thr = V::load(e.thr + i);
+  F steer = V::load(e.steer + i);
+
+  // sign()
+  F thrSign = V::select(V::gt(thr, zero), one, V::select(V::lt(thr, zero), minusOne, zero));
+  F speedSign = V::select(V::gt(speed, zero), one, V::select(V::lt(speed, zero), minusOne, zero));
+  F isBraking = V::and_(V::neq(thrSign, zero), V::neq(thrSign, speedSign));
+  F accel = V::select(isBraking, V::set(12.f), V::set(3.f));
+
+  // move_to(speed, clamp(thr, -0.3, 1) * 10, dt, accel)
+  F target = V::mul(V::min(V::max(thr, V::set(-0.3f)), one), V::set(10.f));
+  F d = V::mul(accel, vdt);
+  F diff = V::sub(speed, target);
+  F absDiff = V::abs(diff, signBit);
+  F moved = V::select(V::lt(target, speed), V::sub(speed, d), V::add(speed, d));
+  speed = V::select(V::lt(absDiff, d), target, moved);
+
+  F clampedSpeed = V::min(V::max(speed, V::set(-2.f)), V::set(2.f));
+  ori = V::add(ori, V::mul(V::mul(V::mul(steer, vdt), clampedSpeed), V::set(0.3f)));
+  F wrap = V::select(V::gt(ori, V::set(PI)), V::set(-2.f * PI),
+                     V::select(V::lt(ori, V::set(-PI)), V::set(2.f * PI), zero));
+  ori = V::add(ori, wrap);
+
+  // sincos
+  auto q = V::round_to_int(V::mul(ori, V::set(two_over_pi)));
+  F fq = V::to_float(q);
+  F r = V::sub(ori, V::mul(fq, V::set(pi_2_hi)));
+  r = V::sub(r, V::mul(fq, V::set(pi_2_mid)));
+  r = V::sub(r, V::mul(fq, V::set(pi_2_lo)));
+  F r2 = V::mul(r, r);
+  F ps = V::add(r, V::mul(V::mul(r, r2),
+                          V::add(V::set(sin_c0), V::mul(r2, V::add(V::set(sin_c1), V::mul(r2, V::set(sin_c2)))))));
+  F pc = V::add(V::sub(one, V::mul(V::set(0.5f), r2)),
+                V::mul(V::mul(r2, r2),
+                       V::add(V::set(cos_c0), V::mul(r2, V::add(V::set(cos_c1), V::mul(r2, V::set(cos_c2)))))));
+  F swap = V::bit_set(q, 1);
+  F s = V::select(swap, pc, ps);
+  F c = V::select(swap, ps, pc);
+  s = V::xor_(s, V::and_(V::bit_set(q, 2), signBit));
+  c = V::xor_(c, V::and_(V::bit_set(V::add_int(q, 1), 2), signBit));
+
+  x = V::add(x, V::mul(V::mul(c, speed), vdt));
+  y = V::add(y, V::mul(V::mul(s, speed), vdt));
+
+  V::store(e.x + i, x);
+  V::store(e.y + i, y);
+  V::store(e.speed + i, speed);
+  V::store(e.ori + i, ori);
+}
+
+// whole blocks only, returns how many entities were done
+template<typename V>
+size_t simulate_blocks(EntitySpan entities, float dt)
+{
+  size_t i = 0;
+  for (; i + V::width <= entities.count; i += V::width)
+    simulate_block<V>(entities, i, dt);
+  return i;
+}
+
+#endif
+
+}
+
+// In entity_avx2.cpp, only to be called once cpu_has_avx2() said so.
+size_t simulate_blocks_avx2(EntitySpan entities, float dt);
@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "entity.h"
+#include "entityStore.h"
+#include "threadPool.h"
+
+// Times the scalar, the vectorized and the vectorized + thread pool simulation
+// over the same fleet and checks that all of them end up with bit-identical state.
+
+static EntityStore make_fleet(size_t count)
+{
+  EntityStore store;
+  for (size_t i = 0; i < count; ++i)
+  {
+    Entity ent;
+    ent.x = (rand() % 2000) * 0.1f - 100.f;
+    ent.y = (rand() % 2000) * 0.1f - 100.f;
+    ent.ori = (rand() % 6283) * 0.001f - 3.1415f;
+    store.create(ent);
+  }
+  return store;
+}
+
+static void randomize_inputs(EntityStore &store)
+{
+  for (size_t i = 0; i < store.size(); ++i)
+  {
+    // same quantization as the wire input: 4 bits, with an exact zero
+    store.thr[i] = (rand() % 15 - 7) / 7.f;
+    store.steer[i] = (rand() % 15 - 7) / 7.f;
+  }
+}
+
+static bool same_bits(const std::vector<float> &a, const std::vector<float> &b)
+{
+  return memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+static bool same_state(const EntityStore &a, const EntityStore &b)
+{
+  return same_bits(a.x, b.x) && same_bits(a.y, b.y) && same_bits(a.speed, b.speed) && same_bits(a.ori, b.ori);
+}
+
+int main(int argc, const char **argv)
+{
+  const size_t count = argc > 1 ? size_t(atoi(argv[1])) : 100000;
+  const int ticks = argc > 2 ? atoi(argv[2]) : 600;
+  const float dt = 0.01f;
+
+  srand(1);
+  EntityStore scalar = make_fleet(count);
+  EntityStore simd = scalar;
+  EntityStore threaded = scalar;
+  unsigned cores = std::thread::hardware_concurrency();
+  ThreadPool pool(cores > 1 ? cores - 1 : 0);
+
+  double scalarMs = 0.0;
+  double simdMs = 0.0;
+  double threadedMs = 0.0;
+  for (int t = 0; t < ticks; ++t)
+  {
+    if (t % 60 == 0)
+    {
+      randomize_inputs(scalar);
+      simd.thr = scalar.thr;
+      simd.steer = scalar.steer;
+      threaded.thr = scalar.thr;
+      threaded.steer = scalar.steer;
+    }
+    auto start = std::chrono::steady_clock::now();
+    simulate_entities_scalar(scalar.span(), dt);
+    auto mid = std::chrono::steady_clock::now();
+    simulate_entities(simd.span(), dt);
+    auto simdEnd = std::chrono::steady_clock::now();
+    EntitySpan span = threaded.span();
+    pool.parallel_for(span.count, 4096, [&](size_t begin, size_t end)
+    {
+      simulate_entities(span.slice(begin, end), dt);
+    });
+    auto end = std::chrono::steady_clock::now();
+    scalarMs += std::chrono::duration<double, std::milli>(mid - start).count();
+    simdMs += std::chrono::duration<double, std::milli>(simdEnd - mid).count();
+    threadedMs += std::chrono::duration<double, std::milli>(end - simdEnd).count();
+  }
+
+  bool identical = same_state(scalar, simd) && same_state(scalar, threaded);
+  printf("%zu entities, %d ticks: scalar %.3f ms/tick | %s %.3f ms/tick (x%.2f) | %s on %zu threads %.3f ms/tick (x%.2f) | %s\n",
+         count, ticks, scalarMs / ticks, simulate_entities_path(), simdMs / ticks, scalarMs / simdMs, simulate_entities_path(),
+         pool.concurrency(), threadedMs / ticks, scalarMs / threadedMs,
+         identical ? "identical" : "MISMATCH");
+  return identical ? 0 : 1;
+}
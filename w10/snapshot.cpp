@@ -0,0 +1,99 @@
+#include "snapshot.h"
+#include "quantisation.h"
+#include <algorithm>
+
+QuantizedEntity quantize_entity(uint32_t eid, float x, float y, float ori)
+{
+  QuantizedEntity q;
+  q.eid = eid;
+  q.x = PositionXQuantized(x, -16.f, 16.f).packedVal;
+  q.y = PositionYQuantized(y, -8.f, 8.f).packedVal;
+  q.ori = OrientationQuantized(ori, -PI, PI).packedVal;
+  return q;
+}
+
+void dequantize_entity(const QuantizedEntity &q, float &x, float &y, float &ori)
+{
+  x = PositionXQuantized(q.x).unpack(-16.f, 16.f);
+  y = PositionYQuantized(q.y).unpack(-8.f, 8.f);
+  ori = OrientationQuantized(q.ori).unpack(-PI, PI);
+}
+
+uint8_t delta_mask(const QuantizedEntity &q, const QuantizedEntity *baseline)
+{
+  if (!baseline)
+    return E_DELTA_ALL;
+  return (q.x != baseline->x ? E_DELTA_X : 0) |
+         (q.y != baseline->y ? E_DELTA_Y : 0) |
+         (q.ori != baseline->ori ? E_DELTA_ORI : 0);
+}
+
+static bool eid_less(const QuantizedEntity &q, uint32_t eid)
+{
+  return q.eid < eid;
+}
+
+const QuantizedEntity *WorldSnapshot::find(uint32_t eid) const
+{
+  auto it = std::lower_bound(entities.begin(), entities.end(), eid, eid_less);
+  return it != entities.end() && it->eid == eid ? &*it : nullptr;
+}
+
+QuantizedEntity &WorldSnapshot::get_or_add(uint32_t eid)
+{
+  auto it = std::lower_bound(entities.begin(), entities.end(), eid, eid_less);
+  if (it == entities.end() || it->eid != eid)
+  {
+    it = entities.insert(it, QuantizedEntity());
+    it->eid = eid;
+  }
+  return *it;
+}
+
+void WorldSnapshot::expect_parts(uint16_t count)
+{
+  numParts = count;
+  numReceived = 0;
+  receivedParts.assign((count + 63) / 64, 0);
+}
+
+void WorldSnapshot::mark_received(uint16_t part)
+{
+  if (part >= numParts)
+    return;
+  uint64_t &word = receivedParts[part / 64];
+  const uint64_t bit = 1ull << (part % 64);
+  if (word & bit)
+    return;
+  word |= bit;
+  numReceived++;
+}
+
+void quantize_world(const EntityStore &entities, WorldSnapshot &snapshot)
+{
+  snapshot.entities.resize(entities.size());
+  for (size_t i = 0; i < entities.size(); ++i)
+    snapshot.entities[i] = quantize_entity(entities.eid[i], entities.x[i], entities.y[i], entities.ori[i]);
+  std::sort(snapshot.entities.begin(), snapshot.entities.end(),
+            [](const QuantizedEntity &a, const QuantizedEntity &b) { return a.eid < b.eid; });
+}
+
+WorldSnapshot &SnapshotHistory::emplace(uint32_t seq)
+{
+  WorldSnapshot &snapshot = slots[seq % snapshot_history_size];
+  snapshot.seq = seq;
+  snapshot.entities.clear();
+  snapshot.receivedParts.clear();
+  snapshot.numParts = 0;
+  snapshot.numReceived = 0;
+  snapshot.changed.clear();
+  return snapshot;
+}
+
+WorldSnapshot *SnapshotHistory::find(uint32_t seq)
+{
+  if (seq == invalid_snapshot)
+    return nullptr;
+  WorldSnapshot &snapshot = slots[seq % snapshot_history_size];
+  return snapshot.seq == seq ? &snapshot : nullptr;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "entity.h"
+#include "entityStore.h"
+
+// Entity state exactly as it goes over the wire, so that server and client
+// compare and reconstruct deltas on identical values.
+struct QuantizedEntity
+{
+  uint32_t eid = invalid_entity;
+  uint16_t x = 0;
+  uint16_t y = 0;
+  uint8_t ori = 0;
+};
+
+enum DeltaField : uint8_t
+{
+  E_DELTA_X = 1 << 0,
+  E_DELTA_Y = 1 << 1,
+  E_DELTA_ORI = 1 << 2,
+  E_DELTA_ALL = E_DELTA_X | E_DELTA_Y | E_DELTA_ORI
+};
+
+QuantizedEntity quantize_entity(uint32_t eid, float x, float y, float ori);
+void dequantize_entity(const QuantizedEntity &q, float &x, float &y, float &ori);
+uint8_t delta_mask(const QuantizedEntity &q, const QuantizedEntity *baseline);
+
+constexpr uint32_t invalid_snapshot = 0;
+// parts are numbered with a u16, a single snapshot can't span more packets than this
+constexpr uint16_t max_snapshot_parts = UINT16_MAX;
+
+struct WorldSnapshot
+{
+  uint32_t seq = invalid_snapshot;
+  std::vector<QuantizedEntity> entities; // sorted by eid
+
+  // client side reassembly of a snapshot split over several packets,
+  // one bit per part so the part count grows with the world
+  std::vector<uint64_t> receivedParts;
+  uint16_t numParts = 0;
+  uint16_t numReceived = 0;
+  std::vector<uint32_t> changed; // eids carried by the received parts
+
+  const QuantizedEntity *find(uint32_t eid) const;
+  QuantizedEntity &get_or_add(uint32_t eid);
+  void expect_parts(uint16_t count);
+  // parts out of range or seen before are ignored
+  void mark_received(uint16_t part);
+  bool complete() const { return numParts > 0 && numReceived == numParts; }
+};
+
+void quantize_world(const EntityStore &entities, WorldSnapshot &snapshot);
+
+// Keeps the last snapshot_history_size snapshots addressed by sequence number.
+// A baseline is only usable while it is still inside this window.
+constexpr size_t snapshot_history_size = 64;
+
+class SnapshotHistory
+{
+  WorldSnapshot slots[snapshot_history_size];
+public:
+  WorldSnapshot &emplace(uint32_t seq);
+  WorldSnapshot *find(uint32_t seq);
+};
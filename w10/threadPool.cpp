@@ -0,0 +1,86 @@
+#include "threadPool.h"
+
+ThreadPool::ThreadPool(size_t numWorkers)
+{
+  workers.reserve(numWorkers);
+  for (size_t i = 0; i < numWorkers; ++i)
+    workers.emplace_back([this]() { worker_loop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread &worker : workers)
+    worker.join();
+}
+
+void ThreadPool::run_chunks()
+{
+  const size_t numChunks = (count + grain - 1) / grain;
+  for (size_t chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++)
+  {
+    size_t begin = chunk * grain;
+    size_t end = begin + grain < count ? begin + grain : count;
+    (*job)(begin, end);
+  }
+}
+
+void ThreadPool::worker_loop()
+{
+  uint64_t seenGeneration = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+      if (stopping)
+        return;
+      seenGeneration = generation;
+      // woke up after the caller already finished the job on its own
+      if (!job)
+        continue;
+      ++busyWorkers;
+    }
+    run_chunks();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      --busyWorkers;
+    }
+    done.notify_one();
+  }
+}
+
+void ThreadPool::parallel_for(size_t count, size_t grain, const Job &job)
+{
+  if (count == 0)
+    return;
+  if (grain == 0)
+    grain = 1;
+  // not worth waking anyone for a single chunk
+  if (workers.empty() || count <= grain)
+  {
+    job(0, count);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->job = &job;
+    this->count = count;
+    this->grain = grain;
+    nextChunk = 0;
+    ++generation;
+  }
+  wake.notify_all();
+  run_chunks();
+
+  // job is cleared under the lock, so a worker that wakes up late can't pick
+  // up this job after it returned
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&]() { return busyWorkers == 0; });
+  this->job = nullptr;
+}
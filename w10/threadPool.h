@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for the data parallel stages of the server tick.
+// The calling thread works on the job too and returns once every chunk is
+// done, so ENet is still only ever touched from the thread that owns the host.
+class ThreadPool
+{
+public:
+  // chunk [begin, end) of the range handed to parallel_for
+  typedef std::function<void(size_t begin, size_t end)> Job;
+
+  explicit ThreadPool(size_t numWorkers);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // number of threads a job runs on, the caller included
+  size_t concurrency() const { return workers.size() + 1; }
+
+  // Splits [0, count) into chunks of grain items. Idle threads keep grabbing
+  // the next chunk, so an uneven chunk doesn't leave the other cores waiting.
+  void parallel_for(size_t count, size_t grain, const Job &job);
+
+private:
+  void worker_loop();
+  void run_chunks();
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  bool stopping = false;
+  uint64_t generation = 0;
+  size_t busyWorkers = 0;
+
+  // current job, written under the mutex before the generation is bumped
+  const Job *job = nullptr;
+  size_t count = 0;
+  size_t grain = 1;
+  std::atomic<size_t> nextChunk = 0;
+};
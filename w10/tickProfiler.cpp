@@ -0,0 +1,248 @@
+#include "tickProfiler.h"
+
+#if TICK_PROFILER
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static const char *stage_names[num_profile_stages] = {
+  "events", "open", "apply_inputs", "simulate", "simulate_slice", "snapshots", "encode", "seal", "send", "service",
+  "tick"
+};
+
+static uint64_t steady_ns()
+{
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Scopes read the TSC where there is one, at about half the cost of
+// steady_clock. Durations stay in those ticks until a dump converts them with
+// the rate measured against steady_clock since startup.
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+static uint64_t now_ticks() { return __rdtsc(); }
+#else
+static uint64_t now_ticks() { return steady_ns(); }
+#endif
+
+static const uint64_t startTicks = now_ticks();
+static const uint64_t startNs = steady_ns();
+
+static double ns_per_tick()
+{
+  const uint64_t ticks = now_ticks() - startTicks;
+  return ticks ? double(steady_ns() - startNs) / ticks : 1.0;
+}
+
+struct ProfileRecord
+{
+  uint32_t duration; // in now_ticks() units
+  ProfileStage stage;
+};
+
+// Single producer (the owning thread), single consumer (the game thread).
+// A full ring drops the record rather than making the producer wait.
+class ProfileRing
+{
+public:
+  bool push(const ProfileRecord &record)
+  {
+    const uint32_t head = writeIdx.load(std::memory_order_relaxed);
+    if (head - readIdx.load(std::memory_order_acquire) == capacity)
+      return false;
+    records[head & (capacity - 1)] = record;
+    writeIdx.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  template <typename Callable>
+  void drain(Callable c)
+  {
+    const uint32_t head = writeIdx.load(std::memory_order_acquire);
+    uint32_t tail = readIdx.load(std::memory_order_relaxed);
+    for (; tail != head; ++tail)
+      c(records[tail & (capacity - 1)]);
+    readIdx.store(tail, std::memory_order_release);
+  }
+
+  std::atomic<uint64_t> dropped = 0;
+
+private:
+  // a tick of a few thousand events fits without drops
+  static constexpr uint32_t capacity = 1 << 14;
+  ProfileRecord records[capacity];
+  alignas(64) std::atomic<uint32_t> writeIdx = 0;
+  alignas(64) std::atomic<uint32_t> readIdx = 0;
+};
+
+// Log linear buckets as in HdrHistogram: 32 per power of two, so every value
+// is kept to within about 3% from single ticks up to hours.
+class LatencyHistogram
+{
+public:
+  void add(uint64_t value)
+  {
+    buckets[bucket_index(value)]++;
+    total++;
+    sum += value;
+    if (value > maxValue)
+      maxValue = value;
+  }
+
+  // highest value of the bucket holding the p-th fraction of samples
+  uint64_t percentile(double p) const
+  {
+    const uint64_t rank = uint64_t(p * total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < num_buckets; ++i)
+    {
+      seen += buckets[i];
+      if (seen > rank)
+        return std::min(bucket_value(i), maxValue);
+    }
+    return maxValue;
+  }
+
+  uint64_t count() const { return total; }
+  double mean() const { return total ? double(sum) / total : 0.0; }
+  uint64_t max() const { return maxValue; }
+
+  template <typename Callable>
+  void for_each_bucket(Callable c) const
+  {
+    for (size_t i = 0; i < num_buckets; ++i)
+      if (buckets[i])
+        c(bucket_value(i), buckets[i]);
+  }
+
+private:
+  static constexpr uint64_t sub_buckets = 64;
+  static constexpr uint64_t half_sub_buckets = sub_buckets / 2;
+  static constexpr size_t max_shift = 42;
+  static constexpr size_t num_buckets = sub_buckets + max_shift * half_sub_buckets;
+
+  static size_t bucket_index(uint64_t v)
+  {
+    if (v < sub_buckets)
+      return size_t(v);
+    // shifted down until it lies in [half_sub_buckets, sub_buckets)
+    const size_t shift = size_t(63 - std::countl_zero(v)) - 5;
+    if (shift > max_shift)
+      return num_buckets - 1;
+    return size_t(sub_buckets + (shift - 1) * half_sub_buckets + ((v >> shift) - half_sub_buckets));
+  }
+
+  static uint64_t bucket_value(size_t index)
+  {
+    if (index < sub_buckets)
+      return index;
+    const size_t shift = (index - sub_buckets) / half_sub_buckets + 1;
+    const uint64_t sub = (index - sub_buckets) % half_sub_buckets + half_sub_buckets;
+    return ((sub + 1) << shift) - 1;
+  }
+
+  uint64_t buckets[num_buckets] = {};
+  uint64_t total = 0;
+  uint64_t sum = 0;
+  uint64_t maxValue = 0;
+};
+
+// rings live as long as the process, pool threads never exit before it does
+static std::mutex ringsMutex;
+static std::vector<std::unique_ptr<ProfileRing>> rings;
+static thread_local ProfileRing *threadRing = nullptr;
+
+static LatencyHistogram histograms[num_profile_stages];
+static uint64_t droppedReported = 0;
+
+static ProfileRing &thread_ring()
+{
+  if (!threadRing)
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    rings.push_back(std::make_unique<ProfileRing>());
+    threadRing = rings.back().get();
+  }
+  return *threadRing;
+}
+
+ProfileScope::ProfileScope(ProfileStage stage) : start(now_ticks()), stage(stage)
+{
+}
+
+ProfileScope::~ProfileScope()
+{
+  const uint64_t duration = now_ticks() - start;
+  ProfileRing &ring = thread_ring();
+  if (!ring.push({uint32_t(std::min<uint64_t>(duration, UINT32_MAX)), stage}))
+    ring.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void profiler_end_tick()
+{
+  uint64_t stageTicks[num_profile_stages] = {};
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (std::unique_ptr<ProfileRing> &ring : rings)
+      ring->drain([&](const ProfileRecord &record) { stageTicks[record.stage] += record.duration; });
+  }
+  for (size_t i = 0; i < num_profile_stages; ++i)
+    histograms[i].add(stageTicks[i]);
+}
+
+void profiler_dump(const char *path)
+{
+  uint64_t dropped = 0;
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (std::unique_ptr<ProfileRing> &ring : rings)
+      dropped += ring->dropped.load(std::memory_order_relaxed);
+  }
+  const double us = ns_per_tick() * 1e-3;
+  const LatencyHistogram &tick = histograms[E_STAGE_TICK];
+  printf("Tick profile: p50 %.1f us, p99 %.1f us, p999 %.1f us, max %.1f us, %llu records dropped\n",
+         tick.percentile(0.5) * us, tick.percentile(0.99) * us, tick.percentile(0.999) * us,
+         tick.max() * us, (unsigned long long)(dropped - droppedReported));
+
+  FILE *file = fopen(path, "w");
+  if (!file)
+  {
+    printf("Cannot write tick profile to %s\n", path);
+  }
+  else
+  {
+    fprintf(file, "# time per tick spent in each stage over %llu ticks, in microseconds\n",
+            (unsigned long long)tick.count());
+    fprintf(file, "# %-14s %10s %10s %10s %10s %10s\n", "stage", "mean", "p50", "p99", "p999", "max");
+    for (size_t i = 0; i < num_profile_stages; ++i)
+    {
+      const LatencyHistogram &h = histograms[i];
+      fprintf(file, "%-16s %10.2f %10.2f %10.2f %10.2f %10.2f\n", stage_names[i], h.mean() * us,
+              h.percentile(0.5) * us, h.percentile(0.99) * us, h.percentile(0.999) * us, h.max() * us);
+    }
+    fprintf(file, "# histograms: stage, bucket upper bound in ns, ticks\n");
+    for (size_t i = 0; i < num_profile_stages; ++i)
+      histograms[i].for_each_bucket([&](uint64_t upper, uint64_t count)
+      {
+        fprintf(file, "%s %.0f %llu\n", stage_names[i], upper * us * 1e3, (unsigned long long)count);
+      });
+    fclose(file);
+  }
+
+  for (LatencyHistogram &h : histograms)
+    h = LatencyHistogram();
+  droppedReported = dropped;
+}
+
+#endif
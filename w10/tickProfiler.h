@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Stages of the server tick that get their own timers. Each one is summed over
+// the tick, so a stage running on every worker counts the cpu time of all of them.
+enum ProfileStage : uint8_t
+{
+  E_STAGE_EVENTS = 0,     // handling what the network thread received since the last tick
+  E_STAGE_OPEN,           // authenticating and decrypting the inputs and acks of the tick
+  E_STAGE_APPLY_INPUTS,
+  E_STAGE_SIMULATE,
+  E_STAGE_SIMULATE_SLICE, // one parallel_for chunk of the simulation, on any thread
+  E_STAGE_SNAPSHOTS,      // everything in send_snapshots
+  E_STAGE_ENCODE,         // encoding the delta for one baseline, on any thread
+  E_STAGE_SEAL,           // sealing the parts for a batch of peers, on any thread
+  E_STAGE_SEND,           // queueing the sealed packets for the network thread
+  E_STAGE_SERVICE,        // one pass of the network thread: sending, flushing, servicing ENet
+  E_STAGE_TICK,
+  num_profile_stages
+};
+
+#if TICK_PROFILER
+
+// Times its own lifetime and pushes the result into a ring owned by the calling
+// thread. Pushing is lock free; the game thread drains all rings at the end of
+// the tick, so no other thread ever waits on the profiler.
+class ProfileScope
+{
+public:
+  explicit ProfileScope(ProfileStage stage);
+  ~ProfileScope();
+
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+  uint64_t start;
+  ProfileStage stage;
+};
+
+#define PROFILE_SCOPE_NAME_(line) profileScope##line
+#define PROFILE_SCOPE_NAME(line) PROFILE_SCOPE_NAME_(line)
+#define PROFILE_SCOPE(stage) ProfileScope PROFILE_SCOPE_NAME(__LINE__)(stage)
+
+// Called on the game thread once the tick is done: drains the rings and adds one
+// sample per stage (zero if it didn't run) to that stage's histogram.
+void profiler_end_tick();
+// Writes p50/p99/p999 of every stage and the raw histograms of the ticks since
+// the last dump to path, prints the tick percentiles and starts over.
+void profiler_dump(const char *path);
+
+#else
+
+#define PROFILE_SCOPE(stage) ((void)0)
+inline void profiler_end_tick() {}
+inline void profiler_dump(const char *) {}
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <chrono>
+
+struct TickStats
+{
+  uint64_t ticks = 0;
+  uint64_t wakeUps = 0;
+  uint64_t overruns = 0;     // wake ups that found more than one tick due
+  uint64_t droppedTicks = 0; // ticks skipped past the catch up limit
+  double sumLateMs = 0.0;    // how far past the deadline the tick started
+  double maxLateMs = 0.0;
+};
+
+// Fixed timestep clock for the server loop. The loop sleeps in wait() until the
+// tick is due, then simulates advance() steps of dt() each. A loop servicing
+// ENet itself blocks in enet_host_service for service_timeout() first and only
+// sleeps the sub millisecond rest; the server leaves ENet to its HostThread.
+class TickScheduler
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  TickScheduler(uint32_t tickMs, uint32_t maxCatchUpTicks);
+
+  // whole milliseconds left until the next tick is due, for enet_host_service
+  uint32_t service_timeout() const;
+  // sleeps until the next tick is due (clock_nanosleep on Linux)
+  void wait() const;
+  // number of steps to simulate now, never more than maxCatchUpTicks
+  uint32_t advance();
+
+  float dt() const { return tickMs * 0.001f; }
+  const TickStats &stats() const { return tickStats; }
+  void reset_stats() { tickStats = TickStats(); }
+
+private:
+  uint32_t tickMs;
+  uint32_t maxCatchUpTicks;
+  Clock::duration period;
+  Clock::time_point nextTick;
+  TickStats tickStats;
+};
+
+// one line summary of the stats since the last call, then resets them
+void print_tick_stats(TickScheduler &scheduler);
@@ -0,0 +1,103 @@
+#include "collision.h"
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
+
+bool touches (const Entity& e1, const Entity& e2) {
+    float dx = std::abs(e1.x - e2.x);
+    float dy = std::abs(e1.y - e2.y);
+
+    return (dx < e1.size + e2.size) && (dy < e1.size + e2.size);
+}
+
+// returns the entity that got eaten and respawned, or nullptr
+static Entity* try_eat (Entity& a, Entity& b) {
+    Entity* e1Ptr = &a;
+    Entity* e2Ptr = &b;
+
+    if (e1Ptr->size < e2Ptr->size) std::swap(e1Ptr, e2Ptr);
+    Entity& e1 = *e1Ptr;
+    Entity& e2 = *e2Ptr;
+
+    if (!touches(e1, e2)) return nullptr;
+
+    e1.size += e2.size / 2;
+    e2.size /= 2;
+    e2.x = (rand() % 40 - 20) * 20.f;
+    e2.y = (rand() % 40 - 20) * 20.f;
+    return &e2;
+}
+
+void resolve_collisions_all_pairs (std::vector<Entity>& entities, CollisionStats& stats) {
+    for (size_t i = 0; i < entities.size(); i++) {
+        for (size_t j = i + 1; j < entities.size(); j++) {
+            stats.pairTests++;
+            if (try_eat(entities[i], entities[j]))
+                stats.eats++;
+        }
+    }
+}
+
+// cells that may hold anything touching e, returns whether they changed
+static bool query_box (const SpatialHash& grid, const Entity& e, int32_t box[4]) {
+    // padded a bit so float rounding at cell borders can't drop a pair
+    const float r = e.size * 1.001f + 1e-3f;
+    const int32_t newBox[4] = {grid.Cell(e.x - r), grid.Cell(e.y - r), grid.Cell(e.x + r), grid.Cell(e.y + r)};
+    if (std::equal(newBox, newBox + 4, box))
+        return false;
+    std::copy(newBox, newBox + 4, box);
+    return true;
+}
+
+void resolve_collisions (std::vector<Entity>& entities, SpatialHash& grid, CollisionStats& stats) {
+    grid.Update(entities);
+
+    static std::vector<uint32_t> candidates;
+    for (size_t i = 0; i < entities.size(); i++) {
+        // Every j outside the queried cells can't touch i. An eat only moves i
+        // or a j we have already passed, so the candidates stay valid unless
+        // the cells i needs change.
+        size_t nextJ = i + 1;
+        int32_t box[4] = {0, 0, -1, -1};
+        bool stale = query_box(grid, entities[i], box);
+        size_t pos = 0;
+        while (true) {
+            if (grid.IsOversized(entities[i])) {
+                // the grid can't narrow this one down, fall back to the plain scan
+                for (size_t j = nextJ; j < entities.size(); j++) {
+                    stats.pairTests++;
+                    if (!try_eat(entities[i], entities[j]))
+                        continue;
+                    stats.eats++;
+                    grid.Update(entities, i);
+                    grid.Update(entities, j);
+                }
+                break;
+            }
+            if (stale) {
+                candidates.clear();
+                grid.Query(box[0], box[1], box[2], box[3], candidates);
+                candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                                [&](uint32_t j) { return j < nextJ; }),
+                                 candidates.end());
+                std::sort(candidates.begin(), candidates.end());
+                candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+                pos = 0;
+                stale = false;
+            }
+            if (pos == candidates.size())
+                break;
+
+            const size_t j = candidates[pos++];
+            nextJ = j + 1;
+            stats.pairTests++;
+            if (!try_eat(entities[i], entities[j]))
+                continue;
+
+            stats.eats++;
+            grid.Update(entities, i);
+            grid.Update(entities, j);
+            stale = query_box(grid, entities[i], box);
+        }
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "entity.h"
+#include "spatialHash.h"
+
+struct CollisionStats {
+    size_t pairTests = 0;
+    size_t eats = 0;
+};
+
+bool touches (const Entity& e1, const Entity& e2);
+
+// Both passes test pairs (i, j), i < j, in the same order and apply the same
+// eat/respawn rules, so they leave the world in exactly the same state.
+void resolve_collisions_all_pairs (std::vector<Entity>& entities, CollisionStats& stats);
+void resolve_collisions (std::vector<Entity>& entities, SpatialHash& grid, CollisionStats& stats);
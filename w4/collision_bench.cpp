@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "collision.h"
+
+// Compares the all-pairs eat pass with the spatial hash broadphase on the same
+// world and checks that both leave it in exactly the same state.
+
+static std::vector<Entity> make_world (size_t count) {
+    // keep the density of the 10-blob server arena (+-100 units) as the count grows
+    const int halfExtent = static_cast<int>(100 * std::sqrt(count / 10.0));
+    std::vector<Entity> entities(count);
+    for (size_t i = 0; i < count; i++) {
+        Entity& e = entities[i];
+        e.eid = i;
+        e.x = rand() % (2 * halfExtent) - halfExtent;
+        e.y = rand() % (2 * halfExtent) - halfExtent;
+        e.size = (7.5 + (5.0 * (rand() % 1000)) / 999);
+    }
+    return entities;
+}
+
+static bool same_world (const std::vector<Entity>& a, const std::vector<Entity>& b) {
+    for (size_t i = 0; i < a.size(); i++)
+        if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].size != b[i].size)
+            return false;
+    return true;
+}
+
+int main() {
+    constexpr int ticks = 3;
+    for (size_t count : {1000, 10000, 50000}) {
+        srand(count);
+        const std::vector<Entity> world = make_world(count);
+
+        std::vector<Entity> allPairs = world;
+        CollisionStats allPairsStats;
+        auto start = std::chrono::steady_clock::now();
+        srand(1);
+        for (int t = 0; t < ticks; t++)
+            resolve_collisions_all_pairs(allPairs, allPairsStats);
+        double allPairsMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<Entity> grid = world;
+        CollisionStats gridStats;
+        SpatialHash hash(32.f);
+        start = std::chrono::steady_clock::now();
+        srand(1);
+        for (int t = 0; t < ticks; t++)
+            resolve_collisions(grid, hash, gridStats);
+        double gridMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        printf("%6zu entities: all-pairs %12zu tests/tick %9.2f ms/tick | grid %9zu tests/tick %7.2f ms/tick | eats %zu/%zu | %s\n",
+               count, allPairsStats.pairTests / ticks, allPairsMs / ticks,
+               gridStats.pairTests / ticks, gridMs / ticks,
+               allPairsStats.eats, gridStats.eats,
+               same_world(allPairs, grid) ? "identical" : "MISMATCH");
+    }
+    return 0;
+}
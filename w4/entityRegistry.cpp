@@ -0,0 +1,57 @@
+#include "entityRegistry.h"
+
+uint16_t EntityRegistry::Create () {
+    size_t slot = 0;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else if (slots.size() < maxEntities) {
+        slot = slots.size();
+        slots.emplace_back();
+    } else {
+        return invalid_entity;
+    }
+
+    slots[slot].dense = denseIds.size();
+    const uint16_t eid = static_cast<uint16_t>(slot);
+    denseIds.push_back(eid);
+    return eid;
+}
+
+size_t EntityRegistry::Find (uint16_t eid) const {
+    if (eid >= slots.size())
+        return npos;
+    const Slot& s = slots[eid];
+    return s.dense == static_cast<uint32_t>(npos) ? npos : s.dense;
+}
+
+size_t EntityRegistry::Destroy (uint16_t eid) {
+    const size_t idx = Find(eid);
+    if (idx == npos)
+        return npos;
+
+    const uint16_t moved = denseIds.back();
+    denseIds[idx] = moved;
+    denseIds.pop_back();
+    slots[moved].dense = idx;
+
+    Slot& s = slots[eid];
+    s.dense = static_cast<uint32_t>(npos);
+    s.generation++;
+    freeSlots.push_back(eid);
+    return idx;
+}
+
+EntityHandle EntityRegistry::Handle (uint16_t eid) const {
+    EntityHandle handle;
+    if (Find(eid) == npos)
+        return handle;
+    handle.eid = eid;
+    handle.generation = slots[eid].generation;
+    return handle;
+}
+
+size_t EntityRegistry::Find (EntityHandle handle) const {
+    const size_t idx = Find(handle.eid);
+    return idx != npos && slots[handle.eid].generation == handle.generation ? idx : npos;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "entity.h"
+
+// Slot map from eids to indices in the entity vector. The eid is just the slot,
+// so the whole 16 bit id on the wire addresses entities; the slot's generation
+// is kept on the server only. An EntityHandle pairs an eid with the generation
+// it was taken at and stops resolving once that entity is destroyed, even when
+// the slot has been reused since. Eids from clients are only checked for being
+// live, whether the peer may touch that entity is the caller's check.
+struct EntityHandle {
+    uint16_t eid = invalid_entity;
+    uint32_t generation = 0;
+};
+
+class EntityRegistry {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    static constexpr int slotBits = 16;
+    static constexpr uint16_t slotMask = static_cast<uint16_t>((1u << slotBits) - 1);
+    // the last slot is kept back so no live id can equal invalid_entity
+    static constexpr size_t maxEntities = slotMask;
+
+    // new id whose entity goes to index Size() - 1, invalid_entity if full
+    uint16_t Create ();
+    // index of a live eid, npos otherwise; fine to call with untrusted ids
+    size_t Find (uint16_t eid) const;
+    // swap-remove: the last entity moves into the returned index, npos if eid isn't live
+    size_t Destroy (uint16_t eid);
+
+    // handle for a live eid, one with invalid_entity otherwise
+    EntityHandle Handle (uint16_t eid) const;
+    // index of the entity the handle was taken for, npos once it's gone
+    size_t Find (EntityHandle handle) const;
+
+    size_t Size () const { return denseIds.size(); }
+
+private:
+    struct Slot {
+        uint32_t dense = static_cast<uint32_t>(npos);
+        uint32_t generation = 0;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint16_t> freeSlots;
+    std::vector<uint16_t> denseIds;
+};
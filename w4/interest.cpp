@@ -0,0 +1,27 @@
+#include "interest.h"
+#include <algorithm>
+#include <cmath>
+
+static bool is_near (const Entity& viewer, const Entity& e, float radius) {
+    return std::abs(e.x - viewer.x) < radius + e.size && std::abs(e.y - viewer.y) < radius + e.size;
+}
+
+void gather_interest (const std::vector<Entity>& entities, const SpatialHash& grid, const Entity* viewer,
+                      uint32_t tick, const InterestSettings& settings, std::vector<uint32_t>& out) {
+    const size_t first = out.size();
+    if (viewer) {
+        const float r = settings.radius;
+        grid.Query(grid.Cell(viewer->x - r), grid.Cell(viewer->y - r),
+                   grid.Cell(viewer->x + r), grid.Cell(viewer->y + r), out);
+        std::sort(out.begin() + first, out.end());
+        out.erase(std::unique(out.begin() + first, out.end()), out.end());
+        out.erase(std::remove_if(out.begin() + first, out.end(),
+                                 [&](uint32_t idx) { return !is_near(*viewer, entities[idx], r); }),
+                  out.end());
+    }
+
+    const uint32_t interval = std::max(settings.farInterval, 1u);
+    for (size_t idx = tick % interval; idx < entities.size(); idx += interval)
+        if (!viewer || !is_near(*viewer, entities[idx], settings.radius))
+            out.push_back(idx);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "entity.h"
+#include "spatialHash.h"
+
+struct InterestSettings {
+    // entities within this distance (per axis, like the camera view) come every tick;
+    // well inside the +-100 unit spawn square, so about 40% of a fresh world is near
+    float radius = 70.f;
+    // everything else is spread over this many ticks
+    uint32_t farInterval = 10;
+};
+
+// Collects indices of the entities a viewer should hear about on this tick:
+// the ones around it every tick and a rotating 1/farInterval slice of the rest.
+// Without a viewer (not joined yet) the whole world comes at the far rate.
+void gather_interest (const std::vector<Entity>& entities, const SpatialHash& grid, const Entity* viewer,
+                      uint32_t tick, const InterestSettings& settings, std::vector<uint32_t>& out);
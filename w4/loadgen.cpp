@@ -0,0 +1,141 @@
+// Headless load generator for w4_server: many scripted bots from one process,
+// each its own ENet peer playing the same protocol as the w4 client. The loop,
+// stats and report are common/loadgenCore's, this is the w4 protocol side.
+// usage: w4_loadgen [bots] [seconds] [host] [port]
+#include <enet/enet.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include "entity.h"
+#include "protocol.h"
+#include "packetPool.h"
+#include "loadgenCore.h"
+
+// the server ticks every 20 ms and sends all snapshots of a tick at once
+constexpr double tickMs = 20.0;
+// the client sends its state once per rendered frame at 60 fps
+constexpr double stateIntervalMs = 1000.0 / 60.0;
+constexpr float moveSpeed = 100.f;
+// how long a bot keeps walking one way before picking another direction
+constexpr int minMoveHoldMs = 250;
+constexpr int maxMoveHoldMs = 2000;
+
+class Bot : public LoadBot {
+public:
+    explicit Bot (uint32_t seed) : rng(seed) {}
+
+    void on_connect () override {
+        send_join(peer);
+    }
+
+    void on_disconnect () override {
+        positioned = false;
+        eid = invalid_entity;
+    }
+
+    void on_receive (ENetPacket* packet, double arrival, LoadStats& stats) override {
+        try {
+            switch (get_packet_type(packet)) {
+                case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+                    deserialize_set_controlled_entity(packet, eid);
+                    break;
+                case E_SERVER_TO_CLIENT_SNAPSHOT:
+                    OnSnapshot(packet, arrival, stats);
+                    break;
+                default:
+                    break;
+            };
+        } catch (const std::runtime_error& e) {
+            printf("Malformed packet: %s\n", e.what());
+        }
+    }
+
+    void drive (double now) override {
+        if (!positioned || now - lastState < stateIntervalMs)
+            return;
+        if (now >= nextMoveChange) {
+            std::uniform_int_distribution<int> axis(-1, 1);
+            std::uniform_int_distribution<int> hold(minMoveHoldMs, maxMoveHoldMs);
+            dirX = static_cast<float>(axis(rng));
+            dirY = static_cast<float>(axis(rng));
+            nextMoveChange = now + hold(rng);
+        }
+        const float dt = static_cast<float>(std::min(now - lastState, 100.0) * 0.001);
+        lastState = now;
+        x += dirX * moveSpeed * dt;
+        y += dirY * moveSpeed * dt;
+        send_entity_state(peer, eid, x, y);
+    }
+
+    bool playing () const override { return eid != invalid_entity; }
+
+private:
+    // Time from the server tick to this snapshot being handled. The burst's first
+    // snapshot is taken to be half the lowest round trip late, the rest of the
+    // burst is measured against it; a whole burst held back by a slow tick shows
+    // up in the ENet round trip instead.
+    double SnapshotLatency (double arrival) {
+        if (arrival - lastSnapshot > tickMs * 0.5)
+            burstStart = arrival;
+        lastSnapshot = arrival;
+        return peer->lowestRoundTripTime * 0.5 + (arrival - burstStart);
+    }
+
+    void OnSnapshot (ENetPacket* packet, double arrival, LoadStats& stats) {
+        uint16_t snapshotEid = invalid_entity;
+        float snapshotX = 0.f;
+        float snapshotY = 0.f;
+        float size = 0.f;
+        deserialize_snapshot(packet, snapshotEid, snapshotX, snapshotY, size);
+        stats.snapshots++;
+        stats.latency.add(SnapshotLatency(arrival));
+        // like the client, the server's word on our own entity overrides the local one
+        if (snapshotEid == eid) {
+            x = snapshotX;
+            y = snapshotY;
+            positioned = true;
+        }
+    }
+
+    uint16_t eid = invalid_entity;
+    // the controlled entity as the client sees it, moved locally and sent as state
+    bool positioned = false;
+    float x = 0.f;
+    float y = 0.f;
+    float dirX = 0.f;
+    float dirY = 0.f;
+    std::mt19937 rng;
+    double nextMoveChange = 0.0;
+    double lastState = 0.0;
+    // snapshots carry no tick number, a gap of half a tick starts the next burst
+    double burstStart = 0.0;
+    double lastSnapshot = 0.0;
+};
+
+int main(int argc, const char** argv) {
+    LoadgenOptions options;
+    options.hostName = "127.0.0.1";
+    parse_loadgen_options(argc, argv, options);
+
+    if (packet_pool_initialize() != 0) {
+        printf("Cannot init ENet");
+        return 1;
+    }
+
+    ENetAddress address;
+    if (enet_address_set_host(&address, options.hostName) != 0) {
+        printf("Cannot resolve %s\n", options.hostName);
+        return 1;
+    }
+    address.port = options.port;
+
+    const int result = run_loadgen(options, address, [] (size_t index) {
+        return std::make_unique<Bot>(static_cast<uint32_t>(index));
+    });
+
+    atexit(enet_deinitialize);
+    return result;
+}
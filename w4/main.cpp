@@ -2,10 +2,12 @@
 #include <enet/enet.h>
 #include <algorithm>  // min/max
 #include <functional>
+#include <stdexcept>
 
 #include <vector>
 #include "entity.h"
 #include "protocol.h"
+#include "packetPool.h"
 
 static std::vector<Entity> entities;
 static std::unordered_map<uint16_t, size_t> indexMap;
@@ -46,7 +48,7 @@ void on_snapshot(ENetPacket* packet) {
 }
 
 int main(int argc, const char** argv) {
-    if (enet_initialize() != 0) {
+    if (packet_pool_initialize() != 0) {
         printf("Cannot init ENet");
         return 1;
     }
@@ -100,19 +102,23 @@ int main(int argc, const char** argv) {
                     connected = true;
                     break;
                 case ENET_EVENT_TYPE_RECEIVE:
-                    switch (get_packet_type(event.packet)) {
-                        case E_SERVER_TO_CLIENT_NEW_ENTITY:
-                            on_new_entity_packet(event.packet);
-                            printf("new it\n");
-                            break;
-                        case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
-                            on_set_controlled_entity(event.packet);
-                            printf("got it\n");
-                            break;
-                        case E_SERVER_TO_CLIENT_SNAPSHOT:
-                            on_snapshot(event.packet);
-                            break;
-                    };
+                    try {
+                        switch (get_packet_type(event.packet)) {
+                            case E_SERVER_TO_CLIENT_NEW_ENTITY:
+                                on_new_entity_packet(event.packet);
+                                printf("new it\n");
+                                break;
+                            case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+                                on_set_controlled_entity(event.packet);
+                                printf("got it\n");
+                                break;
+                            case E_SERVER_TO_CLIENT_SNAPSHOT:
+                                on_snapshot(event.packet);
+                                break;
+                        };
+                    } catch (const std::runtime_error& e) {
+                        printf("Malformed packet: %s\n", e.what());
+                    }
                     break;
                 default:
                     break;
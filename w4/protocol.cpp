@@ -1,53 +1,62 @@
 #include "protocol.h"
-#include <cstring> // memcpy
+#include "serialise.h"
 #include <cstdio>
 
+static Writer packet_writer (ENetPacket *packet) {
+    return Writer({packet->data, packet->dataLength});
+}
+
+static Reader packet_reader (ENetPacket *packet) {
+    return Reader({packet->data, packet->dataLength});
+}
+
+static PacketSink packetSink = nullptr;
+
+void set_packet_sink (PacketSink sink) {
+    packetSink = sink;
+}
+
+// every packet goes out through here
+static void send_packet (ENetPeer *peer, uint8_t channel, ENetPacket *packet) {
+    if (packetSink)
+        packetSink(peer, channel, packet);
+    else
+        enet_peer_send(peer, channel, packet);
+}
+
 void send_join (ENetPeer *peer) {
-    ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t), ENET_PACKET_FLAG_RELIABLE);
-    *packet->data = E_CLIENT_TO_SERVER_JOIN;
+    ENetPacket *packet = enet_packet_create(nullptr, PackedSize<uint8_t>, ENET_PACKET_FLAG_RELIABLE);
+    packet_writer(packet).Write(E_CLIENT_TO_SERVER_JOIN);
 
-    enet_peer_send(peer, 0, packet);
+    send_packet(peer, 0, packet);
 }
 
 void send_new_entity (ENetPeer *peer, const Entity &ent) {
-    ENetPacket* packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(Entity), ENET_PACKET_FLAG_RELIABLE);
-    uint8_t *ptr = packet->data;
-    *ptr = E_SERVER_TO_CLIENT_NEW_ENTITY; ptr += sizeof(uint8_t);
-    memcpy(ptr, &ent, sizeof(Entity)); ptr += sizeof(Entity);
+    ENetPacket* packet = enet_packet_create(nullptr, PackedSize<uint8_t, Entity>, ENET_PACKET_FLAG_RELIABLE);
+    packet_writer(packet).Write(E_SERVER_TO_CLIENT_NEW_ENTITY).Write(ent);
 
-    enet_peer_send(peer, 0, packet);
+    send_packet(peer, 0, packet);
 }
 
 void send_set_controlled_entity (ENetPeer *peer, uint16_t eid) {
-    ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t), ENET_PACKET_FLAG_RELIABLE);
-    uint8_t *ptr = packet->data;
-    *ptr = E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY; ptr += sizeof(uint8_t);
-    memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+    ENetPacket *packet = enet_packet_create(nullptr, PackedSize<uint8_t, uint16_t>, ENET_PACKET_FLAG_RELIABLE);
+    packet_writer(packet).Write(E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY).Write(eid);
 
-    enet_peer_send(peer, 0, packet);
+    send_packet(peer, 0, packet);
 }
 
 void send_entity_state (ENetPeer *peer, uint16_t eid, float x, float y) {
-    ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) + 2 * sizeof(float), ENET_PACKET_FLAG_UNSEQUENCED);
-    uint8_t *ptr = packet->data;
-    *ptr = E_CLIENT_TO_SERVER_STATE; ptr += sizeof(uint8_t);
-    memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-    memcpy(ptr, &x, sizeof(float)); ptr += sizeof(float);
-    memcpy(ptr, &y, sizeof(float)); ptr += sizeof(float);
-
-    enet_peer_send(peer, 1, packet);
+    ENetPacket *packet = enet_packet_create(nullptr, PackedSize<uint8_t, uint16_t, float, float>, ENET_PACKET_FLAG_UNSEQUENCED);
+    packet_writer(packet).Write(E_CLIENT_TO_SERVER_STATE).Write(eid).Write(x).Write(y);
+
+    send_packet(peer, 1, packet);
 }
 
 void send_snapshot (ENetPeer *peer, uint16_t eid, float x, float y, float size) {
-    ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) + 3 * sizeof(float), ENET_PACKET_FLAG_UNSEQUENCED);
-    uint8_t *ptr = packet->data;
-    *ptr = E_SERVER_TO_CLIENT_SNAPSHOT; ptr += sizeof(uint8_t);
-    memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-    memcpy(ptr, &x, sizeof(float)); ptr += sizeof(float);
-    memcpy(ptr, &y, sizeof(float)); ptr += sizeof(float);
-    memcpy(ptr, &size, sizeof(float)); ptr += sizeof(float);
-
-    enet_peer_send(peer, 1, packet);
+    ENetPacket *packet = enet_packet_create(nullptr, PackedSize<uint8_t, uint16_t, float, float, float>, ENET_PACKET_FLAG_UNSEQUENCED);
+    packet_writer(packet).Write(E_SERVER_TO_CLIENT_SNAPSHOT).Write(eid).Write(x).Write(y).Write(size);
+
+    send_packet(peer, 1, packet);
 }
 
 MessageType get_packet_type (ENetPacket *packet) {
@@ -55,27 +64,17 @@ MessageType get_packet_type (ENetPacket *packet) {
 }
 
 void deserialize_new_entity (ENetPacket *packet, Entity &ent) {
-    uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-    ent = *(Entity*)(ptr); ptr += sizeof(Entity);
+    packet_reader(packet).Skip(sizeof(uint8_t)).Read(ent);
 }
 
 void deserialize_set_controlled_entity (ENetPacket *packet, uint16_t &eid) {
-    uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-    eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
+    packet_reader(packet).Skip(sizeof(uint8_t)).Read(eid);
 }
 
 void deserialize_entity_state (ENetPacket *packet, uint16_t &eid, float &x, float &y) {
-    uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-    eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-    x = *(float*)(ptr); ptr += sizeof(float);
-    y = *(float*)(ptr); ptr += sizeof(float);
+    packet_reader(packet).Skip(sizeof(uint8_t)).Read(eid).Read(x).Read(y);
 }
 
 void deserialize_snapshot (ENetPacket *packet, uint16_t &eid, float &x, float &y, float& size) {
-    uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-    eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-    x = *(float*)(ptr); ptr += sizeof(float);
-    y = *(float*)(ptr); ptr += sizeof(float);
-    size = *(float*)(ptr); ptr += sizeof(float);
+    packet_reader(packet).Skip(sizeof(uint8_t)).Read(eid).Read(x).Read(y).Read(size);
 }
-
@@ -11,6 +11,11 @@ enum MessageType : uint8_t {
     E_SERVER_TO_CLIENT_SNAPSHOT
 };
 
+// Where the sends below hand their packets over: enet_peer_send by default, a
+// server whose host lives on a HostThread queues them for it instead.
+typedef void (*PacketSink)(ENetPeer *peer, uint8_t channel, ENetPacket *packet);
+void set_packet_sink(PacketSink sink);
+
 void send_join(ENetPeer *peer);
 void send_new_entity(ENetPeer *peer, const Entity &ent);
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid);
@@ -1,102 +1,96 @@
 #pragma once
 
-#include <vector>
-#include <string>
-#include <deque>
+#include <cstdint>
+#include <cstring>
+#include <span>
 #include <stdexcept>
-#include <algorithm>
+#include <string_view>
+#include <type_traits>
+
+// Zero-copy (de)serialisation straight over a packet buffer (ENetPacket::data).
+// Trivially copyable values are stored as raw bytes without any size prefix,
+// so message layouts are known at compile time via PackedSize.
 
 template <typename T>
-uint64_t SizeOf (const T&) {
-    return sizeof(T);
-}
+concept TriviallySerialisable = std::is_trivially_copyable_v<T>;
 
-template <>
-uint64_t SizeOf (const std::string& str) {
-    return str.length();
-}
+template <TriviallySerialisable... Ts>
+constexpr size_t PackedSize = (sizeof(Ts) + ... + 0);
 
 class Writer {
-    std::vector<uint8_t> buffer;
+    std::span<uint8_t> buffer;
+    size_t cursor = 0;
 public:
-    template <typename T>
+    explicit Writer (std::span<uint8_t> buffer) : buffer(buffer) {}
+
+    template <TriviallySerialisable T>
     Writer& Write (const T& val) {
-        uint64_t size = SizeOf(val);
+        if (buffer.size() - cursor < sizeof(T)) throw std::runtime_error("not enough space to write type");
 
-        buffer.insert(buffer.end(), reinterpret_cast<uint8_t*>(&size), reinterpret_cast<uint8_t*>(&size + sizeof(size)));
-        buffer.insert(buffer.end(), reinterpret_cast<uint8_t*>(&val), reinterpret_cast<uint8_t*>(&val + size))
+        memcpy(buffer.data() + cursor, &val, sizeof(T));
+        cursor += sizeof(T);
 
         return *this;
     }
 
-    Writer& Writer::Write (const std::string& val) {
-        uint64_t size = SizeOf(val);
-    
-        buffer.insert(buffer.end(), reinterpret_cast<uint8_t*>(&size), reinterpret_cast<uint8_t*>(&size + sizeof(size)));
-        buffer.insert(buffer.end(), val.c_str(), val.c_str() + size);
-    
-        return *this;
-    }
+    // strings are the only variable sized values and carry a length prefix
+    Writer& Write (std::string_view val) {
+        uint16_t size = val.size();
+        if (size != val.size()) throw std::runtime_error("string is too long");
+
+        Write(size);
+        if (buffer.size() - cursor < size) throw std::runtime_error("not enough space to write string");
+        memcpy(buffer.data() + cursor, val.data(), size);
+        cursor += size;
 
-    Writer& Writer::Write (const char* val) {
-        uint64_t size = strlen(val);
-    
-        buffer.insert(buffer.end(), reinterpret_cast<uint8_t*>(&size), reinterpret_cast<uint8_t*>(&size + sizeof(size)));
-        buffer.insert(buffer.end(), val, val + size);
-    
         return *this;
     }
 
-    std::vector<uint8_t>&& Buffer () {
-        auto res = std::vector<uint8_t>();
-        std::swap(res, buffer);
-        return std::move(res);
+    Writer& Write (const char* val) {
+        return Write(std::string_view(val));
     }
-private:
 
+    size_t Written () const {
+        return cursor;
+    }
 };
 
 class Reader {
-    std::deque<uint8_t> buffer;
+    std::span<const uint8_t> buffer;
+    size_t cursor = 0;
 public:
-    Reader (const std::vector<uint8_t>& buffer) : buffer(buffer.begin(), buffer.end()) {}
+    explicit Reader (std::span<const uint8_t> buffer) : buffer(buffer) {}
 
-    template <typename T>
+    template <TriviallySerialisable T>
     Reader& Read (T& val) {
-        uint64_t size = 0;
-        
-        if (buffer.size() < sizeof(size)) throw std::runtime_error("not enought len to scan size");
-        for (size_t i = 0; i < sizeof(size); i++) {
-            reinterpret_cast<uint8_t*>(&size)[i] = buffer.front();
-            buffer.pop_front();
-        }
-
-        // AHTUNG: изменить для сторки
-        if (size != SizeOf(val))  throw std::runtime_error("mistmatch between type size and buffer len");
-        if (buffer.size() < size) throw std::runtime_error("not enought len to scan type");
-
-        for (size_t i = 0; i < size; i++) {
-            reinterpret_cast<uint8_t*>(&val)[i] = buffer.front();
-            buffer.pop_front();
-        }
+        if (buffer.size() - cursor < sizeof(T)) throw std::runtime_error("not enough len to scan type");
+
+        memcpy(&val, buffer.data() + cursor, sizeof(T));
+        cursor += sizeof(T);
 
         return *this;
     }
 
-    Reader& Read (std::string& val) {
-        uint64_t size = 0;
-        
-        if (buffer.size() < sizeof(size)) throw std::runtime_error("not enought len to scan size");
-        for (size_t i = 0; i < sizeof(size); i++) {
-            reinterpret_cast<uint8_t*>(&size)[i] = buffer.front();
-            buffer.pop_front();
-        }
+    // the view points into the packet and is only valid while the packet lives
+    Reader& Read (std::string_view& val) {
+        uint16_t size = 0;
+        Read(size);
 
-        if (buffer.size() < size) throw std::runtime_error("not enought len to scan type");
-        
-        val = std::string(buffer.front(), buffer.front() + size);
-        for (size_t i = 0; i < size; i++) buffer.pop_front();
+        if (buffer.size() - cursor < size) throw std::runtime_error("not enough len to scan string");
+        val = std::string_view(reinterpret_cast<const char*>(buffer.data() + cursor), size);
+        cursor += size;
 
         return *this;
     }
+
+    Reader& Skip (size_t size) {
+        if (buffer.size() - cursor < size) throw std::runtime_error("not enough len to skip");
+        cursor += size;
+
+        return *this;
+    }
+
+    size_t Remaining () const {
+        return buffer.size() - cursor;
+    }
 };
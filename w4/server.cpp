@@ -5,13 +5,34 @@
 #include <vector>
 #include "entity.h"
 #include "protocol.h"
+#include "packetPool.h"
+#include "collision.h"
+#include "interest.h"
+#include "tickScheduler.h"
+#include "entityRegistry.h"
+#include "hostThread.h"
 #include <chrono>
+#include <memory>
+#include <stdexcept>
 
 static std::vector<Entity> entities;
+static EntityRegistry registry; // eid -> index in entities
 static std::map<uint16_t, ENetPeer*> controlledMap;
+static std::map<ENetPeer*, uint16_t> peerEntities;
+// peers the network thread told us about, the ENetPeer itself is its business
+static std::map<ENetPeer*, ENetAddress> connectedPeers;
+static std::unique_ptr<HostThread> network;
+static SpatialHash grid(32.f);
+static InterestSettings interest;
+
+constexpr uint32_t tickMs = 20;
+constexpr uint32_t maxCatchUpTicks = 5;
+constexpr uint64_t tickStatsInterval = 500;
 
 static uint16_t create_random_entity() {
-    uint16_t newEid = entities.size();
+    uint16_t newEid = registry.Create();
+    if (newEid == invalid_entity)
+        return invalid_entity;
     uint32_t color = 0xff000000 + 0x00440000 * (1 + rand() % 4) + 0x00004400 * (1 + rand() % 4) + 0x00000044 * (1 + rand() % 4);
     float x = (rand() % 40 - 20) * 5.f;
     float y = (rand() % 40 - 20) * 5.f;
@@ -21,54 +42,95 @@ static uint16_t create_random_entity() {
     return newEid;
 }
 
-void on_join(ENetPacket* packet, ENetPeer* peer, ENetHost* host) {
+void on_join(ENetPacket* packet, ENetPeer* peer, const ENetAddress& address) {
     // send all entities
     for (const Entity& ent : entities)
         send_new_entity(peer, ent);
 
-    // find max eid
     uint16_t newEid = create_random_entity();
-    const Entity& ent = entities[newEid];
+    if (newEid == invalid_entity) {
+        printf("No free entity slots for %x:%u\n", address.host, address.port);
+        return;
+    }
+    const Entity& ent = entities[registry.Find(newEid)];
 
     controlledMap[newEid] = peer;
+    peerEntities[peer] = newEid;
 
     // send info about new entity to everyone
-    for (size_t i = 0; i < host->peerCount; ++i)
-        send_new_entity(&host->peers[i], ent);
+    for (const auto& [other, otherAddress] : connectedPeers)
+        send_new_entity(other, ent);
     // send info about controlled entity
     send_set_controlled_entity(peer, newEid);
 }
 
-void on_state(ENetPacket* packet) {
+void on_state(ENetPacket* packet, ENetPeer* peer) {
     uint16_t eid = invalid_entity;
     float x = 0.f;
     float y = 0.f;
     deserialize_entity_state(packet, eid, x, y);
-    for (Entity& e : entities)
-        if (e.eid == eid) {
-            e.x = x;
-            e.y = y;
-        }
+    // only accept state for the entity this peer actually plays
+    auto controlled = peerEntities.find(peer);
+    const size_t idx = registry.Find(eid);
+    if (idx == EntityRegistry::npos || controlled == peerEntities.end() || controlled->second != eid)
+        return;
+    entities[idx].x = x;
+    entities[idx].y = y;
 }
 
-bool touches (const Entity& e1, const Entity& e2) {
-    float dx = std::abs(e1.x - e2.x);
-    float dy = std::abs(e1.y - e2.y);
-
-    return (dx < e1.size + e2.size) && (dy < e1.size + e2.size);
+// everything the network thread got since the last tick, in the order it came
+void handle_events() {
+    HostEvent event;
+    while (network->receive(event)) {
+        switch (event.type) {
+            case ENET_EVENT_TYPE_CONNECT:
+                printf("Connection with %x:%u established\n", event.address.host, event.address.port);
+                connectedPeers[event.peer] = event.address;
+                break;
+            case ENET_EVENT_TYPE_DISCONNECT:
+                printf("Disconnected %x:%u\n", event.address.host, event.address.port);
+                connectedPeers.erase(event.peer);
+                peerEntities.erase(event.peer);
+                break;
+            case ENET_EVENT_TYPE_RECEIVE:
+                try {
+                    switch (get_packet_type(event.packet)) {
+                        case E_CLIENT_TO_SERVER_JOIN:
+                            on_join(event.packet, event.peer, event.address);
+                            break;
+                        case E_CLIENT_TO_SERVER_STATE:
+                            on_state(event.packet, event.peer);
+                            break;
+                    };
+                } catch (const std::runtime_error& e) {
+                    printf("Malformed packet from %x:%u: %s\n", event.address.host, event.address.port, e.what());
+                }
+                enet_packet_destroy(event.packet);
+                break;
+            default:
+                break;
+        };
+    }
 }
 
 int main(int argc, const char** argv) {
-    if (enet_initialize() != 0) {
+    if (packet_pool_initialize() != 0) {
         printf("Cannot init ENet");
         return 1;
     }
+    // usage: w4_server [interest radius] [far update interval in ticks]
+    if (argc > 1)
+        interest.radius = atof(argv[1]);
+    if (argc > 2)
+        interest.farInterval = atoi(argv[2]);
+
     ENetAddress address;
 
     address.host = ENET_HOST_ANY;
     address.port = 10131;
 
-    ENetHost* server = enet_host_create(&address, 32, 2, 0, 0);
+    // as many peers as ENet can address, so w4_loadgen can bring thousands of bots
+    ENetHost* server = enet_host_create(&address, ENET_PROTOCOL_MAXIMUM_PEER_ID, 2, 0, 0);
 
     if (!server) {
         printf("Cannot create ENet server\n");
@@ -79,86 +141,72 @@ int main(int argc, const char** argv) {
 
     for (int i = 0; i < numAi; ++i) {
         uint16_t eid = create_random_entity();
-        entities[eid].serverControlled = true;
+        entities[registry.Find(eid)].serverControlled = true;
         controlledMap[eid] = nullptr;
     }
 
-    uint32_t lastTime = enet_time_get();
+    // ENet gets a thread of its own, every send of the tick is queued for it
+    network = std::make_unique<HostThread>(server);
+    set_packet_sink([](ENetPeer* peer, uint8_t channel, ENetPacket* packet) { network->send(peer, channel, packet); });
+    network->start();
+
+    TickScheduler scheduler(tickMs, maxCatchUpTicks);
     while (true) {
-        uint32_t curTime = enet_time_get();
-        float dt = (curTime - lastTime) * 0.001f;
-        lastTime = curTime;
-        ENetEvent event;
-        while (enet_host_service(server, &event, 0) > 0) {
-            switch (event.type) {
-                case ENET_EVENT_TYPE_CONNECT:
-                    printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
-                    break;
-                case ENET_EVENT_TYPE_RECEIVE:
-                    switch (get_packet_type(event.packet)) {
-                        case E_CLIENT_TO_SERVER_JOIN:
-                            on_join(event.packet, event.peer, server);
-                            break;
-                        case E_CLIENT_TO_SERVER_STATE:
-                            on_state(event.packet);
-                            break;
-                    };
-                    enet_packet_destroy(event.packet);
-                    break;
-                default:
-                    break;
-            };
-        }
-        for (Entity& e : entities) {
-            if (e.serverControlled) {
-                const float diffX = e.targetX - e.x;
-                const float diffY = e.targetY - e.y;
-                const float dirX = diffX > 0.f ? 1.f : -1.f;
-                const float dirY = diffY > 0.f ? 1.f : -1.f;
-                constexpr float spd = 50.f;
-                e.x += dirX * spd * dt;
-                e.y += dirY * spd * dt;
-                if (fabsf(diffX) < 10.f && fabsf(diffY) < 10.f) {
-                    e.targetX = (rand() % 40 - 20) * 15.f;
-                    e.targetY = (rand() % 40 - 20) * 15.f;
+        scheduler.Wait();
+        const uint32_t steps = scheduler.Advance();
+        if (steps == 0)
+            continue;
+        handle_events();
+        const float dt = scheduler.Dt();
+        for (uint32_t step = 0; step < steps; step++) {
+            for (Entity& e : entities) {
+                if (e.serverControlled) {
+                    const float diffX = e.targetX - e.x;
+                    const float diffY = e.targetY - e.y;
+                    const float dirX = diffX > 0.f ? 1.f : -1.f;
+                    const float dirY = diffY > 0.f ? 1.f : -1.f;
+                    constexpr float spd = 50.f;
+                    e.x += dirX * spd * dt;
+                    e.y += dirY * spd * dt;
+                    if (fabsf(diffX) < 10.f && fabsf(diffY) < 10.f) {
+                        e.targetX = (rand() % 40 - 20) * 15.f;
+                        e.targetY = (rand() % 40 - 20) * 15.f;
+                    }
                 }
             }
         }
 
         static float timer = 1.0 / 15;
-        timer -= dt;
+        timer -= steps * dt;
         if (timer < 0) {
             timer = 1.0 / 15;
 
-            for (size_t i = 0; i < entities.size(); i++) {
-                for (size_t j = i + 1; j < entities.size(); j++) { 
-                    Entity* e1Ptr = &entities[i];
-                    Entity* e2Ptr = &entities[j];
-
-                    if (e1Ptr->size < e2Ptr->size) std::swap(e1Ptr, e2Ptr);
-                    Entity& e1 = *e1Ptr;
-                    Entity& e2 = *e2Ptr;
-
-                    if (!touches(e1, e2)) continue;
-
-                    e1.size += e2.size / 2;
-                    e2.size /= 2;
-                    e2.x = (rand() % 40 - 20) * 20.f;
-                    e2.y = (rand() % 40 - 20) * 20.f;
-                }
-            }
+            CollisionStats stats;
+            resolve_collisions(entities, grid, stats);
         }
 
-        for (const Entity& e : entities) {
-            for (size_t i = 0; i < server->peerCount; ++i) {
-                ENetPeer* peer = &server->peers[i];
-                //if (controlledMap[e.eid] != peer)
+        static uint32_t tick = 0;
+        static std::vector<uint32_t> relevant;
+        tick++;
+        grid.Update(entities);
+        for (const auto& [peer, address] : connectedPeers) {
+            auto itf = peerEntities.find(peer);
+            const Entity* viewer = itf != peerEntities.end() ? &entities[registry.Find(itf->second)] : nullptr;
+
+            relevant.clear();
+            gather_interest(entities, grid, viewer, tick, interest, relevant);
+            for (uint32_t idx : relevant) {
+                const Entity& e = entities[idx];
                 send_snapshot(peer, e.eid, e.x, e.y, e.size);
             }
         }
-        // usleep(400000);
+        if (scheduler.Stats().ticks >= tickStatsInterval) {
+            print_packet_pool_stats(scheduler.Stats().ticks);
+            scheduler.PrintStats();
+        }
     }
 
+    network->stop();
     enet_host_destroy(server);
 
     atexit(enet_deinitialize);
@@ -0,0 +1,89 @@
+#include "spatialHash.h"
+#include <algorithm>
+#include <cmath>
+
+static void erase_index (std::vector<uint32_t>& bucket, uint32_t idx) {
+    auto it = std::find(bucket.begin(), bucket.end(), idx);
+    if (it != bucket.end()) {
+        *it = bucket.back();
+        bucket.pop_back();
+    }
+}
+
+int32_t SpatialHash::Cell (float v) const {
+    return static_cast<int32_t>(std::floor(v / cellSize));
+}
+
+bool SpatialHash::IsOversized (const Entity& e) const {
+    return RangeOf(e).oversized;
+}
+
+SpatialHash::CellRange SpatialHash::RangeOf (const Entity& e) const {
+    CellRange range;
+    range.x0 = Cell(e.x - e.size);
+    range.y0 = Cell(e.y - e.size);
+    range.x1 = Cell(e.x + e.size);
+    range.y1 = Cell(e.y + e.size);
+    range.oversized = int64_t(range.x1) - range.x0 >= maxCellsPerAxis || int64_t(range.y1) - range.y0 >= maxCellsPerAxis;
+    return range;
+}
+
+uint64_t SpatialHash::Key (int32_t cx, int32_t cy) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+}
+
+void SpatialHash::Insert (const CellRange& range, uint32_t idx) {
+    if (range.oversized) {
+        oversized.push_back(idx);
+        return;
+    }
+    for (int32_t cx = range.x0; cx <= range.x1; cx++)
+        for (int32_t cy = range.y0; cy <= range.y1; cy++)
+            cells[Key(cx, cy)].push_back(idx);
+}
+
+void SpatialHash::Remove (const CellRange& range, uint32_t idx) {
+    if (range.oversized) {
+        erase_index(oversized, idx);
+        return;
+    }
+    for (int32_t cx = range.x0; cx <= range.x1; cx++) {
+        for (int32_t cy = range.y0; cy <= range.y1; cy++) {
+            auto itf = cells.find(Key(cx, cy));
+            if (itf != cells.end())
+                erase_index(itf->second, idx);
+        }
+    }
+}
+
+void SpatialHash::Update (const std::vector<Entity>& entities) {
+    for (size_t i = 0; i < entities.size(); i++)
+        Update(entities, i);
+}
+
+void SpatialHash::Update (const std::vector<Entity>& entities, size_t idx) {
+    while (entityRanges.size() <= idx) {
+        const uint32_t newIdx = entityRanges.size();
+        entityRanges.push_back(RangeOf(entities[newIdx]));
+        Insert(entityRanges.back(), newIdx);
+    }
+
+    const CellRange range = RangeOf(entities[idx]);
+    if (entityRanges[idx] == range)
+        return;
+    Remove(entityRanges[idx], idx);
+    Insert(range, idx);
+    entityRanges[idx] = range;
+}
+
+void SpatialHash::Query (int32_t x0, int32_t y0, int32_t x1, int32_t y1, std::vector<uint32_t>& out) const {
+    out.insert(out.end(), oversized.begin(), oversized.end());
+
+    for (int32_t cx = x0; cx <= x1; cx++) {
+        for (int32_t cy = y0; cy <= y1; cy++) {
+            auto itf = cells.find(Key(cx, cy));
+            if (itf != cells.end())
+                out.insert(out.end(), itf->second.begin(), itf->second.end());
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "entity.h"
+
+// Uniform grid over the unbounded arena, addressed by hashed cell coordinates.
+// Every entity is registered in all cells its square (x +- size, y +- size)
+// overlaps, so two touching entities always share a cell. Entities are tracked
+// by their index in the entity vector and only re-registered when their cell
+// range changes. Entities too big for the grid go to a list every query sees.
+class SpatialHash {
+public:
+    explicit SpatialHash (float cellSize) : cellSize(cellSize) {}
+
+    void Update (const std::vector<Entity>& entities);
+    void Update (const std::vector<Entity>& entities, size_t idx);
+
+    // appends indices of entities that may overlap the cells [x0, x1] x [y0, y1], possibly with duplicates
+    void Query (int32_t x0, int32_t y0, int32_t x1, int32_t y1, std::vector<uint32_t>& out) const;
+
+    int32_t Cell (float v) const;
+    // entities this big span too many cells for the grid to help
+    bool IsOversized (const Entity& e) const;
+
+private:
+    struct CellRange {
+        int32_t x0 = 0, y0 = 0, x1 = -1, y1 = -1;
+        bool oversized = false;
+
+        bool operator== (const CellRange&) const = default;
+    };
+
+    static constexpr int32_t maxCellsPerAxis = 8;
+
+    CellRange RangeOf (const Entity& e) const;
+    static uint64_t Key (int32_t cx, int32_t cy);
+    void Insert (const CellRange& range, uint32_t idx);
+    void Remove (const CellRange& range, uint32_t idx);
+
+    float cellSize;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+    std::vector<uint32_t> oversized;
+    std::vector<CellRange> entityRanges;
+};
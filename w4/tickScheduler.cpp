@@ -0,0 +1,58 @@
+#include "tickScheduler.h"
+#include <cstdio>
+#include <thread>
+#if defined(__linux__)
+#include <errno.h>
+#include <time.h>
+#endif
+
+TickScheduler::TickScheduler (uint32_t tickMs, uint32_t maxCatchUpTicks)
+    : tickMs(tickMs)
+    , maxCatchUpTicks(maxCatchUpTicks > 0 ? maxCatchUpTicks : 1)
+    , period(std::chrono::milliseconds(tickMs))
+    , nextTick(Clock::now() + period) {}
+
+uint32_t TickScheduler::ServiceTimeout () const {
+    const Clock::time_point now = Clock::now();
+    if (now >= nextTick) return 0;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(nextTick - now).count();
+}
+
+void TickScheduler::Wait () const {
+#if defined(__linux__)
+    // libstdc++ and libc++ both back steady_clock with CLOCK_MONOTONIC
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(nextTick.time_since_epoch()).count();
+    timespec deadline;
+    deadline.tv_sec = ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {}
+#else
+    std::this_thread::sleep_until(nextTick);
+#endif
+}
+
+uint32_t TickScheduler::Advance () {
+    const Clock::time_point now = Clock::now();
+    if (now < nextTick) return 0;
+
+    const double lateMs = std::chrono::duration<double, std::milli>(now - nextTick).count();
+    stats.wakeUps++;
+    stats.sumLateMs += lateMs;
+    if (lateMs > stats.maxLateMs) stats.maxLateMs = lateMs;
+
+    const uint32_t due = 1 + static_cast<uint32_t>((now - nextTick) / period);
+    const uint32_t steps = due < maxCatchUpTicks ? due : maxCatchUpTicks;
+    if (due > 1) stats.overruns++;
+    stats.droppedTicks += due - steps;
+    stats.ticks += steps;
+    nextTick += due * period;
+    return steps;
+}
+
+void TickScheduler::PrintStats () {
+    printf("Ticks %llu, late avg %.3f ms max %.3f ms, overruns %llu, dropped %llu\n",
+           static_cast<unsigned long long>(stats.ticks),
+           stats.wakeUps ? stats.sumLateMs / stats.wakeUps : 0.0, stats.maxLateMs,
+           static_cast<unsigned long long>(stats.overruns), static_cast<unsigned long long>(stats.droppedTicks));
+    stats = TickStats();
+}
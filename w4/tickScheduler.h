@@ -0,0 +1,40 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+struct TickStats {
+    uint64_t ticks = 0;
+    uint64_t wakeUps = 0;
+    uint64_t overruns = 0;     // wake ups that found more than one tick due
+    uint64_t droppedTicks = 0; // ticks skipped past the catch up limit
+    double sumLateMs = 0.0;
+    double maxLateMs = 0.0;
+};
+
+// Fixed timestep clock for the server loop, so the loop sleeps between ticks
+// instead of spinning: Wait() for the tick, then run Advance() steps of Dt()
+// seconds. A loop servicing ENet itself blocks in enet_host_service for
+// ServiceTimeout() ms first; the server leaves that to its HostThread.
+class TickScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TickScheduler (uint32_t tickMs, uint32_t maxCatchUpTicks);
+
+    uint32_t ServiceTimeout () const;
+    void Wait () const;
+    // steps due now, capped at maxCatchUpTicks; the rest are dropped
+    uint32_t Advance ();
+
+    float Dt () const { return tickMs * 0.001f; }
+    const TickStats& Stats () const { return stats; }
+    // prints the stats gathered since the last call and starts over
+    void PrintStats ();
+
+private:
+    uint32_t tickMs;
+    uint32_t maxCatchUpTicks;
+    Clock::duration period;
+    Clock::time_point nextTick;
+    TickStats stats;
+};
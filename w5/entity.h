@@ -23,6 +23,7 @@ struct Entity {
         float x = 0.f;
         float y = 0.f;
         float ori = 0.f;
+        float speed = 0.f;
 
         uint32_t physFrame;
     };
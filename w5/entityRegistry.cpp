@@ -0,0 +1,60 @@
+#include "entityRegistry.h"
+
+uint16_t EntityRegistry::Create() {
+    size_t slot = 0;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else if (m_slots.size() < MAX_ENTITIES) {
+        slot = m_slots.size();
+        m_slots.emplace_back();
+    } else {
+        return Entity::invalid;
+    }
+
+    m_slots[slot].dense = m_denseIds.size();
+    const uint16_t eid = static_cast<uint16_t>(slot);
+    m_denseIds.push_back(eid);
+    return eid;
+}
+
+size_t EntityRegistry::Find(uint16_t eid) const {
+    if (eid >= m_slots.size()) {
+        return NPOS;
+    }
+    const Slot& s = m_slots[eid];
+    return s.dense == static_cast<uint32_t>(NPOS) ? NPOS : s.dense;
+}
+
+size_t EntityRegistry::Destroy(uint16_t eid) {
+    const size_t idx = Find(eid);
+    if (idx == NPOS) {
+        return NPOS;
+    }
+
+    const uint16_t moved = m_denseIds.back();
+    m_denseIds[idx] = moved;
+    m_denseIds.pop_back();
+    m_slots[moved].dense = idx;
+
+    Slot& s = m_slots[eid];
+    s.dense = static_cast<uint32_t>(NPOS);
+    s.generation++;
+    m_freeSlots.push_back(eid);
+    return idx;
+}
+
+EntityHandle EntityRegistry::Handle(uint16_t eid) const {
+    EntityHandle handle;
+    if (Find(eid) == NPOS) {
+        return handle;
+    }
+    handle.eid = eid;
+    handle.generation = m_slots[eid].generation;
+    return handle;
+}
+
+size_t EntityRegistry::Find(EntityHandle handle) const {
+    const size_t idx = Find(handle.eid);
+    return idx != NPOS && m_slots[handle.eid].generation == handle.generation ? idx : NPOS;
+}
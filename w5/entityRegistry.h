@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "entity.h"
+
+// Slot map handing out entity ids and resolving them to indices in the
+// server's entity vector in O(1). An id is just its slot, so every one of the
+// 16 bits on the wire addresses entities. Generations live on the server only:
+// an EntityHandle is an id plus the generation it was taken at, and stops
+// resolving once that entity is destroyed, even after its slot is reused. Ids
+// from clients are checked for being live; which ones a peer may use is up to
+// the caller.
+struct EntityHandle {
+    uint16_t eid = Entity::invalid;
+    uint32_t generation = 0;
+};
+
+class EntityRegistry {
+public:
+    static constexpr size_t NPOS = static_cast<size_t>(-1);
+    static constexpr int SLOT_BITS = 16;
+    static constexpr uint16_t SLOT_MASK = static_cast<uint16_t>((1u << SLOT_BITS) - 1);
+    // one slot short, so that no id can come out as Entity::invalid
+    static constexpr size_t MAX_ENTITIES = SLOT_MASK;
+
+    // id of a new entity at index Size() - 1, Entity::invalid if full
+    uint16_t Create();
+    // index for a live id, NPOS for anything else including garbage from the network
+    size_t Find(uint16_t eid) const;
+    // the last entity takes the place of the removed one at the returned index
+    size_t Destroy(uint16_t eid);
+
+    // handle for a live id, one with Entity::invalid otherwise
+    EntityHandle Handle(uint16_t eid) const;
+    // index of the entity the handle was taken for, NPOS once it is gone
+    size_t Find(EntityHandle handle) const;
+
+    size_t Size() const { return m_denseIds.size(); }
+
+private:
+    struct Slot {
+        uint32_t dense = static_cast<uint32_t>(NPOS);
+        uint32_t generation = 0;
+    };
+
+    std::vector<Slot> m_slots;
+    std::vector<uint16_t> m_freeSlots;
+    std::vector<uint16_t> m_denseIds;
+};
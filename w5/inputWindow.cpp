@@ -0,0 +1,28 @@
+#include "inputWindow.h"
+
+bool InputWindow::Sample(uint32_t frame, float thr, float steer) {
+    if (m_sampled && frame == m_lastFrame) {
+        return false;
+    }
+
+    if (!m_sampled || thr != m_lastThr || steer != m_lastSteer) {
+        m_repeatsLeft = INPUT_WINDOW_SIZE;
+    }
+    m_sampled = true;
+    m_lastFrame = frame;
+    m_lastThr = thr;
+    m_lastSteer = steer;
+    if (m_repeatsLeft == 0) {
+        return false;
+    }
+    m_repeatsLeft--;
+
+    if (m_count == INPUT_WINDOW_SIZE) {
+        for (size_t i = 1; i < m_count; ++i) {
+            m_window[i - 1] = m_window[i];
+        }
+        m_count--;
+    }
+    m_window[m_count++] = {frame, thr, steer};
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+
+// Input send stage of the client. Input is sampled at most once per simulation
+// frame, every packet carries the last INPUT_WINDOW_SIZE samples tagged with
+// their frames, and an unchanged input stops being sent once a full window of
+// packets has carried it.
+class InputWindow {
+public:
+    // true if a packet with Samples()/Size() should go out for this frame
+    bool Sample(uint32_t frame, float thr, float steer);
+
+    const InputSample* Samples() const { return m_window; }
+    size_t Size() const { return m_count; }
+
+private:
+    bool m_sampled = false;
+    uint32_t m_lastFrame = 0;
+    size_t m_repeatsLeft = 0;
+    float m_lastThr = 0.f;
+    float m_lastSteer = 0.f;
+    InputSample m_window[INPUT_WINDOW_SIZE]; // oldest first
+    size_t m_count = 0;
+};
@@ -0,0 +1,73 @@
+#include "interpolationDelay.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "entity.h"
+
+namespace {
+    const float MIN_DELAY = 1.f;
+    const float MAX_DELAY = 20.f;
+    // the next snapshot is normally a frame after the one being shown
+    const float SNAPSHOT_INTERVAL = 1.f;
+    const float JITTER_SCALE = 3.f;
+    // the delay changes by at most this share of the elapsed time, i.e. 5% time scaling
+    const float MAX_SLEW = 0.05f;
+    const float LATENESS_GAIN = 1.f / 16.f;
+    const float JITTER_GAIN = 1.f / 16.f;
+    const float LOSS_GAIN = 1.f / 32.f;
+    // a longer gap is a stall or a resync rather than loss
+    const uint32_t MAX_COUNTED_GAP = 32;
+    // cover losses in a row until a run this likely
+    const float LOSS_RUN_PROBABILITY = 0.01f;
+    const float MAX_LOSS_FRAMES = 5.f;
+}
+
+void InterpolationDelay::Reset() {
+    *this = InterpolationDelay();
+}
+
+void InterpolationDelay::OnSnapshot(uint32_t serverFrame, double arrivalFrame, uint32_t rttVarianceMs) {
+    m_rttJitter = 0.5f * rttVarianceMs / update;
+    // every entity's snapshot of a frame comes in one burst, only the first one says anything
+    if (m_hasFrame && static_cast<int32_t>(serverFrame - m_lastFrame) <= 0) {
+        return;
+    }
+
+    const float lateness = static_cast<float>(arrivalFrame - serverFrame);
+    if (!m_hasFrame) {
+        m_hasFrame = true;
+        m_lateness = lateness;
+    } else {
+        const uint32_t step = serverFrame - m_lastFrame;
+        const float transitChange = static_cast<float>(arrivalFrame - m_lastArrival) - step;
+        m_jitter += (fabsf(transitChange) - m_jitter) * JITTER_GAIN;
+        m_lateness += (lateness - m_lateness) * LATENESS_GAIN;
+        // one loss sample per server frame, not per snapshot received
+        for (uint32_t missed = 1; missed < std::min(step, MAX_COUNTED_GAP); ++missed) {
+            m_loss += (1.f - m_loss) * LOSS_GAIN;
+        }
+        m_loss -= m_loss * LOSS_GAIN;
+    }
+    m_lastFrame = serverFrame;
+    m_lastArrival = arrivalFrame;
+}
+
+float InterpolationDelay::TargetDelay() const {
+    if (!m_hasFrame) {
+        return INITIAL_DELAY;
+    }
+    float lossFrames = 0.f;
+    if (m_loss > LOSS_RUN_PROBABILITY) {
+        lossFrames = std::min(ceilf(logf(LOSS_RUN_PROBABILITY) / logf(m_loss)), MAX_LOSS_FRAMES);
+    }
+    const float jitter = std::max(m_jitter, m_rttJitter);
+    const float target = m_lateness + SNAPSHOT_INTERVAL + JITTER_SCALE * jitter + lossFrames;
+    return std::clamp(target, MIN_DELAY, MAX_DELAY);
+}
+
+float InterpolationDelay::Update(float elapsedFrames) {
+    const float maxStep = MAX_SLEW * elapsedFrames;
+    m_delay += std::clamp(TargetDelay() - m_delay, -maxStep, maxStep);
+    return m_delay;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+
+// Render delay for interpolated entities, in frames. Snapshot arrival times give
+// how late snapshots are on average, how much that varies and how many get lost;
+// the target delay is just enough to have the next snapshot in hand nearly always.
+// The actual delay slides towards the target a few percent of a frame per frame,
+// so the rendered timeline only speeds up or slows down slightly and never jumps.
+class InterpolationDelay {
+public:
+    // what the client used before it had any measurements
+    static constexpr float INITIAL_DELAY = 10.f;
+
+    // forget everything measured, for when the client clock is resynced
+    void Reset();
+    // a snapshot for serverFrame arrived when the client clock read arrivalFrame;
+    // rttVarianceMs is the peer's roundTripTimeVariance, a floor for the jitter estimate
+    void OnSnapshot(uint32_t serverFrame, double arrivalFrame, uint32_t rttVarianceMs);
+    // moves the delay towards the target for elapsedFrames of client time and returns it
+    float Update(float elapsedFrames);
+
+    float Delay() const { return m_delay; }
+    float TargetDelay() const;
+    float Jitter() const { return m_jitter; }
+    float Loss() const { return m_loss; }
+
+private:
+    bool m_hasFrame = false;
+    uint32_t m_lastFrame = 0;
+    double m_lastArrival = 0.0; // frame numbers are too large for float precision
+    float m_lateness = 0.f; // arrival frame - server frame, smoothed
+    float m_jitter = 0.f;   // smoothed variation of that, as in RFC 3550
+    float m_rttJitter = 0.f;
+    float m_loss = 0.f;     // share of server frames whose snapshots never arrived
+    float m_delay = INITIAL_DELAY;
+};
@@ -0,0 +1,325 @@
+#include "linkEmulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+    // ENet never puts more than this in one datagram
+    const size_t MAX_DATAGRAM = ENET_PROTOCOL_MAXIMUM_MTU;
+    // longest the thread sleeps with nothing due, so that Stop() is noticed
+    const double MAX_WAIT_MS = 5.0;
+    // a loadgen host with 64 bots sends in bursts
+    const int SOCKET_BUFFER_SIZE = 1 << 20;
+}
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool set_direction_key(LinkDirection& direction, const std::string& key, double value) {
+    if (key == "delay") {
+        direction.delayMs = value;
+    } else if (key == "jitter") {
+        direction.jitterMs = value;
+    } else if (key == "loss") {
+        direction.loss = value;
+    } else if (key == "dup") {
+        direction.duplicate = value;
+    } else if (key == "reorder") {
+        direction.reorder = value;
+    } else if (key == "reorder_delay") {
+        direction.reorderMs = value;
+    } else if (key == "rate") {
+        direction.bytesPerSecond = value;
+    } else if (key == "queue") {
+        direction.queueMs = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_link_config(const char* spec, LinkConfig& config) {
+    const std::string text(spec);
+    size_t start = 0;
+    while (start <= text.size()) {
+        const size_t end = std::min(text.find(',', start), text.size());
+        const std::string item = text.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) {
+            continue;
+        }
+        const size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            printf("Link setting '%s' is not key=value\n", item.c_str());
+            return false;
+        }
+        const std::string key = item.substr(0, equals);
+        const char* valueText = item.c_str() + equals + 1;
+        char* valueEnd = nullptr;
+        const double value = strtod(valueText, &valueEnd);
+        if (valueEnd == valueText || *valueEnd != '\0' || value < 0.0) {
+            printf("Link setting '%s' needs a non-negative number\n", item.c_str());
+            return false;
+        }
+
+        bool known = false;
+        if (key == "seed") {
+            config.seed = static_cast<uint32_t>(value);
+            known = true;
+        } else if (key.rfind("up.", 0) == 0) {
+            known = set_direction_key(config.up, key.substr(3), value);
+        } else if (key.rfind("down.", 0) == 0) {
+            known = set_direction_key(config.down, key.substr(5), value);
+        } else {
+            known = set_direction_key(config.up, key, value) && set_direction_key(config.down, key, value);
+        }
+        if (!known) {
+            printf("Unknown link setting '%s'\n", key.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+LinkCounters LinkEmulator::AtomicCounters::Load() const {
+    LinkCounters counters;
+    counters.datagrams = datagrams.load(std::memory_order_relaxed);
+    counters.lost = lost.load(std::memory_order_relaxed);
+    counters.duplicated = duplicated.load(std::memory_order_relaxed);
+    counters.reordered = reordered.load(std::memory_order_relaxed);
+    counters.overflowed = overflowed.load(std::memory_order_relaxed);
+    return counters;
+}
+
+bool LinkEmulator::IsLater(const Datagram& a, const Datagram& b) {
+    return a.due > b.due || (a.due == b.due && a.order > b.order);
+}
+
+LinkEmulator::LinkEmulator(const ENetAddress& server, const LinkConfig& config)
+    : m_server(server), m_config(config) {
+}
+
+LinkEmulator::~LinkEmulator() {
+    Stop();
+}
+
+bool LinkEmulator::Start() {
+    if (m_running.load()) {
+        return true;
+    }
+    m_socket = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+    if (m_socket == ENET_SOCKET_NULL) {
+        return false;
+    }
+    ENetAddress local;
+    enet_address_set_host(&local, "127.0.0.1");
+    local.port = 0;
+    if (enet_socket_bind(m_socket, &local) < 0 || enet_socket_get_address(m_socket, &m_localAddress) < 0) {
+        enet_socket_destroy(m_socket);
+        m_socket = ENET_SOCKET_NULL;
+        return false;
+    }
+    enet_socket_set_option(m_socket, ENET_SOCKOPT_NONBLOCK, 1);
+    enet_socket_set_option(m_socket, ENET_SOCKOPT_RCVBUF, SOCKET_BUFFER_SIZE);
+    enet_socket_set_option(m_socket, ENET_SOCKOPT_SNDBUF, SOCKET_BUFFER_SIZE);
+
+    m_running.store(true);
+    m_thread = std::thread(&LinkEmulator::Run, this);
+    return true;
+}
+
+void LinkEmulator::Stop() {
+    m_running.store(false);
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    for (Flow& flow : m_flows) {
+        enet_socket_destroy(flow.upstream);
+    }
+    m_flows.clear();
+    m_flowByClient.clear();
+    m_queue.clear();
+    if (m_socket != ENET_SOCKET_NULL) {
+        enet_socket_destroy(m_socket);
+        m_socket = ENET_SOCKET_NULL;
+    }
+}
+
+void LinkEmulator::Run() {
+    while (m_running.load(std::memory_order_relaxed)) {
+        ENetSocketSet readable;
+        ENET_SOCKETSET_EMPTY(readable);
+        ENET_SOCKETSET_ADD(readable, m_socket);
+        ENetSocket maxSocket = m_socket;
+        for (const Flow& flow : m_flows) {
+            ENET_SOCKETSET_ADD(readable, flow.upstream);
+            maxSocket = std::max(maxSocket, flow.upstream);
+        }
+        if (enet_socketset_select(maxSocket, &readable, nullptr, WaitTimeout(now_ms())) < 0) {
+            ENET_SOCKETSET_EMPTY(readable);
+        }
+
+        const double now = now_ms();
+        // flows added by ReceiveClients() weren't selected on and are skipped until the next round
+        const size_t selectedFlows = m_flows.size();
+        if (ENET_SOCKETSET_CHECK(readable, m_socket)) {
+            ReceiveClients(now);
+        }
+        for (size_t i = 0; i < selectedFlows; ++i) {
+            if (ENET_SOCKETSET_CHECK(readable, m_flows[i].upstream)) {
+                ReceiveServer(i, now);
+            }
+        }
+        Deliver(now);
+    }
+}
+
+uint32_t LinkEmulator::WaitTimeout(double now) const {
+    double timeout = MAX_WAIT_MS;
+    if (!m_queue.empty()) {
+        timeout = std::clamp(m_queue.front().due - now, 0.0, MAX_WAIT_MS);
+    }
+    return static_cast<uint32_t>(std::ceil(timeout));
+}
+
+void LinkEmulator::ReceiveClients(double now) {
+    uint8_t data[MAX_DATAGRAM];
+    ENetBuffer buffer;
+    buffer.data = data;
+    buffer.dataLength = sizeof(data);
+    ENetAddress from;
+    int length = 0;
+    while ((length = enet_socket_receive(m_socket, &from, &buffer, 1)) > 0) {
+        size_t flow = 0;
+        if (FindFlow(from, flow)) {
+            Schedule(flow, UP, data, static_cast<size_t>(length), now);
+        }
+    }
+}
+
+void LinkEmulator::ReceiveServer(size_t flow, double now) {
+    uint8_t data[MAX_DATAGRAM];
+    ENetBuffer buffer;
+    buffer.data = data;
+    buffer.dataLength = sizeof(data);
+    ENetAddress from;
+    int length = 0;
+    while ((length = enet_socket_receive(m_flows[flow].upstream, &from, &buffer, 1)) > 0) {
+        Schedule(flow, DOWN, data, static_cast<size_t>(length), now);
+    }
+}
+
+bool LinkEmulator::FindFlow(const ENetAddress& client, size_t& flow) {
+    const uint64_t key = static_cast<uint64_t>(client.host) << 16 | client.port;
+    auto it = m_flowByClient.find(key);
+    if (it != m_flowByClient.end()) {
+        flow = it->second;
+        return true;
+    }
+
+    ENetSocket upstream = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+    if (upstream == ENET_SOCKET_NULL) {
+        return false;
+    }
+    ENetAddress any;
+    any.host = ENET_HOST_ANY;
+    any.port = 0;
+    if (enet_socket_bind(upstream, &any) < 0) {
+        enet_socket_destroy(upstream);
+        return false;
+    }
+    enet_socket_set_option(upstream, ENET_SOCKOPT_NONBLOCK, 1);
+    enet_socket_set_option(upstream, ENET_SOCKOPT_RCVBUF, SOCKET_BUFFER_SIZE);
+    enet_socket_set_option(upstream, ENET_SOCKOPT_SNDBUF, SOCKET_BUFFER_SIZE);
+
+    flow = m_flows.size();
+    Flow& created = m_flows.emplace_back();
+    created.client = client;
+    created.upstream = upstream;
+    // flows are numbered in the order clients first sent something
+    for (uint32_t direction = UP; direction <= DOWN; ++direction) {
+        std::seed_seq seed{m_config.seed, static_cast<uint32_t>(flow), direction};
+        created.directions[direction].rng.seed(seed);
+    }
+    m_flowByClient[key] = flow;
+    return true;
+}
+
+void LinkEmulator::Schedule(size_t flow, Direction direction, const uint8_t* data, size_t length, double now) {
+    const LinkDirection& link = direction == UP ? m_config.up : m_config.down;
+    AtomicCounters& counters = direction == UP ? m_up : m_down;
+    DirectionState& state = m_flows[flow].directions[direction];
+
+    // the same draws for every datagram whatever becomes of it, so that one
+    // datagram's fate doesn't shift the random numbers of all the later ones
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::uniform_real_distribution<double> spread(-1.0, 1.0);
+    const bool lost = chance(state.rng) < link.loss;
+    const bool duplicated = chance(state.rng) < link.duplicate;
+    const bool reordered = chance(state.rng) < link.reorder;
+    const double jitter[2] = {spread(state.rng) * link.jitterMs, spread(state.rng) * link.jitterMs};
+
+    counters.datagrams.fetch_add(1, std::memory_order_relaxed);
+    if (lost) {
+        counters.lost.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (duplicated) {
+        counters.duplicated.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (reordered) {
+        counters.reordered.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const int copies = duplicated ? 2 : 1;
+    for (int copy = 0; copy < copies; ++copy) {
+        // with a cap the datagram leaves once everything before it is on the link
+        double departure = now;
+        if (link.bytesPerSecond > 0.0) {
+            const double start = std::max(now, state.linkFreeAt);
+            if (start - now > link.queueMs) {
+                counters.overflowed.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            state.linkFreeAt = start + length * 1000.0 / link.bytesPerSecond;
+            departure = state.linkFreeAt;
+        }
+
+        Datagram datagram;
+        datagram.due = departure + std::max(0.0, link.delayMs + jitter[copy]);
+        if (reordered && copy == 0) {
+            datagram.due += link.reorderMs;
+        }
+        datagram.order = m_scheduled++;
+        datagram.flow = flow;
+        datagram.direction = direction;
+        datagram.data.assign(data, data + length);
+        m_queue.push_back(std::move(datagram));
+        std::push_heap(m_queue.begin(), m_queue.end(), IsLater);
+    }
+}
+
+void LinkEmulator::Deliver(double now) {
+    while (!m_queue.empty() && m_queue.front().due <= now) {
+        std::pop_heap(m_queue.begin(), m_queue.end(), IsLater);
+        const Datagram datagram = std::move(m_queue.back());
+        m_queue.pop_back();
+
+        const Flow& flow = m_flows[datagram.flow];
+        ENetBuffer buffer;
+        buffer.data = const_cast<uint8_t*>(datagram.data.data());
+        buffer.dataLength = datagram.data.size();
+        // a full socket buffer loses the datagram, as the network would
+        if (datagram.direction == UP) {
+            enet_socket_send(flow.upstream, &m_server, &buffer, 1);
+        } else {
+            enet_socket_send(m_socket, &flow.client, &buffer, 1);
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <enet/enet.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+// What one direction of the emulated link does to every datagram.
+struct LinkDirection {
+    double delayMs = 0.0;
+    // uniform in [-jitterMs, jitterMs] on top of the delay, so as with netem jitter alone reorders
+    double jitterMs = 0.0;
+    // fractions of datagrams
+    double loss = 0.0;
+    double duplicate = 0.0;
+    double reorder = 0.0;
+    // a reordered datagram is held back this much longer than the ones around it
+    double reorderMs = 10.0;
+    // 0 is unlimited
+    double bytesPerSecond = 0.0;
+    // with a bandwidth cap, datagrams that would wait longer than this to go out are dropped
+    double queueMs = 100.0;
+};
+
+struct LinkConfig {
+    LinkDirection up;   // client to server
+    LinkDirection down; // server to client
+    uint32_t seed = 1;
+};
+
+// Parses "delay=75,jitter=5,loss=0.1,rate=50000,seed=3": keys without a prefix
+// set both directions, "up." or "down." set one. Keys are delay, jitter, loss,
+// dup, reorder, reorder_delay, rate (bytes/s), queue (ms) and seed.
+bool parse_link_config(const char* spec, LinkConfig& config);
+
+struct LinkCounters {
+    uint64_t datagrams = 0; // everything that came in, delivered or not
+    uint64_t lost = 0;
+    uint64_t duplicated = 0;
+    uint64_t reordered = 0;
+    uint64_t overflowed = 0; // dropped by the bandwidth cap's queue
+};
+
+// A bad network inside the process, for testing on machines where shaping the
+// real one takes root (netshape.sh) or isn't possible at all. It is a UDP relay
+// on the loopback: clients connect their ENet hosts to LocalAddress() instead of
+// the server and every datagram either way is delayed, lost, duplicated and
+// rate limited on the emulator's own thread before being passed on.
+//
+// Every client socket gets its own link with its own upstream socket, so the
+// server still sees one address per client. What happens to the n-th datagram
+// in a direction of a link depends only on the seed and n, so a run with the
+// same seed and the same traffic loses, duplicates and holds back the same
+// datagrams by the same amounts. Delays are kept to within about a millisecond.
+class LinkEmulator {
+public:
+    LinkEmulator(const ENetAddress& server, const LinkConfig& config);
+    ~LinkEmulator();
+
+    // binds the loopback port and starts relaying
+    bool Start();
+    void Stop();
+
+    // where clients connect to instead of the server, valid after Start()
+    const ENetAddress& LocalAddress() const { return m_localAddress; }
+
+    LinkCounters UpCounters() const { return m_up.Load(); }
+    LinkCounters DownCounters() const { return m_down.Load(); }
+
+private:
+    enum Direction : uint8_t {
+        UP,
+        DOWN
+    };
+
+    struct DirectionState {
+        std::mt19937 rng;
+        // when the last queued datagram has been fully put on the capped link
+        double linkFreeAt = 0.0;
+    };
+
+    struct Flow {
+        ENetAddress client = {};
+        ENetSocket upstream = ENET_SOCKET_NULL;
+        DirectionState directions[2];
+    };
+
+    struct Datagram {
+        double due = 0.0;
+        // ties go in the order the datagrams were scheduled
+        uint64_t order = 0;
+        size_t flow = 0;
+        Direction direction = UP;
+        std::vector<uint8_t> data;
+    };
+
+    struct AtomicCounters {
+        std::atomic<uint64_t> datagrams{0};
+        std::atomic<uint64_t> lost{0};
+        std::atomic<uint64_t> duplicated{0};
+        std::atomic<uint64_t> reordered{0};
+        std::atomic<uint64_t> overflowed{0};
+
+        LinkCounters Load() const;
+    };
+
+    // for a min heap on due, equal ones in the order they were scheduled
+    static bool IsLater(const Datagram& a, const Datagram& b);
+
+    void Run();
+    uint32_t WaitTimeout(double now) const;
+    void ReceiveClients(double now);
+    void ReceiveServer(size_t flow, double now);
+    bool FindFlow(const ENetAddress& client, size_t& flow);
+    void Schedule(size_t flow, Direction direction, const uint8_t* data, size_t length, double now);
+    void Deliver(double now);
+
+    ENetAddress m_server;
+    LinkConfig m_config;
+    ENetSocket m_socket = ENET_SOCKET_NULL;
+    ENetAddress m_localAddress = {};
+    // only touched on the emulator's thread from Start() to Stop()
+    std::vector<Flow> m_flows;
+    std::map<uint64_t, size_t> m_flowByClient;
+    std::vector<Datagram> m_queue; // a min heap on due
+    uint64_t m_scheduled = 0;
+    AtomicCounters m_up;
+    AtomicCounters m_down;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+};
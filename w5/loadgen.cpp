@@ -0,0 +1,164 @@
+// Headless load generator for the w5 server: many scripted bots from one process,
+// each its own ENet peer playing the same protocol as the w5 client. The loop,
+// stats and report are common/loadgenCore's, this is the w5 protocol side.
+// usage: loadgen [bots] [seconds] [host] [port] [link]
+// link puts an emulated network between the bots and the server, one link per
+// host of 64 bots; see parse_link_config() for the syntax.
+#include <enet/enet.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <memory>
+
+#include "entity.h"
+#include "protocol.h"
+#include "packetPool.h"
+#include "inputWindow.h"
+#include "linkEmulator.h"
+#include "loadgenCore.h"
+
+namespace {
+    // same as the client, inputs are sent this many frames past a round trip ahead
+    const uint32_t INPUT_LEAD_MARGIN = 2;
+    // how long a bot keeps its scripted input before picking another one
+    const int MIN_INPUT_HOLD_MS = 250;
+    const int MAX_INPUT_HOLD_MS = 2000;
+}
+
+class Bot : public LoadBot {
+public:
+    explicit Bot(uint32_t seed) : m_rng(seed) {}
+
+    void on_connect() override {
+        send_join(peer);
+    }
+
+    void on_disconnect() override {
+        m_eid = Entity::invalid;
+    }
+
+    void on_receive(ENetPacket* packet, double arrival, LoadStats& stats) override {
+        switch (get_packet_type(packet)) {
+            case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY: {
+                uint32_t time = 0;
+                deserialize_set_controlled_entity(packet, m_eid, time);
+                break;
+            }
+            case E_SERVER_TO_CLIENT_SNAPSHOT: {
+                uint16_t eid = Entity::invalid;
+                float x = 0.f, y = 0.f, ori = 0.f, speed = 0.f;
+                uint32_t frame = 0;
+                deserialize_snapshot(packet, eid, x, y, ori, speed, frame);
+                stats.snapshots++;
+                stats.latency.add(SnapshotLatency(frame, arrival));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void drive(double now) override {
+        if (m_eid == Entity::invalid) {
+            return;
+        }
+        if (now >= m_nextInputChange) {
+            std::uniform_int_distribution<int> axis(-1, 1);
+            std::uniform_int_distribution<int> hold(MIN_INPUT_HOLD_MS, MAX_INPUT_HOLD_MS);
+            m_thr = static_cast<float>(axis(m_rng));
+            m_steer = static_cast<float>(axis(m_rng));
+            m_nextInputChange = now + hold(m_rng);
+        }
+        // the server derives frames from the same clock, and inputs for frames it
+        // has already simulated still apply from its current one
+        const uint32_t lead = (peer->roundTripTime + update - 1) / update + INPUT_LEAD_MARGIN;
+        const uint32_t frame = enet_time_get() / update + lead;
+        if (m_inputWindow.Sample(frame, m_thr, m_steer)) {
+            send_entity_input(peer, m_eid, m_inputWindow.Samples(), m_inputWindow.Size());
+        }
+    }
+
+    bool playing() const override { return m_eid != Entity::invalid; }
+
+private:
+    // Time from the server frame to its snapshot being handled. Frames are update ms
+    // apart on the server clock, so arrival minus frame * update is the delay plus a
+    // constant clock offset. The smallest such value seen is taken to be a delivery
+    // of half the lowest round trip and everything else is measured against it.
+    double SnapshotLatency(uint32_t frame, double arrival) {
+        if (!m_hasFrame) {
+            m_hasFrame = true;
+            m_firstFrame = frame;
+            m_fastestOffset = arrival;
+        }
+        const double offset = arrival - static_cast<int32_t>(frame - m_firstFrame) * static_cast<double>(update);
+        m_fastestOffset = std::min(m_fastestOffset, offset);
+        return peer->lowestRoundTripTime * 0.5 + (offset - m_fastestOffset);
+    }
+
+    uint16_t m_eid = Entity::invalid;
+    InputWindow m_inputWindow;
+    std::mt19937 m_rng;
+    double m_nextInputChange = 0.0;
+    float m_thr = 0.f;
+    float m_steer = 0.f;
+    // snapshot frames and arrivals, see SnapshotLatency()
+    bool m_hasFrame = false;
+    uint32_t m_firstFrame = 0;
+    double m_fastestOffset = 0.0;
+};
+
+static void print_link(const char* direction, const LinkCounters& counters) {
+    printf("link %s: %llu datagrams, %llu lost, %llu over the rate, %llu duplicated, %llu reordered\n", direction,
+           static_cast<unsigned long long>(counters.datagrams), static_cast<unsigned long long>(counters.lost),
+           static_cast<unsigned long long>(counters.overflowed), static_cast<unsigned long long>(counters.duplicated),
+           static_cast<unsigned long long>(counters.reordered));
+}
+
+int main(int argc, const char** argv) {
+    LoadgenOptions options;
+    parse_loadgen_options(argc, argv, options);
+    const char* linkSpec = argc > 5 ? argv[5] : nullptr;
+
+    if (packet_pool_initialize() != 0) {
+        printf("Cannot init ENet");
+        return 1;
+    }
+
+    ENetAddress address;
+    if (enet_address_set_host(&address, options.hostName) != 0) {
+        printf("Cannot resolve %s\n", options.hostName);
+        return 1;
+    }
+    address.port = options.port;
+
+    std::unique_ptr<LinkEmulator> link;
+    if (linkSpec) {
+        LinkConfig config;
+        if (!parse_link_config(linkSpec, config)) {
+            return 1;
+        }
+        link = std::make_unique<LinkEmulator>(address, config);
+        if (!link->Start()) {
+            printf("Cannot start the link emulator\n");
+            return 1;
+        }
+        address = link->LocalAddress();
+        printf("Emulated link: %s\n", linkSpec);
+    }
+
+    const int result = run_loadgen(options, address, [](size_t index) {
+        return std::make_unique<Bot>(static_cast<uint32_t>(index));
+    });
+
+    if (link) {
+        print_link("up", link->UpCounters());
+        print_link("down", link->DownCounters());
+        link->Stop();
+    }
+
+    atexit(enet_deinitialize);
+    return result;
+}
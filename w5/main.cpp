@@ -2,20 +2,34 @@
 #include <enet/enet.h>
 #include <math.h>
 #include <cstdio>
-#include <deque>
-#include <queue>
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include "entity.h"
 #include "protocol.h"
+#include "packetPool.h"
+#include "inputWindow.h"
+#include "ringBuffer.h"
+#include "reconciler.h"
+#include "interpolationDelay.h"
+#include "networkThread.h"
+#include "linkEmulator.h"
 
 namespace {
-    const uint32_t PREDICTION_WINDOW = 10;
     const int INITIAL_WINDOW_WIDTH = 600;
     const int INITIAL_WINDOW_HEIGHT = 600;
     const float CAMERA_ZOOM = 10.0f;
-    const size_t MAX_HISTORY_SIZE = 200;
+    // extra frames the prediction runs ahead of the server on top of the round trip
+    const uint32_t INPUT_LEAD_MARGIN = 2;
+    // snapshots come every frame and are held back by at most 20 frames of interpolation delay
+    const size_t MAX_PENDING_STATES = 32;
+    // how far past the last snapshot an entity keeps moving before it stops and waits
+    const float MAX_EXTRAPOLATION_FRAMES = 5.f;
     const Color BACKGROUND_COLOR = GRAY;
+    // how often the prediction and link stats are printed when running over an emulated link
+    const uint32_t LINK_REPORT_INTERVAL_MS = 1000;
 }
 
 
@@ -24,35 +38,69 @@ class GameClient {
     GameClient();
     ~GameClient();
     
-    bool InitializeNetwork();
+    // linkSpec, if given, puts an emulated link between us and the server, see parse_link_config()
+    bool InitializeNetwork(const char* linkSpec);
     void Run();
     
 private:
+    using PendingStates = RingQueue<Entity::State, MAX_PENDING_STATES>;
+
     struct GameState {
-        std::map<uint16_t, std::queue<Entity::State>> pendingStates;
+        // indexed by eid, grown when entities arrive
+        std::vector<PendingStates> pendingStates;
         std::map<uint16_t, Entity> entities;
-        std::deque<Entity::State> stateHistory;
-        Entity::State correction = {0, 0, 0};
         uint16_t controlledEntityId = Entity::invalid;
+        // remote entities are shown as of this frame, server time as seen by the client
         uint32_t currentFrame = 0;
-        int historyBeginFrame = 0;
+        // currentFrame with the fraction of the frame already passed, double because
+        // frames count from the epoch and float can't tell neighbouring ones apart
+        double clockFrame = 0.0;
+        // enet_time_get() clockFrame was taken at
+        uint32_t clockTime = 0;
+        // remote entities are drawn as of this frame, clockFrame minus the interpolation delay
+        double renderFrame = 0.0;
+        // the controlled entity is predicted up to this frame, far enough ahead that
+        // its inputs reach the server before the server simulates their frames
+        uint32_t predictedFrame = 0;
+    };
+
+    // what the server's states for the controlled entity did to the prediction
+    struct PredictionStats {
+        uint64_t reconciled = 0;
+        uint64_t mispredicted = 0;   // reconciled, but with frames to replay
+        uint64_t replayedFrames = 0;
+        uint64_t resets = 0;         // the server was past everything predicted
     };
     
     void ProcessNetworkEvents();
     void ProcessPlayerInput();
-    void UpdateEntities(int deltaFrames);
-    void RenderFrame(int deltaFrames);
-    void HandleNewEntity(ENetPacket* packet);
-    void HandleControlledEntity(ENetPacket* packet);
-    void HandleSnapshot(ENetPacket* packet);
+    void UpdateEntities();
+    void RenderFrame();
+    void HandleNewEntity(const NetMessage& message);
+    void HandleControlledEntity(const NetMessage& message);
+    void HandleSnapshot(const NetMessage& message);
     
-    void ApplyCorrection(const Entity::State& historicalState, const Entity::State& serverState);
+    PendingStates* FindPendingStates(uint16_t entityId);
+    uint32_t PredictionLead() const;
+    void ReconcileControlledEntity(const Entity::State& serverState);
     void UpdateEntityInterpolation(Entity& entity, float& renderX, float& renderY, float& renderOri);
-    void UpdateControlledEntity(Entity& entity, int deltaFrames);
+    void ExtrapolateEntity(const Entity& entity, float& renderX, float& renderY, float& renderOri);
+    void PrintLinkReport();
     
     GameState m_state;
+    Reconciler m_reconciler;
+    InterpolationDelay m_interpolationDelay;
+    InputWindow m_inputWindow;
     ENetHost* m_client = nullptr;
+    // a handle for addressing messages, the network thread owns the peer itself
     ENetPeer* m_serverPeer = nullptr;
+    std::unique_ptr<NetworkThread> m_network;
+    std::unique_ptr<LinkEmulator> m_link;
+    PredictionStats m_predictionStats;
+    uint32_t m_lastLinkReport = 0;
+    // as of the latest message from the server
+    uint32_t m_roundTripTime = 0;
+    uint32_t m_roundTripTimeVariance = 0;
     Camera2D m_camera;
     bool m_isConnected = false;
 };
@@ -80,14 +128,20 @@ GameClient::GameClient() {
 }
 
 GameClient::~GameClient() {
+    if (m_network) {
+        m_network->Stop();
+    }
     if (m_client) {
         enet_host_destroy(m_client);
     }
+    if (m_link) {
+        m_link->Stop();
+    }
     CloseWindow();
 }
 
-bool GameClient::InitializeNetwork() {
-    if (enet_initialize() != 0) {
+bool GameClient::InitializeNetwork(const char* linkSpec) {
+    if (packet_pool_initialize() != 0) {
         printf("Failed to initialize ENet\n");
         return false;
     }
@@ -103,12 +157,30 @@ bool GameClient::InitializeNetwork() {
     enet_address_set_host(&address, "localhost");
     address.port = 10131;
 
+    if (linkSpec) {
+        LinkConfig config;
+        if (!parse_link_config(linkSpec, config)) {
+            return false;
+        }
+        m_link = std::make_unique<LinkEmulator>(address, config);
+        if (!m_link->Start()) {
+            printf("Failed to start the link emulator\n");
+            return false;
+        }
+        // the emulator relays to the server, the host only ever talks to it
+        address = m_link->LocalAddress();
+        printf("Emulated link: %s\n", linkSpec);
+    }
+
     m_serverPeer = enet_host_connect(m_client, &address, 2, 0);
     if (!m_serverPeer) {
         printf("Failed to connect to server\n");
         return false;
     }
-    
+
+    // from here on only the network thread touches the host
+    m_network = std::make_unique<NetworkThread>(m_client);
+    m_network->Start();
     return true;
 }
 
@@ -120,43 +192,55 @@ void GameClient::Run() {
         const int deltaFrames = static_cast<int>(currentTime / update) - static_cast<int>(lastTime / update);
         
         m_state.currentFrame += deltaFrames;
+        m_state.predictedFrame += deltaFrames;
+        m_state.clockFrame = m_state.currentFrame + static_cast<double>(currentTime % update) / update;
+        m_state.clockTime = currentTime;
         
         ProcessNetworkEvents();
         ProcessPlayerInput();
-        UpdateEntities(deltaFrames);
+        const float delay = m_interpolationDelay.Update(static_cast<float>(currentTime - lastTime) / update);
+        m_state.renderFrame = m_state.clockFrame - delay;
+        UpdateEntities();
         
         BeginDrawing();
         ClearBackground(BACKGROUND_COLOR);
-        RenderFrame(deltaFrames);
+        RenderFrame();
         EndDrawing();
         
+        if (m_link && currentTime - m_lastLinkReport >= LINK_REPORT_INTERVAL_MS) {
+            PrintLinkReport();
+            m_lastLinkReport = currentTime;
+        }
         lastTime = currentTime;
     }
 }
 
 void GameClient::ProcessNetworkEvents() {
-    ENetEvent event;
-    while (enet_host_service(m_client, &event, 0) > 0) {
-        switch (event.type) {
-            case ENET_EVENT_TYPE_CONNECT:
-                printf("Connected to %x:%u\n", event.peer->address.host, event.peer->address.port);
-                send_join(m_serverPeer);
+    NetMessage message;
+    while (m_network->Receive(message)) {
+        m_roundTripTime = message.roundTripTime;
+        m_roundTripTimeVariance = message.roundTripTimeVariance;
+        switch (message.event) {
+            case NetMessage::CONNECTED:
+                printf("Connected to %x:%u\n", message.address.host, message.address.port);
+                m_network->SendJoin(m_serverPeer);
                 m_isConnected = true;
                 break;
                 
-            case ENET_EVENT_TYPE_RECEIVE:
-                switch (get_packet_type(event.packet)) {
+            case NetMessage::RECEIVED:
+                switch (message.type) {
                     case E_SERVER_TO_CLIENT_NEW_ENTITY:
-                        HandleNewEntity(event.packet);
+                        HandleNewEntity(message);
                         break;
                     case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
-                        HandleControlledEntity(event.packet);
+                        HandleControlledEntity(message);
                         break;
                     case E_SERVER_TO_CLIENT_SNAPSHOT:
-                        HandleSnapshot(event.packet);
+                        HandleSnapshot(message);
+                        break;
+                    default:
                         break;
                 }
-                enet_packet_destroy(event.packet);
                 break;
                 
             default:
@@ -165,106 +249,153 @@ void GameClient::ProcessNetworkEvents() {
     }
 }
 
-void GameClient::HandleNewEntity(ENetPacket* packet) {
-    Entity newEntity;
-    deserialize_new_entity(packet, newEntity);
+void GameClient::HandleNewEntity(const NetMessage& message) {
+    const Entity& newEntity = message.entity;
     m_state.entities[newEntity.eid] = newEntity;
+
+    if (newEntity.eid >= m_state.pendingStates.size()) {
+        m_state.pendingStates.resize(newEntity.eid + 1);
+    }
+    m_state.pendingStates[newEntity.eid].Clear();
 }
 
-void GameClient::HandleControlledEntity(ENetPacket* packet) {
-    uint32_t serverTime;
-    deserialize_set_controlled_entity(packet, m_state.controlledEntityId, serverTime);
-    m_state.currentFrame = serverTime / update;
-    m_state.historyBeginFrame = m_state.currentFrame;
+void GameClient::HandleControlledEntity(const NetMessage& message) {
+    m_state.controlledEntityId = message.eid;
+    m_state.currentFrame = message.time / update;
+    m_state.predictedFrame = m_state.currentFrame + PredictionLead();
+    // the entity we got with it is the server's state as of currentFrame
+    m_reconciler.Reset(m_state.entities[m_state.controlledEntityId], m_state.currentFrame);
+    // arrival times measured against the old clock mean nothing now
+    m_interpolationDelay.Reset();
 }
 
-void GameClient::HandleSnapshot(ENetPacket* packet) {
-    uint16_t entityId = Entity::invalid;
-    Entity::State state;
-    deserialize_snapshot(packet, entityId, state.x, state.y, state.ori, state.physFrame);
-    
-    state.physFrame += PREDICTION_WINDOW;
+uint32_t GameClient::PredictionLead() const {
+    return (m_roundTripTime + update - 1) / update + INPUT_LEAD_MARGIN;
+}
+
+GameClient::PendingStates* GameClient::FindPendingStates(uint16_t entityId) {
+    return entityId < m_state.pendingStates.size() ? &m_state.pendingStates[entityId] : nullptr;
+}
+
+void GameClient::HandleSnapshot(const NetMessage& message) {
+    const uint16_t entityId = message.eid;
+    const Entity::State& state = message.state;
+    if (m_reconciler.Started()) {
+        // when the network thread got it, not when this frame came round to it
+        const double arrivalFrame = m_state.clockFrame - static_cast<double>(static_cast<int32_t>(m_state.clockTime - message.receivedAt)) / update;
+        m_interpolationDelay.OnSnapshot(state.physFrame, arrivalFrame, m_roundTripTimeVariance);
+    }
+    if (entityId == m_state.controlledEntityId) {
+        ReconcileControlledEntity(state);
+        return;
+    }
     
-    if (m_state.currentFrame < state.physFrame) {
-        m_state.pendingStates[entityId].push(state);
-    } 
-    else if (state.physFrame - PREDICTION_WINDOW >= m_state.historyBeginFrame && 
-             entityId == m_state.controlledEntityId) {
-        const auto& historicalState = m_state.stateHistory[state.physFrame - PREDICTION_WINDOW - m_state.historyBeginFrame];
-        ApplyCorrection(historicalState, state);
+    PendingStates* pending = FindPendingStates(entityId);
+    if (!pending) {
+        return;
+    }
+    if (m_state.renderFrame < state.physFrame) {
+        pending->Push(state);
+        return;
+    }
+    // too late to interpolate to, but still fresher than what an idle entity is extrapolating from
+    auto it = m_state.entities.find(entityId);
+    if (pending->Empty() && it != m_state.entities.end() && static_cast<int32_t>(state.physFrame - it->second.physFrame) > 0) {
+        it->second.x = state.x;
+        it->second.y = state.y;
+        it->second.ori = state.ori;
+        it->second.speed = state.speed;
+        it->second.physFrame = state.physFrame;
     }
 }
 
-void GameClient::ApplyCorrection(const Entity::State& historicalState, const Entity::State& serverState) {
-    m_state.correction.x += historicalState.x - serverState.x;
-    m_state.correction.y += historicalState.y - serverState.y;
-    m_state.correction.ori += historicalState.ori - serverState.ori;
+void GameClient::ReconcileControlledEntity(const Entity::State& serverState) {
+    if (!m_reconciler.Started()) {
+        return;
+    }
+    Entity& entity = m_state.entities[m_state.controlledEntityId];
+    const int replayed = m_reconciler.Reconcile(entity, serverState);
+    if (replayed >= 0) {
+        m_predictionStats.reconciled++;
+        m_predictionStats.mispredicted += replayed > 0;
+        m_predictionStats.replayedFrames += replayed;
+        return;
+    }
+    // the server is past everything we predicted, so our inputs reach it late: take its state and run further ahead
+    if (static_cast<int32_t>(serverState.physFrame - m_reconciler.Frame()) > 0) {
+        entity.x = serverState.x;
+        entity.y = serverState.y;
+        entity.ori = serverState.ori;
+        entity.speed = serverState.speed;
+        m_reconciler.Reset(entity, serverState.physFrame);
+        m_state.predictedFrame = serverState.physFrame + PredictionLead();
+        m_predictionStats.resets++;
+    }
+}
+
+void GameClient::PrintLinkReport() {
+    const LinkCounters up = m_link->UpCounters();
+    const LinkCounters down = m_link->DownCounters();
+    const PredictionStats& p = m_predictionStats;
+    printf("rtt %u+-%u ms, link up %llu lost %llu dup %llu reordered %llu, down %llu lost %llu dup %llu reordered %llu; "
+           "prediction %llu states, %llu mispredicted, %llu frames replayed, %llu resets\n",
+           m_roundTripTime, m_roundTripTimeVariance,
+           static_cast<unsigned long long>(up.datagrams), static_cast<unsigned long long>(up.lost + up.overflowed),
+           static_cast<unsigned long long>(up.duplicated), static_cast<unsigned long long>(up.reordered),
+           static_cast<unsigned long long>(down.datagrams), static_cast<unsigned long long>(down.lost + down.overflowed),
+           static_cast<unsigned long long>(down.duplicated), static_cast<unsigned long long>(down.reordered),
+           static_cast<unsigned long long>(p.reconciled), static_cast<unsigned long long>(p.mispredicted),
+           static_cast<unsigned long long>(p.replayedFrames), static_cast<unsigned long long>(p.resets));
 }
 
 void GameClient::ProcessPlayerInput() {
-    if (m_state.controlledEntityId == Entity::invalid) return;
+    if (m_state.controlledEntityId == Entity::invalid || !m_reconciler.Started()) return;
+    // input is per simulated frame, nothing to do until the clock reaches a new one
+    if (static_cast<int32_t>(m_state.predictedFrame - m_reconciler.Frame()) <= 0) return;
 
     const float thr = IsKeyDown(KEY_UP) ? 1.0f : (IsKeyDown(KEY_DOWN) ? -1.0f : 0.0f);
     const float steer = IsKeyDown(KEY_LEFT) ? -1.0f : (IsKeyDown(KEY_RIGHT) ? 1.0f : 0.0f);
     
-    auto& entity = m_state.entities[m_state.controlledEntityId];
-    entity.thr = thr;
-    entity.steer = steer;
-    
-    send_entity_input(m_serverPeer, m_state.controlledEntityId, thr, steer);
+    // the server applies an input from its frame on, the same way the prediction does
+    if (m_inputWindow.Sample(m_reconciler.Frame() + 1, thr, steer)) {
+        m_network->SendEntityInput(m_serverPeer, m_state.controlledEntityId, m_inputWindow.Samples(), m_inputWindow.Size());
+    }
+    m_reconciler.Advance(m_state.entities[m_state.controlledEntityId], m_state.predictedFrame, thr, steer);
 }
 
-void GameClient::UpdateEntities(int deltaFrames) {
+void GameClient::UpdateEntities() {
     for (auto& [entityId, entity] : m_state.entities) {
-        auto& stateQueue = m_state.pendingStates[entityId];
-
-        if (entityId == m_state.controlledEntityId && m_state.historyBeginFrame > 0 && deltaFrames > 0) {
-            UpdateControlledEntity(entity, deltaFrames);
-        }
-
-        while (!stateQueue.empty() && stateQueue.front().physFrame <= m_state.currentFrame) {
-            const auto& nextState = stateQueue.front();
+        PendingStates* stateQueue = FindPendingStates(entityId);
+        while (stateQueue && !stateQueue->Empty() && stateQueue->Front().physFrame <= m_state.renderFrame) {
+            const auto& nextState = stateQueue->Front();
             
             entity.x = nextState.x;
             entity.y = nextState.y;
             entity.ori = nextState.ori;
+            entity.speed = nextState.speed;
             entity.physFrame = nextState.physFrame;
             
-            m_state.correction = {0, 0, 0};
-            stateQueue.pop();
-        }
-    }
-}
-
-void GameClient::UpdateControlledEntity(Entity& entity, int deltaFrames) {
-    for (int i = 0; i < deltaFrames - 1; i++) {
-        m_state.stateHistory.push_back({entity.x, entity.y, entity.ori});
-        if (m_state.stateHistory.size() > MAX_HISTORY_SIZE) {
-            m_state.stateHistory.pop_front();
-            m_state.historyBeginFrame++;
+            stateQueue->Pop();
         }
     }
 }
 
-void GameClient::RenderFrame(int deltaFrames) {
+void GameClient::RenderFrame() {
     BeginMode2D(m_camera);
     
     for (auto& [entityId, entity] : m_state.entities) {
         float renderX, renderY, renderOri;
         
-        if (!m_state.pendingStates[entityId].empty()) {
+        const PendingStates* pending = FindPendingStates(entityId);
+        if (entityId == m_state.controlledEntityId) {
+            const Entity::State& offset = m_reconciler.VisualOffset();
+            renderX = entity.x + offset.x;
+            renderY = entity.y + offset.y;
+            renderOri = entity.ori + offset.ori;
+        } else if (pending && !pending->Empty()) {
             UpdateEntityInterpolation(entity, renderX, renderY, renderOri);
         } else {
-            if (entityId == m_state.controlledEntityId) {
-                simulate_entity(entity, deltaFrames);
-            }
-            renderX = entity.x + m_state.correction.x;
-            renderY = entity.y + m_state.correction.y;
-            renderOri = entity.ori + m_state.correction.ori;
-        }
-
-        if (entityId == m_state.controlledEntityId && m_state.historyBeginFrame > 0 && deltaFrames > 0) {
-            m_state.stateHistory.push_back({renderX, renderY, renderOri});
+            ExtrapolateEntity(entity, renderX, renderY, renderOri);
         }
         
         const Rectangle rect = {renderX, renderY, 3.0f, 1.0f};
@@ -275,19 +406,29 @@ void GameClient::RenderFrame(int deltaFrames) {
 }
 
 void GameClient::UpdateEntityInterpolation(Entity& entity, float& renderX, float& renderY, float& renderOri) {
-    const auto& nextState = m_state.pendingStates[entity.eid].front();
-    const int totalFrames = nextState.physFrame - entity.physFrame;
-    const int framesToNext = nextState.physFrame - m_state.currentFrame;
-    const int framesFromPrev = m_state.currentFrame - entity.physFrame;
+    const auto& nextState = FindPendingStates(entity.eid)->Front();
+    const double totalFrames = static_cast<double>(nextState.physFrame) - entity.physFrame;
+    // a growing delay can put the render frame back before the last state for a moment
+    const float t = std::clamp(static_cast<float>((m_state.renderFrame - entity.physFrame) / totalFrames), 0.f, 1.f);
     
-    renderX = ((entity.x + m_state.correction.x) * framesToNext + nextState.x * framesFromPrev) / totalFrames;
-    renderY = ((entity.y + m_state.correction.y) * framesToNext + nextState.y * framesFromPrev) / totalFrames;
-    renderOri = ((entity.ori + m_state.correction.ori) * framesToNext + nextState.ori * framesFromPrev) / totalFrames;
+    renderX = entity.x + (nextState.x - entity.x) * t;
+    renderY = entity.y + (nextState.y - entity.y) * t;
+    renderOri = entity.ori + (nextState.ori - entity.ori) * t;
+}
+
+void GameClient::ExtrapolateEntity(const Entity& entity, float& renderX, float& renderY, float& renderOri) {
+    // keep going the way the last snapshot was heading to cover a short gap
+    const float frames = std::clamp(static_cast<float>(m_state.renderFrame - entity.physFrame), 0.f, MAX_EXTRAPOLATION_FRAMES);
+    const float dt = frames * update * 0.001f;
+    renderX = entity.x + cosf(entity.ori) * entity.speed * dt;
+    renderY = entity.y + sinf(entity.ori) * entity.speed * dt;
+    renderOri = entity.ori;
 }
 
+// usage: client [link], e.g. client delay=75,jitter=10,loss=0.05,seed=3
 int main(int argc, const char** argv) {
     GameClient client;
-    if (!client.InitializeNetwork()) {
+    if (!client.InitializeNetwork(argc > 1 ? argv[1] : nullptr)) {
         return EXIT_FAILURE;
     }
     
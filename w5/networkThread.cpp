@@ -0,0 +1,196 @@
+#include "networkThread.h"
+
+namespace {
+    // how long the network thread blocks in enet_host_service before looking at the outgoing queue
+    const uint32_t SERVICE_TIMEOUT_MS = 1;
+}
+
+NetworkThread::NetworkThread(ENetHost* host) : m_host(host) {
+}
+
+NetworkThread::~NetworkThread() {
+    Stop();
+}
+
+void NetworkThread::Start() {
+    if (m_running.exchange(true)) {
+        return;
+    }
+    m_thread = std::thread(&NetworkThread::Run, this);
+}
+
+void NetworkThread::Stop() {
+    m_running.store(false);
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+bool NetworkThread::Receive(NetMessage& message) {
+    return m_incoming.TryPop(message);
+}
+
+void NetworkThread::Post(const NetMessage& message) {
+    // the network thread drains this every millisecond, a full queue is a short wait
+    while (!m_outgoing.TryPush(message)) {
+        std::this_thread::yield();
+    }
+}
+
+void NetworkThread::SendJoin(ENetPeer* peer) {
+    NetMessage message;
+    message.peer = peer;
+    message.type = E_CLIENT_TO_SERVER_JOIN;
+    Post(message);
+}
+
+void NetworkThread::SendNewEntity(ENetPeer* peer, const Entity& ent) {
+    NetMessage message;
+    message.peer = peer;
+    message.type = E_SERVER_TO_CLIENT_NEW_ENTITY;
+    message.entity = ent;
+    Post(message);
+}
+
+void NetworkThread::SendSetControlledEntity(ENetPeer* peer, uint16_t eid, uint32_t time) {
+    NetMessage message;
+    message.peer = peer;
+    message.type = E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY;
+    message.eid = eid;
+    message.time = time;
+    Post(message);
+}
+
+void NetworkThread::SendEntityInput(ENetPeer* peer, uint16_t eid, const InputSample* samples, size_t count) {
+    NetMessage message;
+    message.peer = peer;
+    message.type = E_CLIENT_TO_SERVER_INPUT;
+    message.eid = eid;
+    message.sampleCount = count < INPUT_WINDOW_SIZE ? count : INPUT_WINDOW_SIZE;
+    for (size_t i = 0; i < message.sampleCount; ++i) {
+        message.samples[i] = samples[i];
+    }
+    Post(message);
+}
+
+void NetworkThread::SendSnapshot(ENetPeer* peer, uint16_t eid, const Entity::State& state) {
+    NetMessage message;
+    message.peer = peer;
+    message.type = E_SERVER_TO_CLIENT_SNAPSHOT;
+    message.eid = eid;
+    message.state = state;
+    Post(message);
+}
+
+void NetworkThread::Run() {
+    NetMessage message;
+    while (m_running.load(std::memory_order_relaxed)) {
+        bool sent = false;
+        while (m_outgoing.TryPop(message)) {
+            Dispatch(message);
+            sent = true;
+        }
+        if (sent) {
+            enet_host_flush(m_host);
+        }
+
+        ENetEvent event;
+        int result = enet_host_service(m_host, &event, SERVICE_TIMEOUT_MS);
+        while (result > 0) {
+            Decode(event);
+            result = enet_host_check_events(m_host, &event);
+        }
+    }
+}
+
+void NetworkThread::Dispatch(const NetMessage& message) {
+    if (message.peer) {
+        DispatchTo(message.peer, message);
+        return;
+    }
+    for (size_t i = 0; i < m_host->peerCount; ++i) {
+        ENetPeer* peer = &m_host->peers[i];
+        if (peer->state == ENET_PEER_STATE_CONNECTED) {
+            DispatchTo(peer, message);
+        }
+    }
+}
+
+void NetworkThread::DispatchTo(ENetPeer* peer, const NetMessage& message) {
+    switch (message.type) {
+        case E_CLIENT_TO_SERVER_JOIN:
+            send_join(peer);
+            break;
+        case E_SERVER_TO_CLIENT_NEW_ENTITY:
+            send_new_entity(peer, message.entity);
+            break;
+        case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+            send_set_controlled_entity(peer, message.eid, message.time);
+            break;
+        case E_CLIENT_TO_SERVER_INPUT:
+            send_entity_input(peer, message.eid, message.samples, message.sampleCount);
+            break;
+        case E_SERVER_TO_CLIENT_SNAPSHOT:
+            send_snapshot(peer, message.eid, message.state.x, message.state.y, message.state.ori,
+                          message.state.speed, message.state.physFrame);
+            break;
+    }
+}
+
+void NetworkThread::Deliver(const NetMessage& message) {
+    if (!m_incoming.TryPush(message)) {
+        m_droppedReceives.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void NetworkThread::Decode(const ENetEvent& event) {
+    NetMessage message;
+    message.peer = event.peer;
+    message.address = event.peer->address;
+    message.receivedAt = enet_time_get();
+    message.roundTripTime = event.peer->roundTripTime;
+    message.roundTripTimeVariance = event.peer->roundTripTimeVariance;
+
+    switch (event.type) {
+        case ENET_EVENT_TYPE_CONNECT:
+            message.event = NetMessage::CONNECTED;
+            Deliver(message);
+            return;
+        case ENET_EVENT_TYPE_DISCONNECT:
+            message.event = NetMessage::DISCONNECTED;
+            Deliver(message);
+            return;
+        case ENET_EVENT_TYPE_RECEIVE:
+            break;
+        default:
+            return;
+    }
+
+    message.event = NetMessage::RECEIVED;
+    message.type = get_packet_type(event.packet);
+    bool known = true;
+    switch (message.type) {
+        case E_CLIENT_TO_SERVER_JOIN:
+            break;
+        case E_SERVER_TO_CLIENT_NEW_ENTITY:
+            deserialize_new_entity(event.packet, message.entity);
+            break;
+        case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+            deserialize_set_controlled_entity(event.packet, message.eid, message.time);
+            break;
+        case E_CLIENT_TO_SERVER_INPUT:
+            message.sampleCount = deserialize_entity_input(event.packet, message.eid, message.samples);
+            break;
+        case E_SERVER_TO_CLIENT_SNAPSHOT:
+            deserialize_snapshot(event.packet, message.eid, message.state.x, message.state.y, message.state.ori,
+                                 message.state.speed, message.state.physFrame);
+            break;
+        default:
+            known = false;
+            break;
+    }
+    enet_packet_destroy(event.packet);
+    if (known) {
+        Deliver(message);
+    }
+}
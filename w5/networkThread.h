@@ -0,0 +1,80 @@
+#pragma once
+#include <enet/enet.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "entity.h"
+#include "protocol.h"
+#include "spscQueue.h"
+
+// A received packet or connection event decoded on the network thread, or a
+// message for the network thread to encode and send.
+struct NetMessage {
+    enum Event : uint8_t {
+        RECEIVED,
+        CONNECTED,
+        DISCONNECTED
+    };
+
+    Event event = RECEIVED;
+    // only ever dereferenced on the network thread; nullptr when sending means every connected peer
+    ENetPeer* peer = nullptr;
+    ENetAddress address = {};
+    // enet_time_get() when the network thread got it, and the peer's round trip at that point
+    uint32_t receivedAt = 0;
+    uint32_t roundTripTime = 0;
+    uint32_t roundTripTimeVariance = 0;
+
+    // which of the fields below are used depends on type
+    MessageType type = E_CLIENT_TO_SERVER_JOIN;
+    Entity entity;                  // new entity
+    uint16_t eid = Entity::invalid; // controlled entity, input, snapshot
+    uint32_t time = 0;              // controlled entity
+    Entity::State state;            // snapshot, physFrame is the server frame
+    InputSample samples[INPUT_WINDOW_SIZE];
+    size_t sampleCount = 0;
+};
+
+// Owns an ENetHost on its own thread, so that a slow frame on the game thread
+// doesn't hold up receiving packets and acknowledging them. The game thread
+// talks to it only through two single producer, single consumer queues.
+class NetworkThread {
+public:
+    static const size_t QUEUE_SIZE = 4096;
+
+    // the host must not be used by anyone else between Start() and Stop()
+    explicit NetworkThread(ENetHost* host);
+    ~NetworkThread();
+
+    void Start();
+    void Stop();
+
+    // game thread only
+    bool Receive(NetMessage& message);
+    void SendJoin(ENetPeer* peer);
+    void SendNewEntity(ENetPeer* peer, const Entity& ent);
+    void SendSetControlledEntity(ENetPeer* peer, uint16_t eid, uint32_t time);
+    void SendEntityInput(ENetPeer* peer, uint16_t eid, const InputSample* samples, size_t count);
+    void SendSnapshot(ENetPeer* peer, uint16_t eid, const Entity::State& state);
+
+    // packets thrown away because the game thread wasn't keeping up
+    uint64_t DroppedReceives() const { return m_droppedReceives.load(std::memory_order_relaxed); }
+
+private:
+    void Run();
+    void Post(const NetMessage& message);
+    void Deliver(const NetMessage& message);
+    void Dispatch(const NetMessage& message);
+    void DispatchTo(ENetPeer* peer, const NetMessage& message);
+    void Decode(const ENetEvent& event);
+
+    ENetHost* m_host;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    SpscQueue<NetMessage> m_incoming{QUEUE_SIZE};
+    SpscQueue<NetMessage> m_outgoing{QUEUE_SIZE};
+    std::atomic<uint64_t> m_droppedReceives{0};
+};
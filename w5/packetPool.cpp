@@ -0,0 +1,124 @@
+#include "packetPool.h"
+#include <enet/enet.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+namespace {
+    const size_t CLASS_SIZES[] = {32, 64, 128, 256, 512, 1024, 2048};
+    const uint32_t NUM_CLASSES = sizeof(CLASS_SIZES) / sizeof(CLASS_SIZES[0]);
+    const uint32_t LARGE_CLASS = NUM_CLASSES;
+    // keeps the block behind it aligned the way malloc would
+    const size_t HEADER_SIZE = 16;
+    const size_t BLOCKS_PER_SLAB = 64;
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    struct SizeClass {
+        std::mutex lock;
+        FreeBlock *freeList = nullptr;
+    };
+
+    SizeClass classes[NUM_CLASSES];
+    std::atomic<uint64_t> allocs{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<uint64_t> systemAllocs{0};
+    std::atomic<uint64_t> slabs{0};
+    std::atomic<uint64_t> reservedBytes{0};
+
+    uint32_t class_for(size_t size) {
+        for (uint32_t i = 0; i < NUM_CLASSES; ++i) {
+            if (size <= CLASS_SIZES[i]) {
+                return i;
+            }
+        }
+        return LARGE_CLASS;
+    }
+
+    // called with the class locked
+    bool refill(uint32_t cls) {
+        const size_t stride = HEADER_SIZE + CLASS_SIZES[cls];
+        uint8_t *slab = static_cast<uint8_t *>(malloc(stride * BLOCKS_PER_SLAB));
+        if (!slab) {
+            return false;
+        }
+        systemAllocs.fetch_add(1, std::memory_order_relaxed);
+        slabs.fetch_add(1, std::memory_order_relaxed);
+        reservedBytes.fetch_add(stride * BLOCKS_PER_SLAB, std::memory_order_relaxed);
+        for (size_t i = 0; i < BLOCKS_PER_SLAB; ++i) {
+            FreeBlock *block = reinterpret_cast<FreeBlock *>(slab + i * stride);
+            block->next = classes[cls].freeList;
+            classes[cls].freeList = block;
+        }
+        return true;
+    }
+
+    void *pool_malloc(size_t size) {
+        allocs.fetch_add(1, std::memory_order_relaxed);
+        const uint32_t cls = class_for(size);
+        uint8_t *block = nullptr;
+        if (cls == LARGE_CLASS) {
+            systemAllocs.fetch_add(1, std::memory_order_relaxed);
+            block = static_cast<uint8_t *>(malloc(HEADER_SIZE + size));
+        } else {
+            SizeClass &sizeClass = classes[cls];
+            std::lock_guard<std::mutex> guard(sizeClass.lock);
+            if (sizeClass.freeList || refill(cls)) {
+                block = reinterpret_cast<uint8_t *>(sizeClass.freeList);
+                sizeClass.freeList = sizeClass.freeList->next;
+            }
+        }
+        if (!block) {
+            return nullptr; // ENet calls its no_memory callback
+        }
+        *reinterpret_cast<uint32_t *>(block) = cls;
+        return block + HEADER_SIZE;
+    }
+
+    void pool_free(void *memory) {
+        if (!memory) {
+            return;
+        }
+        frees.fetch_add(1, std::memory_order_relaxed);
+        uint8_t *block = static_cast<uint8_t *>(memory) - HEADER_SIZE;
+        const uint32_t cls = *reinterpret_cast<uint32_t *>(block);
+        if (cls == LARGE_CLASS) {
+            free(block);
+            return;
+        }
+        SizeClass &sizeClass = classes[cls];
+        std::lock_guard<std::mutex> guard(sizeClass.lock);
+        FreeBlock *freed = reinterpret_cast<FreeBlock *>(block);
+        freed->next = sizeClass.freeList;
+        sizeClass.freeList = freed;
+    }
+}
+
+int packet_pool_initialize() {
+    ENetCallbacks callbacks = {pool_malloc, pool_free, nullptr};
+    return enet_initialize_with_callbacks(ENET_VERSION, &callbacks);
+}
+
+PacketPoolStats packet_pool_stats() {
+    PacketPoolStats stats;
+    stats.allocs = allocs.load(std::memory_order_relaxed);
+    stats.frees = frees.load(std::memory_order_relaxed);
+    stats.systemAllocs = systemAllocs.load(std::memory_order_relaxed);
+    stats.slabs = slabs.load(std::memory_order_relaxed);
+    stats.reservedBytes = reservedBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void print_packet_pool_stats(uint64_t ticks) {
+    static PacketPoolStats last;
+    const PacketPoolStats stats = packet_pool_stats();
+    const double perTick = ticks ? 1.0 / ticks : 0.0;
+    printf("Packet pool: %.1f allocs/tick, %.3f mallocs/tick, %llu blocks live, %llu slabs (%llu KiB)\n",
+           (stats.allocs - last.allocs) * perTick, (stats.systemAllocs - last.systemAllocs) * perTick,
+           static_cast<unsigned long long>(stats.allocs - stats.frees), static_cast<unsigned long long>(stats.slabs),
+           static_cast<unsigned long long>(stats.reservedBytes / 1024));
+    last = stats;
+}
@@ -1,5 +1,6 @@
 #include "protocol.h"
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 
@@ -36,24 +37,40 @@ void send_set_controlled_entity(ENetPeer *peer, uint16_t eid, uint32_t time) {
     enet_peer_send(peer, 0, packet);
 }
 
-void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float steer) {
-    ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) + 2 * sizeof(float),
+namespace {
+    const size_t INPUT_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint8_t);
+    const size_t INPUT_SAMPLE_SIZE = sizeof(uint32_t) + 2 * sizeof(float);
+}
+
+// [type][eid][count] then count samples of [frame][thr][steer], oldest first
+void send_entity_input(ENetPeer *peer, uint16_t eid, const InputSample *samples, size_t count) {
+    count = std::min(count, INPUT_WINDOW_SIZE);
+    if (count == 0) {
+        return;
+    }
+    ENetPacket *packet = enet_packet_create(nullptr, INPUT_HEADER_SIZE + count * INPUT_SAMPLE_SIZE,
                                             ENET_PACKET_FLAG_UNSEQUENCED);
     uint8_t *ptr = packet->data;
     *ptr = E_CLIENT_TO_SERVER_INPUT;
     ptr += sizeof(uint8_t);
     memcpy(ptr, &eid, sizeof(uint16_t));
     ptr += sizeof(uint16_t);
-    memcpy(ptr, &thr, sizeof(float));
-    ptr += sizeof(float);
-    memcpy(ptr, &steer, sizeof(float));
-    ptr += sizeof(float);
+    *ptr = static_cast<uint8_t>(count);
+    ptr += sizeof(uint8_t);
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(ptr, &samples[i].frame, sizeof(uint32_t));
+        ptr += sizeof(uint32_t);
+        memcpy(ptr, &samples[i].thr, sizeof(float));
+        ptr += sizeof(float);
+        memcpy(ptr, &samples[i].steer, sizeof(float));
+        ptr += sizeof(float);
+    }
 
     enet_peer_send(peer, 1, packet);
 }
 
-void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, uint32_t time) {
-    ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) + 3 * sizeof(float) + sizeof(uint32_t),
+void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, float speed, uint32_t time) {
+    ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) + 4 * sizeof(float) + sizeof(uint32_t),
                                             ENET_PACKET_FLAG_UNSEQUENCED);
     uint8_t *ptr = packet->data;
     *ptr = E_SERVER_TO_CLIENT_SNAPSHOT;
@@ -66,6 +83,8 @@ void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, ui
     ptr += sizeof(float);
     memcpy(ptr, &ori, sizeof(float));
     ptr += sizeof(float);
+    memcpy(ptr, &speed, sizeof(float));
+    ptr += sizeof(float);
     memcpy(ptr, &time, sizeof(uint32_t));
     ptr += sizeof(uint32_t);
 
@@ -92,18 +111,30 @@ void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid, uint32
     ptr += sizeof(uint32_t);
 }
 
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer) {
+size_t deserialize_entity_input(ENetPacket *packet, uint16_t &eid, InputSample *samples) {
+    eid = Entity::invalid;
+    if (packet->dataLength < INPUT_HEADER_SIZE) {
+        return 0;
+    }
     uint8_t *ptr = packet->data;
     ptr += sizeof(uint8_t);
     eid = *(uint16_t *)(ptr);
     ptr += sizeof(uint16_t);
-    thr = *(float *)(ptr);
-    ptr += sizeof(float);
-    steer = *(float *)(ptr);
-    ptr += sizeof(float);
+    size_t count = *ptr;
+    ptr += sizeof(uint8_t);
+    count = std::min({count, INPUT_WINDOW_SIZE, (packet->dataLength - INPUT_HEADER_SIZE) / INPUT_SAMPLE_SIZE});
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(&samples[i].frame, ptr, sizeof(uint32_t));
+        ptr += sizeof(uint32_t);
+        memcpy(&samples[i].thr, ptr, sizeof(float));
+        ptr += sizeof(float);
+        memcpy(&samples[i].steer, ptr, sizeof(float));
+        ptr += sizeof(float);
+    }
+    return count;
 }
 
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori, uint32_t &time) {
+void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori, float &speed, uint32_t &time) {
     uint8_t *ptr = packet->data;
     ptr += sizeof(uint8_t);
     eid = *(uint16_t *)(ptr);
@@ -114,6 +145,8 @@ void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y,
     ptr += sizeof(float);
     ori = *(float *)(ptr);
     ptr += sizeof(float);
+    speed = *(float *)(ptr);
+    ptr += sizeof(float);
     time = *(uint32_t *)(ptr);
     ptr += sizeof(uint32_t);
 }
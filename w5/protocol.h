@@ -1,6 +1,7 @@
 #pragma once
 #include <enet/enet.h>
 
+#include <cstddef>
 #include <cstdint>
 
 #include "entity.h"
@@ -13,15 +14,26 @@ enum MessageType : uint8_t {
     E_SERVER_TO_CLIENT_SNAPSHOT
 };
 
+// an input packet repeats this many of the latest samples, oldest first
+const size_t INPUT_WINDOW_SIZE = 3;
+
+struct InputSample {
+    uint32_t frame = 0;
+    float thr = 0.f;
+    float steer = 0.f;
+};
+
 void send_join(ENetPeer *peer);
 void send_new_entity(ENetPeer *peer, const Entity &ent);
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid, uint32_t time);
-void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float steer);
-void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, uint32_t time);
+void send_entity_input(ENetPeer *peer, uint16_t eid, const InputSample *samples, size_t count);
+// speed is part of the snapshot because the client resimulates from it
+void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, float speed, uint32_t time);
 
 MessageType get_packet_type(ENetPacket *packet);
 
 void deserialize_new_entity(ENetPacket *packet, Entity &ent);
 void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid, uint32_t& time);
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer);
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori, uint32_t &time);
+// samples needs room for INPUT_WINDOW_SIZE entries, returns how many were read
+size_t deserialize_entity_input(ENetPacket *packet, uint16_t &eid, InputSample *samples);
+void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori, float &speed, uint32_t &time);
@@ -0,0 +1,89 @@
+#include "reconciler.h"
+
+#include <cmath>
+
+namespace {
+    // differences below this are float noise, not a misprediction
+    const float MISPREDICTION_EPSILON = 1e-3f;
+    // share of the visual error left after each frame
+    const float ERROR_DECAY = 0.8f;
+    // errors this large are a teleport, smoothing them would only look like sliding
+    const float SNAP_DISTANCE = 10.f;
+
+    bool NearlyEqual(float a, float b) {
+        return fabsf(a - b) < MISPREDICTION_EPSILON;
+    }
+}
+
+void Reconciler::Reset(const Entity& entity, uint32_t frame) {
+    m_history.Reset(frame);
+    m_offset = {};
+    Record(entity);
+}
+
+void Reconciler::Record(const Entity& entity) {
+    PredictedFrame frame;
+    frame.thr = entity.thr;
+    frame.steer = entity.steer;
+    frame.state = {entity.x, entity.y, entity.ori, entity.speed, m_history.EndFrame()};
+    m_history.Push(frame);
+}
+
+void Reconciler::Advance(Entity& entity, uint32_t targetFrame, float thr, float steer) {
+    if (!Started()) {
+        return;
+    }
+    while (static_cast<int32_t>(targetFrame - Frame()) > 0) {
+        entity.thr = thr;
+        entity.steer = steer;
+        simulate_entity(entity, 1);
+        entity.physFrame = m_history.EndFrame();
+        Record(entity);
+
+        m_offset.x *= ERROR_DECAY;
+        m_offset.y *= ERROR_DECAY;
+        m_offset.ori *= ERROR_DECAY;
+    }
+}
+
+int Reconciler::Reconcile(Entity& entity, const Entity::State& serverState) {
+    PredictedFrame* acked = m_history.Find(serverState.physFrame);
+    if (!acked) {
+        return -1;
+    }
+    const Entity::State& predicted = acked->state;
+    if (NearlyEqual(predicted.x, serverState.x) && NearlyEqual(predicted.y, serverState.y) &&
+        NearlyEqual(predicted.ori, serverState.ori) && NearlyEqual(predicted.speed, serverState.speed)) {
+        return 0;
+    }
+
+    Entity replay = entity;
+    replay.x = serverState.x;
+    replay.y = serverState.y;
+    replay.ori = serverState.ori;
+    replay.speed = serverState.speed;
+    acked->state = serverState;
+
+    int replayed = 0;
+    for (uint32_t frame = serverState.physFrame + 1; frame != m_history.EndFrame(); ++frame) {
+        PredictedFrame& record = *m_history.Find(frame);
+        replay.thr = record.thr;
+        replay.steer = record.steer;
+        simulate_entity(replay, 1);
+        record.state = {replay.x, replay.y, replay.ori, replay.speed, frame};
+        replayed++;
+    }
+
+    m_offset.x += entity.x - replay.x;
+    m_offset.y += entity.y - replay.y;
+    m_offset.ori += entity.ori - replay.ori;
+    if (fabsf(m_offset.x) + fabsf(m_offset.y) > SNAP_DISTANCE) {
+        m_offset = {};
+    }
+
+    entity.x = replay.x;
+    entity.y = replay.y;
+    entity.ori = replay.ori;
+    entity.speed = replay.speed;
+    return replayed;
+}
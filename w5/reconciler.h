@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "entity.h"
+#include "ringBuffer.h"
+
+// Client-side prediction for the controlled entity. Every predicted frame keeps
+// the input it was simulated with and the state it produced; when the server's
+// state for a frame arrives the entity is rewound to it and the recorded inputs
+// are replayed up to the newest frame. The jump this causes is not drawn at once,
+// VisualOffset() fades it out over the following frames.
+class Reconciler {
+public:
+    static const size_t HISTORY_SIZE = 256;
+
+    // the entity's current state becomes frame, the next Advance() starts from frame + 1
+    void Reset(const Entity& entity, uint32_t frame);
+    bool Started() const { return m_history.Started(); }
+    // last predicted frame
+    uint32_t Frame() const { return m_history.EndFrame() - 1; }
+
+    // simulates the frames up to targetFrame with this input
+    void Advance(Entity& entity, uint32_t targetFrame, float thr, float steer);
+    // serverState is the authoritative end of serverState.physFrame; returns the number
+    // of frames replayed, 0 if the prediction was right, -1 if the frame is not in history
+    int Reconcile(Entity& entity, const Entity::State& serverState);
+
+    // add to the entity's position when drawing it
+    const Entity::State& VisualOffset() const { return m_offset; }
+
+private:
+    struct PredictedFrame {
+        float thr = 0.f;
+        float steer = 0.f;
+        Entity::State state;
+    };
+
+    void Record(const Entity& entity);
+
+    FrameRing<PredictedFrame, HISTORY_SIZE> m_history;
+    Entity::State m_offset;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-capacity FIFO. When full, pushing overwrites the oldest element, so a
+// burst of packets can never make it grow or allocate.
+template <typename T, size_t CAPACITY>
+class RingQueue {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+public:
+    void Push(const T& value) {
+        if (m_size == CAPACITY) {
+            Pop();
+        }
+        m_items[(m_head + m_size) & (CAPACITY - 1)] = value;
+        m_size++;
+    }
+
+    void Pop() {
+        m_head = (m_head + 1) & (CAPACITY - 1);
+        m_size--;
+    }
+
+    void Clear() {
+        m_head = 0;
+        m_size = 0;
+    }
+
+    const T& Front() const { return m_items[m_head]; }
+    bool Empty() const { return m_size == 0; }
+    size_t Size() const { return m_size; }
+
+private:
+    std::array<T, CAPACITY> m_items{};
+    size_t m_head = 0;
+    size_t m_size = 0;
+};
+
+// Fixed-capacity history of per-frame values, frame N lives in slot N % CAPACITY.
+// Holds the last CAPACITY frames pushed; older ones are overwritten in place.
+template <typename T, size_t CAPACITY>
+class FrameRing {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // the next Push() stores frame beginFrame
+    void Reset(uint32_t beginFrame) {
+        m_beginFrame = beginFrame;
+        m_endFrame = beginFrame;
+        m_started = true;
+    }
+
+    void Push(const T& value) {
+        m_items[m_endFrame & (CAPACITY - 1)] = value;
+        m_endFrame++;
+        if (m_endFrame - m_beginFrame > CAPACITY) {
+            m_beginFrame = m_endFrame - CAPACITY;
+        }
+    }
+
+    // nullptr if the frame was never pushed or has already been overwritten
+    const T* Find(uint32_t frame) const {
+        if (frame - m_beginFrame >= m_endFrame - m_beginFrame) {
+            return nullptr;
+        }
+        return &m_items[frame & (CAPACITY - 1)];
+    }
+
+    T* Find(uint32_t frame) {
+        return const_cast<T*>(static_cast<const FrameRing*>(this)->Find(frame));
+    }
+
+    // frame the next Push() stores
+    uint32_t EndFrame() const { return m_endFrame; }
+
+    bool Started() const { return m_started; }
+
+private:
+    std::array<T, CAPACITY> m_items{};
+    uint32_t m_beginFrame = 0;
+    uint32_t m_endFrame = 0;
+    bool m_started = false;
+};
@@ -10,54 +10,97 @@
 #include "entity.h"
 #include "mathUtils.h"
 #include "protocol.h"
-
-#include <windows.h>
-void usleep(int64_t usec) {
-    HANDLE timer;
-    LARGE_INTEGER ft;
-    ft.QuadPart = -(10*usec);
-    timer = CreateWaitableTimer(NULL, TRUE, NULL);
-    SetWaitableTimer(timer, &ft, 0, NULL, NULL, 0);
-    WaitForSingleObject(timer, INFINITE);
-    CloseHandle(timer);
+#include "packetPool.h"
+#include "tickScheduler.h"
+#include "entityRegistry.h"
+#include "ringBuffer.h"
+#include "worldHistory.h"
+#include "networkThread.h"
+
+namespace {
+    const uint32_t MAX_CATCH_UP_FRAMES = 5;
+    const uint64_t TICK_STATS_INTERVAL = 500;
+    // clients predict a round trip ahead, so this is how many input changes can be in flight
+    const size_t MAX_QUEUED_INPUTS = 32;
+    // how far back checks made for a client can look
+    const uint32_t HISTORY_FRAMES = 1000 / update;
+    // history is allocated up front for this many, so not for every possible eid;
+    // checks against entities past it find nothing
+    const size_t HISTORY_ENTITIES = 4096;
 }
 
 std::vector<Entity> entities;
+EntityRegistry registry; // eid -> index in entities
+std::vector<RingQueue<InputSample, MAX_QUEUED_INPUTS>> inputQueues; // inputs waiting for their frame, per entity
+std::vector<uint32_t> inputFrames; // frame of the newest received input, per entity
 std::map<uint16_t, ENetPeer*> controlledMap;
+// positions as of past frames, for checks on behalf of clients that saw the world
+// history.FrameSeenBy(frame, message.roundTripTime, <their interpolation delay>) frames ago
+WorldHistory history(HISTORY_FRAMES, HISTORY_ENTITIES);
 uint32_t frame = 0;
 
-void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host) {
+void on_join(const NetMessage &message, NetworkThread &network) {
+    ENetPeer *peer = message.peer;
     for (Entity &ent : entities) {
         ent.physFrame = frame;
-        send_new_entity(peer, ent);
+        network.SendNewEntity(peer, ent);
     }
 
-    uint16_t maxEid = entities.empty() ? Entity::invalid : entities[0].eid;
-    for (const Entity &e : entities) maxEid = std::max(maxEid, e.eid);
-    uint16_t newEid = maxEid + 1;
+    uint16_t newEid = registry.Create();
+    if (newEid == Entity::invalid) {
+        printf("No free entity slots for %x:%u\n", message.address.host, message.address.port);
+        return;
+    }
     uint32_t color = 0xff000000 + 0x00440000 * (rand() % 5) + 0x00004400 * (rand() % 5) + 0x00000044 * (rand() % 5);
     float x = (rand() % 4) * 5.f;
     float y = (rand() % 4) * 5.f;
     Entity ent = {color, x, y, 0.f, (rand() / RAND_MAX) * 3.141592654f, 0.f, 0.f, newEid, frame};
     entities.push_back(ent);
+    inputFrames.resize(entities.size());
+    inputFrames[registry.Find(newEid)] = 0;
+    inputQueues.resize(entities.size());
+    inputQueues[registry.Find(newEid)].Clear();
 
     controlledMap[newEid] = peer;
 
-    for (size_t i = 0; i < host->peerCount; i++) send_new_entity(&host->peers[i], ent);
-    send_set_controlled_entity(peer, newEid, enet_time_get());
+    network.SendNewEntity(nullptr, ent);
+    network.SendSetControlledEntity(peer, newEid, enet_time_get());
 }
 
-void on_input(ENetPacket *packet) {
-    uint16_t eid = Entity::invalid;
-    float thr = 0.f;
-    float steer = 0.f;
-    deserialize_entity_input(packet, eid, thr, steer);
-    entities[eid].thr = thr;
-    entities[eid].steer = steer;
+void on_input(const NetMessage &message) {
+    const uint16_t eid = message.eid;
+    const InputSample *samples = message.samples;
+    const size_t count = message.sampleCount;
+    // the eid is whatever the client sent, it must be live and belong to this peer
+    const size_t idx = registry.Find(eid);
+    auto controller = controlledMap.find(eid);
+    if (count == 0 || idx == EntityRegistry::NPOS || controller == controlledMap.end() || controller->second != message.peer) {
+        return;
+    }
+
+    // the client predicts with every input from its own frame on, so queue them all until the
+    // simulation reaches that frame; samples we already have are repeats for lost packets
+    for (size_t i = 0; i < count; ++i) {
+        if (inputFrames[idx] != 0 && samples[i].frame <= inputFrames[idx]) {
+            continue;
+        }
+        inputFrames[idx] = samples[i].frame;
+        inputQueues[idx].Push(samples[i]);
+    }
+}
+
+// inputs that arrived late still apply, just from the current frame instead of their own
+void apply_inputs(size_t idx) {
+    auto &queue = inputQueues[idx];
+    while (!queue.Empty() && queue.Front().frame <= frame) {
+        entities[idx].thr = queue.Front().thr;
+        entities[idx].steer = queue.Front().steer;
+        queue.Pop();
+    }
 }
 
 int main(int argc, const char **argv) {
-    if (enet_initialize() != 0) {
+    if (packet_pool_initialize() != 0) {
         printf("Cannot init ENet");
         return 1;
     }
@@ -66,54 +109,75 @@ int main(int argc, const char **argv) {
     address.host = ENET_HOST_ANY;
     address.port = 10131;
 
-    ENetHost *server = enet_host_create(&address, 32, 2, 0, 0);
+    // as many peers as ENet can address, so loadgen can bring thousands of bots
+    ENetHost *server = enet_host_create(&address, ENET_PROTOCOL_MAXIMUM_PEER_ID, 2, 0, 0);
 
     if (!server) {
         printf("Cannot create ENet server\n");
         return 1;
     }
 
-    uint32_t lastTime = enet_time_get();
-    frame = lastTime / update;
+    printf("World history: %u frames of %zu entities, %zu KiB\n", HISTORY_FRAMES, HISTORY_ENTITIES,
+           history.MemoryUsage() / 1024);
+
+    // receives and acks keep going while a tick runs long
+    NetworkThread network(server);
+    network.Start();
+
+    TickScheduler scheduler(update, MAX_CATCH_UP_FRAMES);
+    frame = enet_time_get() / update;
     while (true) {
-        uint32_t curTime = enet_time_get();
+        scheduler.Wait();
 
-        ENetEvent event;
-        while (enet_host_service(server, &event, 0) > 0) {
-            switch (event.type) {
-                case ENET_EVENT_TYPE_CONNECT:
-                    printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
+        NetMessage message;
+        while (network.Receive(message)) {
+            switch (message.event) {
+                case NetMessage::CONNECTED:
+                    printf("Connection with %x:%u established\n", message.address.host, message.address.port);
                     break;
-                case ENET_EVENT_TYPE_RECEIVE:
-                    switch (get_packet_type(event.packet)) {
+                case NetMessage::RECEIVED:
+                    switch (message.type) {
                         case E_CLIENT_TO_SERVER_JOIN:
-                            on_join(event.packet, event.peer, server);
+                            on_join(message, network);
                             break;
                         case E_CLIENT_TO_SERVER_INPUT:
-                            on_input(event.packet);
+                            on_input(message);
+                            break;
+                        default:
                             break;
                     };
-                    enet_packet_destroy(event.packet);
                     break;
                 default:
                     break;
             };
         }
 
-        int dt = curTime / update - lastTime / update;
-        frame += dt;
-
-        for (Entity &e : entities) {
-            simulate_entity(e, dt);
-            for (size_t i = 0; i < server->peerCount; ++i) {
-                ENetPeer *peer = &server->peers[i];
-                send_snapshot(peer, e.eid, e.x, e.y, e.ori, frame);
+        uint32_t skipped = 0;
+        const uint32_t steps = scheduler.Advance(&skipped);
+        if (steps == 0) {
+            continue;
+        }
+        // frames dropped after a stall still count, clients derive frames from the clock
+        frame += skipped;
+        for (uint32_t step = 0; step < steps; ++step) {
+            frame++;
+            for (size_t i = 0; i < entities.size(); ++i) {
+                apply_inputs(i);
+                simulate_entity(entities[i], 1);
             }
+            history.Record(frame, entities);
+        }
+
+        for (const Entity &e : entities) {
+            network.SendSnapshot(nullptr, e.eid, {e.x, e.y, e.ori, e.speed, frame});
+        }
+        if (scheduler.Stats().ticks >= TICK_STATS_INTERVAL) {
+            print_packet_pool_stats(scheduler.Stats().ticks);
+            scheduler.PrintStats();
         }
-        lastTime = curTime;
-        usleep(100000);
     }
 
+    network.Stop();
     enet_host_destroy(server);
 
     atexit(enet_deinitialize);
@@ -0,0 +1,94 @@
+#include "tickScheduler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <errno.h>
+#include <time.h>
+#endif
+
+TickScheduler::TickScheduler(uint32_t tickMs, uint32_t maxCatchUpTicks)
+    : m_maxCatchUpTicks(maxCatchUpTicks > 0 ? maxCatchUpTicks : 1),
+      m_period(std::chrono::milliseconds(tickMs)),
+      m_nextTick(Clock::now() + m_period) {}
+
+uint32_t TickScheduler::ServiceTimeout() const {
+    const Clock::time_point now = Clock::now();
+    if (now >= m_nextTick) {
+        return 0;
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(m_nextTick - now).count();
+}
+
+void TickScheduler::Wait() const {
+#if defined(_WIN32)
+    // Sleep() rounds up to the 15.6 ms system tick, a high resolution waitable timer doesn't
+    const Clock::time_point now = Clock::now();
+    if (now >= m_nextTick) {
+        return;
+    }
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = -std::chrono::duration_cast<std::chrono::nanoseconds>(m_nextTick - now).count() / 100;
+    HANDLE timer = NULL;
+#ifdef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+    timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+    if (!timer) {
+        timer = CreateWaitableTimer(NULL, TRUE, NULL);
+    }
+    SetWaitableTimer(timer, &dueTime, 0, NULL, NULL, 0);
+    WaitForSingleObject(timer, INFINITE);
+    CloseHandle(timer);
+#elif defined(__linux__)
+    // steady_clock is CLOCK_MONOTONIC, so sleep straight to the absolute deadline
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(m_nextTick.time_since_epoch()).count();
+    timespec deadline;
+    deadline.tv_sec = ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+    }
+#else
+    std::this_thread::sleep_until(m_nextTick);
+#endif
+}
+
+uint32_t TickScheduler::Advance(uint32_t* skipped) {
+    if (skipped) {
+        *skipped = 0;
+    }
+    const Clock::time_point now = Clock::now();
+    if (now < m_nextTick) {
+        return 0;
+    }
+
+    const double lateMs = std::chrono::duration<double, std::milli>(now - m_nextTick).count();
+    m_stats.wakeUps++;
+    m_stats.sumLateMs += lateMs;
+    m_stats.maxLateMs = std::max(m_stats.maxLateMs, lateMs);
+
+    const uint32_t due = 1 + static_cast<uint32_t>((now - m_nextTick) / m_period);
+    const uint32_t steps = std::min(due, m_maxCatchUpTicks);
+    if (due > 1) {
+        m_stats.overruns++;
+    }
+    m_stats.droppedTicks += due - steps;
+    m_stats.ticks += steps;
+    m_nextTick += due * m_period;
+    if (skipped) {
+        *skipped = due - steps;
+    }
+    return steps;
+}
+
+void TickScheduler::PrintStats() {
+    printf("Frames %llu, late avg %.3f ms max %.3f ms, overruns %llu, dropped %llu\n",
+           static_cast<unsigned long long>(m_stats.ticks),
+           m_stats.wakeUps ? m_stats.sumLateMs / m_stats.wakeUps : 0.0, m_stats.maxLateMs,
+           static_cast<unsigned long long>(m_stats.overruns),
+           static_cast<unsigned long long>(m_stats.droppedTicks));
+    m_stats = TickStats();
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+struct TickStats {
+    uint64_t ticks = 0;
+    uint64_t wakeUps = 0;
+    uint64_t overruns = 0;     // wake ups that found more than one frame due
+    uint64_t droppedTicks = 0; // frames skipped past the catch up limit
+    double sumLateMs = 0.0;
+    double maxLateMs = 0.0;
+};
+
+// Steps the server in whole frames of `update` ms. The loop waits in
+// enet_host_service for ServiceTimeout(), sleeps the rest in Wait() and then
+// simulates Advance() frames.
+class TickScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TickScheduler(uint32_t tickMs, uint32_t maxCatchUpTicks);
+
+    uint32_t ServiceTimeout() const;
+    void Wait() const;
+    // Frames to simulate now, at most maxCatchUpTicks. Frames over the limit
+    // are reported in skipped so the frame counter can still follow the clock.
+    uint32_t Advance(uint32_t* skipped = nullptr);
+
+    const TickStats& Stats() const { return m_stats; }
+    void PrintStats();
+
+private:
+    uint32_t m_maxCatchUpTicks;
+    Clock::duration m_period;
+    Clock::time_point m_nextTick;
+    TickStats m_stats;
+};
@@ -0,0 +1,122 @@
+#include "worldHistory.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const float TWO_PI = 6.283185307f;
+    const float ORI_SCALE = 65536.f / TWO_PI;
+
+    uint16_t QuantizeOri(float ori) {
+        float wrapped = fmodf(ori, TWO_PI);
+        if (wrapped < 0.f) {
+            wrapped += TWO_PI;
+        }
+        return static_cast<uint16_t>(static_cast<uint32_t>(nearbyintf(wrapped * ORI_SCALE)) & 0xffff);
+    }
+}
+
+WorldHistory::WorldHistory(uint32_t frames, size_t maxEntities)
+    : m_frames(frames), m_maxEntities(maxEntities),
+      m_sliceFrames(frames, 0), m_counts(frames, 0),
+      m_eids(frames * maxEntities), m_x(frames * maxEntities),
+      m_y(frames * maxEntities), m_ori(frames * maxEntities) {
+}
+
+void WorldHistory::Record(uint32_t frame, const std::vector<Entity>& entities) {
+    const size_t slice = Slice(frame);
+    const size_t count = std::min(entities.size(), m_maxEntities);
+    const size_t base = slice * m_maxEntities;
+    for (size_t i = 0; i < count; ++i) {
+        const Entity& e = entities[i];
+        m_eids[base + i] = e.eid;
+        m_x[base + i] = e.x;
+        m_y[base + i] = e.y;
+        m_ori[base + i] = QuantizeOri(e.ori);
+    }
+    m_sliceFrames[slice] = frame;
+    m_counts[slice] = static_cast<uint32_t>(count);
+    m_latestFrame = frame;
+    m_recorded = true;
+}
+
+bool WorldHistory::HasFrame(uint32_t frame) const {
+    return m_recorded && m_latestFrame - frame < m_frames && m_sliceFrames[Slice(frame)] == frame;
+}
+
+uint32_t WorldHistory::FrameSeenBy(uint32_t currentFrame, uint32_t rttMs, uint32_t interpolationFrames) const {
+    const uint32_t behind = std::min((rttMs + update / 2) / update + interpolationFrames, m_frames - 1);
+    uint32_t frame = currentFrame - behind;
+    // frames skipped while catching up after a stall were never recorded, use the one before
+    while (!HasFrame(frame) && m_latestFrame - frame < m_frames) {
+        frame--;
+    }
+    return HasFrame(frame) ? frame : m_latestFrame;
+}
+
+size_t WorldHistory::FindIndex(size_t slice, uint16_t eid, size_t indexHint) const {
+    const size_t base = slice * m_maxEntities;
+    const size_t count = m_counts[slice];
+    if (indexHint < count && m_eids[base + indexHint] == eid) {
+        return indexHint;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (m_eids[base + i] == eid) {
+            return i;
+        }
+    }
+    return count;
+}
+
+bool WorldHistory::PositionAt(uint32_t frame, uint16_t eid, size_t indexHint, float& x, float& y, float& ori) const {
+    if (!HasFrame(frame)) {
+        return false;
+    }
+    const size_t slice = Slice(frame);
+    const size_t idx = FindIndex(slice, eid, indexHint);
+    if (idx == m_counts[slice]) {
+        return false;
+    }
+    const size_t at = slice * m_maxEntities + idx;
+    x = m_x[at];
+    y = m_y[at];
+    ori = m_ori[at] / ORI_SCALE;
+    return true;
+}
+
+bool WorldHistory::Touches(uint32_t frame, uint16_t eid, size_t indexHint, float x, float y, float radius) const {
+    float ex = 0.f;
+    float ey = 0.f;
+    float ori = 0.f;
+    if (!PositionAt(frame, eid, indexHint, ex, ey, ori)) {
+        return false;
+    }
+    const float dx = ex - x;
+    const float dy = ey - y;
+    return dx * dx + dy * dy <= radius * radius;
+}
+
+void WorldHistory::QueryCircle(uint32_t frame, float x, float y, float radius, std::vector<uint16_t>& eids) const {
+    if (!HasFrame(frame)) {
+        return;
+    }
+    const size_t slice = Slice(frame);
+    const size_t base = slice * m_maxEntities;
+    // two subtracts and multiply-adds per entity over contiguous floats
+    const float r2 = radius * radius;
+    const float* xs = &m_x[base];
+    const float* ys = &m_y[base];
+    for (size_t i = 0; i < m_counts[slice]; ++i) {
+        const float dx = xs[i] - x;
+        const float dy = ys[i] - y;
+        if (dx * dx + dy * dy <= r2) {
+            eids.push_back(m_eids[base + i]);
+        }
+    }
+}
+
+size_t WorldHistory::MemoryUsage() const {
+    return m_sliceFrames.size() * sizeof(uint32_t) + m_counts.size() * sizeof(uint32_t) +
+           m_eids.size() * sizeof(uint16_t) + m_x.size() * sizeof(float) +
+           m_y.size() * sizeof(float) + m_ori.size() * sizeof(uint16_t);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "entity.h"
+
+// Last few hundred milliseconds of the world as the server simulated it, so that
+// a check made on behalf of a client can run against the positions that client
+// was looking at instead of the present ones. One slice per frame, laid out as
+// separate arrays of exact float positions (the w5 world has no bounds) and
+// 16 bit orientations; everything is allocated up front for the given number
+// of frames and entities and never grows.
+class WorldHistory {
+public:
+    WorldHistory(uint32_t frames, size_t maxEntities);
+
+    // entities past maxEntities are not recorded
+    void Record(uint32_t frame, const std::vector<Entity>& entities);
+
+    // frame a client was looking at when its input for currentFrame was sent: a round
+    // trip behind plus its interpolation delay, clamped to what is still recorded
+    uint32_t FrameSeenBy(uint32_t currentFrame, uint32_t rttMs, uint32_t interpolationFrames) const;
+    bool HasFrame(uint32_t frame) const;
+
+    // indexHint is where the entity is now, found in O(1) unless entities were removed since
+    bool PositionAt(uint32_t frame, uint16_t eid, size_t indexHint, float& x, float& y, float& ori) const;
+    bool Touches(uint32_t frame, uint16_t eid, size_t indexHint, float x, float y, float radius) const;
+    // ids of every entity within radius of (x, y) as of frame, appended to eids
+    void QueryCircle(uint32_t frame, float x, float y, float radius, std::vector<uint16_t>& eids) const;
+
+    size_t MemoryUsage() const;
+
+private:
+    size_t Slice(uint32_t frame) const { return frame % m_frames; }
+    size_t FindIndex(size_t slice, uint16_t eid, size_t indexHint) const;
+
+    uint32_t m_frames;
+    size_t m_maxEntities;
+    uint32_t m_latestFrame = 0;
+    bool m_recorded = false;
+
+    // per slice
+    std::vector<uint32_t> m_sliceFrames;
+    std::vector<uint32_t> m_counts;
+    // m_frames * m_maxEntities, slice after slice
+    std::vector<uint16_t> m_eids;
+    std::vector<float> m_x;
+    std::vector<float> m_y;
+    std::vector<uint16_t> m_ori;
+};
@@ -0,0 +1,65 @@
+#include "entityRegistry.h"
+
+uint16_t EntityRegistry::create()
+{
+  size_t slot;
+  if (!freeSlots.empty())
+  {
+    slot = freeSlots.back();
+    freeSlots.pop_back();
+  }
+  else if (slots.size() < max_entities)
+  {
+    slot = slots.size();
+    slots.emplace_back();
+  }
+  else
+    return invalid_entity;
+
+  slots[slot].dense = denseIds.size();
+  uint16_t eid = uint16_t(slot);
+  denseIds.push_back(eid);
+  return eid;
+}
+
+size_t EntityRegistry::find(uint16_t eid) const
+{
+  if (eid >= slots.size())
+    return npos;
+  const Slot &s = slots[eid];
+  return s.dense == uint32_t(npos) ? npos : s.dense;
+}
+
+size_t EntityRegistry::destroy(uint16_t eid)
+{
+  size_t idx = find(eid);
+  if (idx == npos)
+    return npos;
+
+  uint16_t moved = denseIds.back();
+  denseIds[idx] = moved;
+  denseIds.pop_back();
+  slots[moved].dense = idx;
+
+  Slot &s = slots[eid];
+  s.dense = uint32_t(npos);
+  s.generation++;
+  freeSlots.push_back(eid);
+  return idx;
+}
+
+EntityHandle EntityRegistry::handle(uint16_t eid) const
+{
+  EntityHandle h;
+  if (find(eid) == npos)
+    return h;
+  h.eid = eid;
+  h.generation = slots[eid].generation;
+  return h;
+}
+
+size_t EntityRegistry::find(EntityHandle handle) const
+{
+  size_t idx = find(handle.eid);
+  return idx != npos && slots[handle.eid].generation == handle.generation ? idx : npos;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "entity.h"
+
+// Slot map from entity ids to dense array indices. The id is just the slot, so
+// all 16 bits of the eid on the wire address entities. The slot's generation
+// stays on the server: an EntityHandle is an id plus the generation it was
+// taken at, and stops resolving once that entity is destroyed, even after the
+// slot is reused. Ids from the network are only checked for being live, what
+// a peer may do with one is up to the caller (see on_input).
+struct EntityHandle
+{
+  uint16_t eid = invalid_entity;
+  uint32_t generation = 0;
+};
+
+class EntityRegistry
+{
+public:
+  static constexpr size_t npos = size_t(-1);
+  static constexpr int slot_bits = 16;
+  static constexpr uint16_t slot_mask = uint16_t((1u << slot_bits) - 1);
+  // the last slot is never handed out, it is invalid_entity
+  static constexpr size_t max_entities = slot_mask;
+
+  // New id at dense index size() - 1, or invalid_entity when full.
+  uint16_t create();
+  // Dense index of eid, npos for anything that isn't a live id. Safe to call
+  // with ids straight from the network.
+  size_t find(uint16_t eid) const;
+  // Swap-remove: the last dense entry moves into the returned index, so the
+  // caller must move its own arrays the same way. npos if eid isn't live.
+  size_t destroy(uint16_t eid);
+
+  // handle for a live eid, one with invalid_entity otherwise
+  EntityHandle handle(uint16_t eid) const;
+  // dense index of the entity the handle was taken for, npos once it is gone
+  size_t find(EntityHandle handle) const;
+
+  size_t size() const { return denseIds.size(); }
+  uint16_t id_at(size_t idx) const { return denseIds[idx]; }
+
+private:
+  struct Slot
+  {
+    uint32_t dense = uint32_t(npos);
+    uint32_t generation = 0;
+  };
+  std::vector<Slot> slots;
+  std::vector<uint16_t> freeSlots;
+  std::vector<uint16_t> denseIds;
+};
@@ -0,0 +1,26 @@
+#include "inputWindow.h"
+
+bool InputWindow::sample(uint32_t timeMs, float thr, float steer)
+{
+  if (sampled && timeMs - lastSampleTime < intervalMs)
+    return false;
+
+  if (!sampled || thr != lastThr || steer != lastSteer)
+    repeatsLeft = input_window_size;
+  sampled = true;
+  lastThr = thr;
+  lastSteer = steer;
+  if (repeatsLeft == 0)
+    return false;
+  repeatsLeft--;
+  lastSampleTime = timeMs;
+
+  if (count == input_window_size)
+  {
+    for (size_t i = 1; i < count; ++i)
+      window[i - 1] = window[i];
+    count--;
+  }
+  window[count++] = {nextSeq++, thr, steer};
+  return true;
+}
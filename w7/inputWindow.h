@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "protocol.h"
+
+// Client side input send stage. Input is sampled at most once per interval;
+// each packet repeats the last input_window_size samples so one lost packet
+// costs nothing, and once an unchanged input has gone out in a full window of
+// packets nothing more is sent until it changes.
+class InputWindow
+{
+public:
+  explicit InputWindow(uint32_t intervalMs) : intervalMs(intervalMs) {}
+
+  // true if a packet with samples()/size() should be sent now
+  bool sample(uint32_t timeMs, float thr, float steer);
+
+  const InputSample *samples() const { return window; }
+  size_t size() const { return count; }
+
+private:
+  uint32_t intervalMs;
+  uint32_t lastSampleTime = 0;
+  bool sampled = false;
+  uint16_t nextSeq = 1;
+  size_t repeatsLeft = 0;
+  float lastThr = 0.f;
+  float lastSteer = 0.f;
+  InputSample window[input_window_size]; // oldest first
+  size_t count = 0;
+};
@@ -0,0 +1,121 @@
+// Headless load generator for w7_server: many scripted bots from one process,
+// each its own ENet peer playing the same protocol as the w7 client. The loop,
+// stats and report are common/loadgenCore's, this is the w7 protocol side.
+// usage: w7_loadgen [bots] [seconds] [host] [port]
+#include <enet/enet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include "entity.h"
+#include "protocol.h"
+#include "packetPool.h"
+#include "inputWindow.h"
+#include "loadgenCore.h"
+
+// the server ticks every 10 ms and sends all snapshots of a tick at once
+constexpr double tick_ms = 10.0;
+// how long a bot keeps its scripted input before picking another one
+constexpr int min_input_hold_ms = 250;
+constexpr int max_input_hold_ms = 2000;
+
+class Bot : public LoadBot
+{
+public:
+  explicit Bot(uint32_t seed) : rng(seed) {}
+
+  void on_connect() override
+  {
+    send_join(peer);
+  }
+
+  void on_disconnect() override
+  {
+    eid = invalid_entity;
+  }
+
+  void on_receive(ENetPacket *packet, double arrival, LoadStats &stats) override
+  {
+    switch (get_packet_type(packet))
+    {
+    case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+      deserialize_set_controlled_entity(packet, eid);
+      break;
+    case E_SERVER_TO_CLIENT_SNAPSHOT:
+      stats.snapshots++;
+      stats.latency.add(snapshot_latency(arrival));
+      break;
+    default:
+      break;
+    };
+  }
+
+  void drive(double now) override
+  {
+    if (eid == invalid_entity)
+      return;
+    if (now >= nextInputChange)
+    {
+      std::uniform_int_distribution<int> axis(-1, 1);
+      std::uniform_int_distribution<int> hold(min_input_hold_ms, max_input_hold_ms);
+      thr = float(axis(rng));
+      steer = float(axis(rng));
+      nextInputChange = now + hold(rng);
+    }
+    if (inputWindow.sample(enet_time_get(), thr, steer))
+      send_entity_input(peer, eid, inputWindow.samples(), inputWindow.size());
+  }
+
+  bool playing() const override { return eid != invalid_entity; }
+
+private:
+  // Time from the server tick to this snapshot being handled. The burst's first
+  // snapshot is taken to be half the lowest round trip late, the rest of the
+  // burst is measured against it; a whole burst held back by a slow tick shows
+  // up in the ENet round trip instead.
+  double snapshot_latency(double arrival)
+  {
+    if (arrival - lastSnapshot > tick_ms * 0.5)
+      burstStart = arrival;
+    lastSnapshot = arrival;
+    return peer->lowestRoundTripTime * 0.5 + (arrival - burstStart);
+  }
+
+  uint16_t eid = invalid_entity;
+  InputWindow inputWindow{10};
+  std::mt19937 rng;
+  double nextInputChange = 0.0;
+  float thr = 0.f;
+  float steer = 0.f;
+  // snapshots carry no tick number, a gap of half a tick starts the next burst
+  double burstStart = 0.0;
+  double lastSnapshot = 0.0;
+};
+
+int main(int argc, const char **argv)
+{
+  LoadgenOptions options;
+  parse_loadgen_options(argc, argv, options);
+
+  if (packet_pool_initialize() != 0)
+  {
+    printf("Cannot init ENet");
+    return 1;
+  }
+
+  ENetAddress address;
+  if (enet_address_set_host(&address, options.hostName) != 0)
+  {
+    printf("Cannot resolve %s\n", options.hostName);
+    return 1;
+  }
+  address.port = options.port;
+
+  int result = run_loadgen(options, address, [](size_t index)
+  {
+    return std::make_unique<Bot>(uint32_t(index));
+  });
+
+  atexit(enet_deinitialize);
+  return result;
+}
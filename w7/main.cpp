@@ -8,10 +8,14 @@
 #include <vector>
 #include "entity.h"
 #include "protocol.h"
+#include "packetPool.h"
+#include "inputWindow.h"
 
 
 static std::vector<Entity> entities;
 static uint16_t my_entity = invalid_entity;
+// matches the server tick, input sampled any faster would be coalesced anyway
+static InputWindow inputWindow(10);
 
 void on_new_entity_packet(ENetPacket *packet)
 {
@@ -46,7 +50,7 @@ void on_snapshot(ENetPacket *packet)
 
 int main(int argc, const char **argv)
 {
-  if (enet_initialize() != 0)
+  if (packet_pool_initialize() != 0)
   {
     printf("Cannot init ENet");
     return 1;
@@ -140,7 +144,8 @@ int main(int argc, const char **argv)
           float steer = (left ? -1.f : 0.f) + (right ? 1.f : 0.f);
 
           // Send
-          send_entity_input(serverPeer, my_entity, thr, steer);
+          if (inputWindow.sample(enet_time_get(), thr, steer))
+            send_entity_input(serverPeer, my_entity, inputWindow.samples(), inputWindow.size());
         }
     }
 
@@ -0,0 +1,132 @@
+#include "packetPool.h"
+#include <enet/enet.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+static constexpr size_t class_sizes[] = {32, 64, 128, 256, 512, 1024, 2048};
+static constexpr uint32_t num_classes = sizeof(class_sizes) / sizeof(class_sizes[0]);
+static constexpr uint32_t large_class = num_classes;
+// keeps the block behind it aligned the way malloc would
+static constexpr size_t header_size = 16;
+static constexpr size_t blocks_per_slab = 64;
+
+struct FreeBlock
+{
+  FreeBlock *next;
+};
+
+struct SizeClass
+{
+  std::mutex lock;
+  FreeBlock *freeList = nullptr;
+};
+
+static SizeClass classes[num_classes];
+static std::atomic<uint64_t> allocs{0};
+static std::atomic<uint64_t> frees{0};
+static std::atomic<uint64_t> systemAllocs{0};
+static std::atomic<uint64_t> slabs{0};
+static std::atomic<uint64_t> reservedBytes{0};
+
+static uint32_t class_for(size_t size)
+{
+  for (uint32_t i = 0; i < num_classes; ++i)
+    if (size <= class_sizes[i])
+      return i;
+  return large_class;
+}
+
+// called with the class locked
+static bool refill(uint32_t cls)
+{
+  const size_t stride = header_size + class_sizes[cls];
+  uint8_t *slab = (uint8_t *)malloc(stride * blocks_per_slab);
+  if (!slab)
+    return false;
+  systemAllocs.fetch_add(1, std::memory_order_relaxed);
+  slabs.fetch_add(1, std::memory_order_relaxed);
+  reservedBytes.fetch_add(stride * blocks_per_slab, std::memory_order_relaxed);
+  for (size_t i = 0; i < blocks_per_slab; ++i)
+  {
+    FreeBlock *block = (FreeBlock *)(slab + i * stride);
+    block->next = classes[cls].freeList;
+    classes[cls].freeList = block;
+  }
+  return true;
+}
+
+static void *pool_malloc(size_t size)
+{
+  allocs.fetch_add(1, std::memory_order_relaxed);
+  const uint32_t cls = class_for(size);
+  uint8_t *block = nullptr;
+  if (cls == large_class)
+  {
+    systemAllocs.fetch_add(1, std::memory_order_relaxed);
+    block = (uint8_t *)malloc(header_size + size);
+  }
+  else
+  {
+    SizeClass &sizeClass = classes[cls];
+    std::lock_guard<std::mutex> guard(sizeClass.lock);
+    if (sizeClass.freeList || refill(cls))
+    {
+      block = (uint8_t *)sizeClass.freeList;
+      sizeClass.freeList = sizeClass.freeList->next;
+    }
+  }
+  if (!block)
+    return nullptr; // ENet calls its no_memory callback
+  *(uint32_t *)block = cls;
+  return block + header_size;
+}
+
+static void pool_free(void *memory)
+{
+  if (!memory)
+    return;
+  frees.fetch_add(1, std::memory_order_relaxed);
+  uint8_t *block = (uint8_t *)memory - header_size;
+  const uint32_t cls = *(uint32_t *)block;
+  if (cls == large_class)
+  {
+    free(block);
+    return;
+  }
+  SizeClass &sizeClass = classes[cls];
+  std::lock_guard<std::mutex> guard(sizeClass.lock);
+  FreeBlock *freed = (FreeBlock *)block;
+  freed->next = sizeClass.freeList;
+  sizeClass.freeList = freed;
+}
+
+int packet_pool_initialize()
+{
+  ENetCallbacks callbacks = {pool_malloc, pool_free, nullptr};
+  return enet_initialize_with_callbacks(ENET_VERSION, &callbacks);
+}
+
+PacketPoolStats packet_pool_stats()
+{
+  PacketPoolStats stats;
+  stats.allocs = allocs.load(std::memory_order_relaxed);
+  stats.frees = frees.load(std::memory_order_relaxed);
+  stats.systemAllocs = systemAllocs.load(std::memory_order_relaxed);
+  stats.slabs = slabs.load(std::memory_order_relaxed);
+  stats.reservedBytes = reservedBytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void print_packet_pool_stats(uint64_t ticks)
+{
+  static PacketPoolStats last;
+  const PacketPoolStats stats = packet_pool_stats();
+  const double perTick = ticks ? 1.0 / ticks : 0.0;
+  printf("Packet pool: %.1f allocs/tick, %.3f mallocs/tick, %llu blocks live, %llu slabs (%llu KiB)\n",
+         (stats.allocs - last.allocs) * perTick, (stats.systemAllocs - last.systemAllocs) * perTick,
+         (unsigned long long)(stats.allocs - stats.frees), (unsigned long long)stats.slabs,
+         (unsigned long long)(stats.reservedBytes / 1024));
+  last = stats;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+
+struct PacketPoolStats
+{
+  uint64_t allocs = 0;        // every enet_malloc
+  uint64_t frees = 0;
+  uint64_t systemAllocs = 0;  // allocs that went to malloc: new slabs and blocks too big for a class
+  uint64_t slabs = 0;
+  uint64_t reservedBytes = 0; // held in slabs, never given back
+};
+
+// Every allocation ENet makes comes from here once packet_pool_initialize()
+// replaced enet_initialize(). Blocks up to 2 KiB are taken from per size class
+// free lists, refilled a slab of 64 blocks at a time, and go back on the list
+// when ENet frees them. Our messages are a handful of fixed sizes, so after
+// warm up a packet and its data are two recycled blocks instead of two mallocs.
+// Safe to use from any thread.
+int packet_pool_initialize();
+
+PacketPoolStats packet_pool_stats();
+// allocations since the last call, per tick
+void print_packet_pool_stats(uint64_t ticks);
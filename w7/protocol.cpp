@@ -1,14 +1,31 @@
 #include "protocol.h"
 #include "quantisation.h"
 #include <cstring> // memcpy
+#include <algorithm>
 #include <iostream>
 
+static PacketSink packetSink = nullptr;
+
+void set_packet_sink(PacketSink sink)
+{
+  packetSink = sink;
+}
+
+// every packet goes out through here
+static void send_packet(ENetPeer *peer, uint8_t channel, ENetPacket *packet)
+{
+  if (packetSink)
+    packetSink(peer, channel, packet);
+  else
+    enet_peer_send(peer, channel, packet);
+}
+
 void send_join(ENetPeer *peer)
 {
   ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t), ENET_PACKET_FLAG_RELIABLE);
   *packet->data = E_CLIENT_TO_SERVER_JOIN;
 
-  enet_peer_send(peer, 0, packet);
+  send_packet(peer, 0, packet);
 }
 
 void send_new_entity(ENetPeer *peer, const Entity &ent)
@@ -19,7 +36,7 @@ void send_new_entity(ENetPeer *peer, const Entity &ent)
   *ptr = E_SERVER_TO_CLIENT_NEW_ENTITY; ptr += sizeof(uint8_t);
   memcpy(ptr, &ent, sizeof(Entity)); ptr += sizeof(Entity);
 
-  enet_peer_send(peer, 0, packet);
+  send_packet(peer, 0, packet);
 }
 
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
@@ -30,27 +47,35 @@ void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
   *ptr = E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY; ptr += sizeof(uint8_t);
   memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
 
-  enet_peer_send(peer, 0, packet);
+  send_packet(peer, 0, packet);
 }
 
-void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float ori)
+static constexpr size_t input_header_size = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint8_t);
+
+// Samples in a window have consecutive seqs, only the newest one goes over the
+// wire: [type][eid][newest seq][count][thr << 4 | steer] * count, oldest first.
+void send_entity_input(ENetPeer *peer, uint16_t eid, const InputSample *samples, size_t count)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) +
-                                                   sizeof(uint8_t),
+  count = std::min(count, input_window_size);
+  if (count == 0)
+    return;
+  ENetPacket *packet = enet_packet_create(nullptr, input_header_size + count * sizeof(uint8_t),
                                                    ENET_PACKET_FLAG_UNSEQUENCED);
   uint8_t *ptr = packet->data;
   *ptr = E_CLIENT_TO_SERVER_INPUT; ptr += sizeof(uint8_t);
   memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  float4bitsQuantized thrPacked(thr, -1.f, 1.f);
-  float4bitsQuantized oriPacked(ori, -1.f, 1.f);
-  uint8_t thrSteerPacked = (thrPacked.packedVal << 4) | oriPacked.packedVal;
-  memcpy(ptr, &thrSteerPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  /*
-  memcpy(ptr, &thrPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  memcpy(ptr, &oriPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  */
-
-  enet_peer_send(peer, 1, packet);
+  memcpy(ptr, &samples[count - 1].seq, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+  uint8_t count8 = count;
+  memcpy(ptr, &count8, sizeof(uint8_t)); ptr += sizeof(uint8_t);
+  for (size_t i = 0; i < count; ++i)
+  {
+    float4bitsQuantized thrPacked(samples[i].thr, -1.f, 1.f);
+    float4bitsQuantized oriPacked(samples[i].steer, -1.f, 1.f);
+    uint8_t thrSteerPacked = (thrPacked.packedVal << 4) | oriPacked.packedVal;
+    memcpy(ptr, &thrSteerPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
+  }
+
+  send_packet(peer, 1, packet);
 }
 
 typedef PackedFloat<uint16_t, 11> PositionXQuantized;
@@ -74,7 +99,7 @@ void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori)
   memcpy(ptr, &yPacked.packedVal, sizeof(uint16_t)); ptr += sizeof(uint16_t);
   memcpy(ptr, &oriPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
 
-  enet_peer_send(peer, 1, packet);
+  send_packet(peer, 1, packet);
 }
 
 MessageType get_packet_type(ENetPacket *packet)
@@ -94,21 +119,28 @@ void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
   eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
 }
 
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer)
+size_t deserialize_entity_input(ENetPacket *packet, uint16_t &eid, InputSample *samples)
 {
+  eid = invalid_entity;
+  if (packet->dataLength < input_header_size)
+    return 0;
   uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
   eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint8_t thrSteerPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  /*
-  uint8_t thrPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  uint8_t oriPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  */
+  uint16_t newestSeq = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
+  size_t count = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
+  count = std::min(count, std::min(input_window_size, packet->dataLength - input_header_size));
+
   static uint8_t neutralPackedValue = pack_float<uint8_t>(0.f, -1.f, 1.f, 4);
-  static uint8_t nominalPackedValue = pack_float<uint8_t>(1.f, 0.f, 1.2f, 4);
-  float4bitsQuantized thrPacked(thrSteerPacked >> 4);
-  float4bitsQuantized steerPacked(thrSteerPacked & 0x0f);
-  thr = thrPacked.packedVal == neutralPackedValue ? 0.f : thrPacked.unpack(-1.f, 1.f);
-  steer = steerPacked.packedVal == neutralPackedValue ? 0.f : steerPacked.unpack(-1.f, 1.f);
+  for (size_t i = 0; i < count; ++i)
+  {
+    uint8_t thrSteerPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
+    float4bitsQuantized thrPacked(thrSteerPacked >> 4);
+    float4bitsQuantized steerPacked(thrSteerPacked & 0x0f);
+    samples[i].seq = uint16_t(newestSeq - (count - 1 - i));
+    samples[i].thr = thrPacked.packedVal == neutralPackedValue ? 0.f : thrPacked.unpack(-1.f, 1.f);
+    samples[i].steer = steerPacked.packedVal == neutralPackedValue ? 0.f : steerPacked.unpack(-1.f, 1.f);
+  }
+  return count;
 }
 
 void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori)
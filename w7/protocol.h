@@ -1,6 +1,7 @@
 #pragma once
 #include <enet/enet.h>
 #include <cstdint>
+#include <cstddef>
 #include "entity.h"
 
 enum MessageType : uint8_t
@@ -12,16 +13,33 @@ enum MessageType : uint8_t
   E_SERVER_TO_CLIENT_SNAPSHOT
 };
 
+// Where the sends below hand their packets over: enet_peer_send by default, a
+// server whose host lives on a HostThread queues them for it instead.
+typedef void (*PacketSink)(ENetPeer *peer, uint8_t channel, ENetPacket *packet);
+void set_packet_sink(PacketSink sink);
+
 void send_join(ENetPeer *peer);
 void send_new_entity(ENetPeer *peer, const Entity &ent);
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid);
-void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float steer);
+
+// an input packet carries this many of the latest samples, oldest first
+constexpr size_t input_window_size = 3;
+
+struct InputSample
+{
+  uint16_t seq = 0;
+  float thr = 0.f;
+  float steer = 0.f;
+};
+
+void send_entity_input(ENetPeer *peer, uint16_t eid, const InputSample *samples, size_t count);
 void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori);
 
 MessageType get_packet_type(ENetPacket *packet);
 
 void deserialize_new_entity(ENetPacket *packet, Entity &ent);
 void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer);
+// samples needs room for input_window_size entries, returns how many were read
+size_t deserialize_entity_input(ENetPacket *packet, uint16_t &eid, InputSample *samples);
 void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori);
 
@@ -2,25 +2,55 @@
 #include <iostream>
 #include "entity.h"
 #include "protocol.h"
+#include "packetPool.h"
 #include "mathUtils.h"
+#include "tickScheduler.h"
+#include "entityRegistry.h"
+#include "hostThread.h"
 #include <stdlib.h>
 #include <vector>
 #include <map>
+#include <memory>
 
 static std::vector<Entity> entities;
+static EntityRegistry registry; // eid -> index in entities
 static std::map<uint16_t, ENetPeer*> controlledMap;
+// peers the network thread told us about, the ENetPeer itself is its business
+static std::map<ENetPeer*, ENetAddress> connectedPeers;
+static std::unique_ptr<HostThread> network;
 
-void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
+// Newest input per entity, indexed like entities. Packets only fill this in,
+// the tick applies it in one pass before simulating.
+struct PendingInput
+{
+  uint16_t seq = 0;
+  bool received = false;
+  bool fresh = false;
+  float thr = 0.f;
+  float steer = 0.f;
+};
+static std::vector<PendingInput> pendingInputs;
+
+// how far behind the newest seq an input still counts as reordered, further
+// back is treated as a restarted counter instead of ignoring the client
+constexpr uint16_t input_reorder_window = 256;
+
+constexpr uint32_t tick_ms = 10;
+constexpr uint32_t max_catch_up_ticks = 5;
+constexpr uint64_t tick_stats_interval = 1000;
+
+void on_join(ENetPacket *packet, ENetPeer *peer, const ENetAddress &address)
 {
   // send all entities
   for (const Entity &ent : entities)
     send_new_entity(peer, ent);
 
-  // find max eid
-  uint16_t maxEid = entities.empty() ? invalid_entity : entities[0].eid;
-  for (const Entity &e : entities)
-    maxEid = std::max(maxEid, e.eid);
-  uint16_t newEid = maxEid + 1;
+  uint16_t newEid = registry.create();
+  if (newEid == invalid_entity)
+  {
+    printf("No free entity slots for %x:%u\n", address.host, address.port);
+    return;
+  }
   uint32_t color = 0xff000000 +
                    0x00440000 * (rand() % 5) +
                    0x00004400 * (rand() % 5) +
@@ -29,33 +59,92 @@ void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
   float y = (rand() % 4) * 5.f;
   Entity ent = {color, x, y, 0.f, (rand() / RAND_MAX) * 3.141592654f, 0.f, 0.f, newEid};
   entities.push_back(ent);
+  pendingInputs.resize(entities.size());
+  pendingInputs[registry.find(newEid)] = PendingInput();
 
   controlledMap[newEid] = peer;
 
 
   // send info about new entity to everyone
-  for (size_t i = 0; i < host->peerCount; ++i)
-    send_new_entity(&host->peers[i], ent);
+  for (const auto &[other, otherAddress] : connectedPeers)
+    send_new_entity(other, ent);
   // send info about controlled entity
   send_set_controlled_entity(peer, newEid);
 }
 
-void on_input(ENetPacket *packet)
+void on_input(ENetPacket *packet, ENetPeer *peer)
 {
   uint16_t eid = invalid_entity;
-  float thr = 0.f; float steer = 0.f;
-  deserialize_entity_input(packet, eid, thr, steer);
-  for (Entity &e : entities)
-    if (e.eid == eid)
+  InputSample samples[input_window_size];
+  size_t count = deserialize_entity_input(packet, eid, samples);
+  // eid comes from the client: it has to be live and controlled by this peer
+  size_t idx = registry.find(eid);
+  auto controller = controlledMap.find(eid);
+  if (count == 0 || idx == EntityRegistry::npos || controller == controlledMap.end() || controller->second != peer)
+    return;
+
+  // only the newest sample counts, the window exists for the packets that got lost
+  const InputSample &newest = samples[count - 1];
+  PendingInput &input = pendingInputs[idx];
+  if (input.received && uint16_t(input.seq - newest.seq) < input_reorder_window)
+    return; // duplicate or out of order
+  input.seq = newest.seq;
+  input.received = true;
+  input.fresh = true;
+  input.thr = newest.thr;
+  input.steer = newest.steer;
+}
+
+void apply_inputs()
+{
+  for (size_t i = 0; i < pendingInputs.size(); ++i)
+  {
+    PendingInput &input = pendingInputs[i];
+    if (!input.fresh)
+      continue;
+    entities[i].thr = input.thr;
+    entities[i].steer = input.steer;
+    input.fresh = false;
+  }
+}
+
+// everything the network thread got since the last tick, in the order it came
+void handle_events()
+{
+  HostEvent event;
+  while (network->receive(event))
+  {
+    switch (event.type)
     {
-      e.thr = thr;
-      e.steer = steer;
-    }
+    case ENET_EVENT_TYPE_CONNECT:
+      printf("Connection with %x:%u established\n", event.address.host, event.address.port);
+      connectedPeers[event.peer] = event.address;
+      break;
+    case ENET_EVENT_TYPE_DISCONNECT:
+      printf("Disconnected %x:%u\n", event.address.host, event.address.port);
+      connectedPeers.erase(event.peer);
+      break;
+    case ENET_EVENT_TYPE_RECEIVE:
+      switch (get_packet_type(event.packet))
+      {
+        case E_CLIENT_TO_SERVER_JOIN:
+          on_join(event.packet, event.peer, event.address);
+          break;
+        case E_CLIENT_TO_SERVER_INPUT:
+          on_input(event.packet, event.peer);
+          break;
+      };
+      enet_packet_destroy(event.packet);
+      break;
+    default:
+      break;
+    };
+  }
 }
 
 int main(int argc, const char **argv)
 {
-  if (enet_initialize() != 0)
+  if (packet_pool_initialize() != 0)
   {
     printf("Cannot init ENet");
     return 1;
@@ -65,7 +154,8 @@ int main(int argc, const char **argv)
   address.host = ENET_HOST_ANY;
   address.port = 10131;
 
-  ENetHost *server = enet_host_create(&address, 32, 2, 0, 0);
+  // as many peers as ENet can address, so w7_loadgen can bring thousands of bots
+  ENetHost *server = enet_host_create(&address, ENET_PROTOCOL_MAXIMUM_PEER_ID, 2, 0, 0);
 
   if (!server)
   {
@@ -73,53 +163,41 @@ int main(int argc, const char **argv)
     return 1;
   }
 
-  uint32_t lastTime = enet_time_get();
+  // ENet gets a thread of its own, every send of the tick is queued for it
+  network = std::make_unique<HostThread>(server);
+  set_packet_sink([](ENetPeer *peer, uint8_t channel, ENetPacket *packet) { network->send(peer, channel, packet); });
+  network->start();
+
+  TickScheduler scheduler(tick_ms, max_catch_up_ticks);
   while (true)
   {
-    uint32_t curTime = enet_time_get();
-    float dt = (curTime - lastTime) * 0.001f;
-    lastTime = curTime;
-    ENetEvent event;
-    while (enet_host_service(server, &event, 0) > 0)
-    {
-      switch (event.type)
-      {
-      case ENET_EVENT_TYPE_CONNECT:
-        printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
-        break;
-      case ENET_EVENT_TYPE_RECEIVE:
-        switch (get_packet_type(event.packet))
-        {
-          case E_CLIENT_TO_SERVER_JOIN:
-            on_join(event.packet, event.peer, server);
-            break;
-          case E_CLIENT_TO_SERVER_INPUT:
-            on_input(event.packet);
-            break;
-        };
-        enet_packet_destroy(event.packet);
-        break;
-      default:
-        break;
-      };
-    }
-    static int t = 0;
+    scheduler.wait();
+    uint32_t steps = scheduler.advance();
+    if (steps == 0)
+      continue;
+    handle_events();
+    apply_inputs();
     for (Entity &e : entities)
     {
       // simulate
-      simulate_entity(e, dt);
+      for (uint32_t i = 0; i < steps; ++i)
+        simulate_entity(e, scheduler.dt());
       // send
-      for (size_t i = 0; i < server->peerCount; ++i)
+      for (const auto &[peer, address] : connectedPeers)
       {
-        ENetPeer *peer = &server->peers[i];
         // skip this here in this implementation
         //if (controlledMap[e.eid] != peer)
         send_snapshot(peer, e.eid, e.x, e.y, e.ori);
       }
     }
-    usleep(10000);
+    if (scheduler.stats().ticks >= tick_stats_interval)
+    {
+      print_packet_pool_stats(scheduler.stats().ticks);
+      print_tick_stats(scheduler);
+    }
   }
 
+  network->stop();
   enet_host_destroy(server);
 
   atexit(enet_deinitialize);
@@ -0,0 +1,70 @@
+#include "tickScheduler.h"
+#include <cstdio>
+#include <thread>
+#if defined(__linux__)
+#include <errno.h>
+#include <time.h>
+#endif
+
+TickScheduler::TickScheduler(uint32_t tickMs, uint32_t maxCatchUpTicks) :
+  tickMs(tickMs), maxCatchUpTicks(maxCatchUpTicks > 0 ? maxCatchUpTicks : 1),
+  period(std::chrono::milliseconds(tickMs)), nextTick(Clock::now() + period)
+{
+}
+
+uint32_t TickScheduler::service_timeout() const
+{
+  Clock::time_point now = Clock::now();
+  if (now >= nextTick)
+    return 0;
+  return uint32_t(std::chrono::duration_cast<std::chrono::milliseconds>(nextTick - now).count());
+}
+
+void TickScheduler::wait() const
+{
+#if defined(__linux__)
+  // steady_clock is CLOCK_MONOTONIC here, so the deadline can be slept on directly
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(nextTick.time_since_epoch()).count();
+  timespec deadline;
+  deadline.tv_sec = ns / 1000000000;
+  deadline.tv_nsec = ns % 1000000000;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+    ;
+#else
+  std::this_thread::sleep_until(nextTick);
+#endif
+}
+
+uint32_t TickScheduler::advance()
+{
+  Clock::time_point now = Clock::now();
+  if (now < nextTick)
+    return 0;
+
+  double lateMs = std::chrono::duration<double, std::milli>(now - nextTick).count();
+  tickStats.wakeUps++;
+  tickStats.sumLateMs += lateMs;
+  if (lateMs > tickStats.maxLateMs)
+    tickStats.maxLateMs = lateMs;
+
+  uint32_t due = 1 + uint32_t((now - nextTick) / period);
+  uint32_t steps = due < maxCatchUpTicks ? due : maxCatchUpTicks;
+  if (due > 1)
+    tickStats.overruns++;
+  // ticks past the limit are dropped, otherwise a slow tick snowballs into
+  // ever longer catch up bursts
+  tickStats.droppedTicks += due - steps;
+  tickStats.ticks += steps;
+  nextTick += due * period;
+  return steps;
+}
+
+void print_tick_stats(TickScheduler &scheduler)
+{
+  const TickStats &stats = scheduler.stats();
+  printf("Ticks %llu, late avg %.3f ms max %.3f ms, overruns %llu, dropped %llu\n",
+         (unsigned long long)stats.ticks,
+         stats.wakeUps ? stats.sumLateMs / stats.wakeUps : 0.0, stats.maxLateMs,
+         (unsigned long long)stats.overruns, (unsigned long long)stats.droppedTicks);
+  scheduler.reset_stats();
+}